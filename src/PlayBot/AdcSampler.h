@@ -0,0 +1,94 @@
+// AdcSampler.h
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include "Config.h"
+#include <Arduino.h>
+#include <DMAChannel.h>
+
+// Background conversions of the analog sensors on ADC2
+// ADC2 converts the inputs one after the other without the CPU: each
+// result raises a DMA request, one DMA channel moves it into a ring of
+// ADC_SWEEPS results per input, and a linked channel writes the next input
+// to ADC2_HC0, which starts the next conversion. Every result is already
+// the hardware average of several samples. read() averages the ring of an
+// input, a fixed number of reads whatever the loop is doing.
+// ADC2 belongs to the sampler: analogRead() must not be used on it.
+// The sampler must be a global so the ring is in DTCM, which the DMA
+// writes without going through the data cache.
+class AdcSampler {
+public:
+    enum Channel : uint8_t {
+        ADC_IR_RIGHT,
+        ADC_IR_LEFT,
+        ADC_LIGHT,
+        ADC_USB_DETECT,
+        ADC_CHANNEL_COUNT
+    };
+
+private:
+    static constexpr uint8_t inputs[ADC_CHANNEL_COUNT] = {
+        IR_SENSOR_RIGHT_ADC, IR_SENSOR_LEFT_ADC, LIGHT_SENSOR_ADC, USB_DETECT_ADC
+    };
+
+    static const uint8_t RESULT_COUNT = ADC_SWEEPS * ADC_CHANNEL_COUNT;
+
+    // Result i of the ring belongs to channel i % ADC_CHANNEL_COUNT
+    volatile uint16_t results[RESULT_COUNT];
+    // ADC2_HC0 words in conversion order, starting with the second channel:
+    // the first conversion is started by begin()
+    uint32_t nextInputs[ADC_CHANNEL_COUNT];
+    DMAChannel resultDma;
+    DMAChannel inputDma;
+
+public:
+    AdcSampler() {
+        for (uint8_t i = 0; i < RESULT_COUNT; i++) {
+            results[i] = 0;
+        }
+        for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+            nextInputs[i] = ADC_HC_ADCH(inputs[(i + 1) % ADC_CHANNEL_COUNT]);
+        }
+    }
+
+    // Start the conversions, ADC2 keeps the resolution and clock set by the core
+    void begin() {
+        ADC2_CFG = (ADC2_CFG & ~ADC_CFG_AVGS(3)) | ADC_CFG_AVGS(ADC_AVERAGING_SELECT);
+        ADC2_GC |= ADC_GC_AVGE | ADC_GC_DMAEN;
+
+        resultDma.begin();
+        resultDma.source((volatile uint16_t&)ADC2_R0);
+        resultDma.destinationBuffer(results, sizeof(results));
+        resultDma.triggerAtHardwareEvent(DMAMUX_SOURCE_ADC2);
+
+        // Runs after every result, including the one ending the ring
+        inputDma.begin();
+        inputDma.sourceBuffer(nextInputs, sizeof(nextInputs));
+        inputDma.destination(ADC2_HC0);
+        inputDma.triggerAtTransfersOf(resultDma);
+        inputDma.triggerAtCompletionOf(resultDma);
+
+        inputDma.enable();
+        resultDma.enable();
+        ADC2_HC0 = ADC_HC_ADCH(inputs[0]);
+    }
+
+    // Channel value averaged over the last ADC_SWEEPS results, same scale as analogRead()
+    uint16_t read(Channel channel) const {
+        uint32_t sum = 0;
+        for (uint8_t sweep = 0; sweep < ADC_SWEEPS; sweep++) {
+            sum += results[sweep * ADC_CHANNEL_COUNT + channel];
+        }
+        return sum / ADC_SWEEPS;
+    }
+
+    // Newest result of a channel, unfiltered
+    // The slot the DMA writes next tells how far the current sweep has got.
+    uint16_t latest(Channel channel) {
+        uint32_t next = (volatile uint16_t*)resultDma.destinationAddress() - results;
+        uint32_t behind = (next + RESULT_COUNT - 1 - channel) % ADC_CHANNEL_COUNT;
+        return results[(next + RESULT_COUNT - 1 - behind) % RESULT_COUNT];
+    }
+};
+
+#endif // ADC_SAMPLER_H
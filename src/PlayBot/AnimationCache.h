@@ -0,0 +1,272 @@
+// AnimationCache.h
+#ifndef ANIMATION_CACHE_H
+#define ANIMATION_CACHE_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "AnimationFormat.h"
+#include <SD.h>
+
+#if defined(ARDUINO_TEENSY41)
+extern "C" uint8_t external_psram_size;  // PSRAM fitted on the Teensy 4.1, in MB
+#endif
+
+// LRU cache of whole animation files in RAM
+// Uses external PSRAM when fitted, otherwise a smaller block of internal RAM.
+// The arena is allocated once at startup, files are placed in free gaps and
+// never moved, so a cached animation can play straight from memory while
+// other files are loaded or evicted around it.
+// Files are loaded in chunks from the main loop while no animation plays:
+// - Requested by Playdate "p/path1,path2,..." preload messages
+// - Queued automatically after a cache miss
+class AnimationCache {
+public:
+    // Cached file, readable once loaded
+    struct Entry {
+        uint32_t pathHash;        // FNV-1a hash of the file path
+        char path[ANIMATION_CACHE_PATH_LENGTH]; // File path
+        uint32_t offset;          // Start of data in the arena
+        uint32_t size;            // File size in bytes
+        uint32_t lastUsed;        // LRU timestamp (use counter)
+        uint8_t pinCount;         // Active readers, pinned entries are never evicted
+        bool used;                // Slot holds a file
+        bool loaded;              // All bytes are in the arena
+    };
+
+private:
+    static const size_t LOAD_CHUNK_SIZE = 2048;  // Bytes read from SD per loop pass
+
+    uint8_t* arena;               // Cache memory
+    uint32_t capacity;            // Arena size in bytes
+    bool inPSRAM;                 // Arena allocated in external PSRAM
+    Entry entries[ANIMATION_CACHE_ENTRIES];
+    uint32_t useCounter;          // Monotonic counter for LRU ordering
+
+    // Pending preloads
+    char preloadQueue[ANIMATION_PRELOAD_QUEUE][ANIMATION_CACHE_PATH_LENGTH];
+    uint8_t preloadHead;          // Next path to load
+    uint8_t preloadCount;         // Paths waiting
+
+    // File being loaded
+    File loadFile;                // Open SD file
+    Entry* loadEntry;             // Entry being filled
+    uint32_t loadedBytes;         // Bytes copied so far
+
+    // Statistics
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+
+    // Find entry for a path, loaded or not
+    Entry* find(const char* path) {
+        uint32_t hash = animationPathHash(path);
+        for (Entry& entry : entries) {
+            if (entry.used && entry.pathHash == hash && strcmp(entry.path, path) == 0) return &entry;
+        }
+        return nullptr;
+    }
+
+    // Find a gap of at least size bytes between cached files
+    // Returns false if no gap is large enough
+    bool findGap(uint32_t size, uint32_t& offset) {
+        uint32_t candidate = 0;
+        while (candidate + size <= capacity) {
+            // Look for an entry overlapping [candidate, candidate + size)
+            Entry* blocker = nullptr;
+            for (Entry& entry : entries) {
+                if (entry.used && entry.offset < candidate + size && candidate < entry.offset + entry.size) {
+                    if (!blocker || entry.offset + entry.size > blocker->offset + blocker->size) blocker = &entry;
+                }
+            }
+            if (!blocker) {
+                offset = candidate;
+                return true;
+            }
+            candidate = blocker->offset + blocker->size;
+        }
+        return false;
+    }
+
+    // Evict the least recently used entry that is not pinned
+    // Returns false if every entry is pinned or being loaded
+    bool evictOldest() {
+        Entry* oldest = nullptr;
+        for (Entry& entry : entries) {
+            if (!entry.used || entry.pinCount > 0 || &entry == loadEntry) continue;
+            if (!oldest || entry.lastUsed < oldest->lastUsed) oldest = &entry;
+        }
+        if (!oldest) return false;
+
+        DEBUG_PRINT(DEBUG_VERBOSE, "Animation cache evicted: %s", oldest->path);
+        oldest->used = false;
+        evictions++;
+        return true;
+    }
+
+    // Reserve arena space and an entry for a file
+    // Evicts old files until the new one fits
+    Entry* allocate(const char* path, uint32_t size) {
+        uint32_t offset;
+        while (!findGap(size, offset)) {
+            if (!evictOldest()) return nullptr;
+        }
+
+        Entry* slot = nullptr;
+        for (Entry& entry : entries) {
+            if (!entry.used) {
+                slot = &entry;
+                break;
+            }
+        }
+        if (!slot) {
+            if (!evictOldest()) return nullptr;
+            return allocate(path, size);
+        }
+
+        slot->pathHash = animationPathHash(path);
+        strlcpy(slot->path, path, sizeof(slot->path));
+        slot->offset = offset;
+        slot->size = size;
+        slot->lastUsed = ++useCounter;
+        slot->pinCount = 0;
+        slot->used = true;
+        slot->loaded = false;
+        return slot;
+    }
+
+    // Open the next queued file and reserve its space
+    void beginNextLoad() {
+        while (preloadCount > 0 && !loadEntry) {
+            const char* path = preloadQueue[preloadHead];
+            preloadHead = (preloadHead + 1) % ANIMATION_PRELOAD_QUEUE;
+            preloadCount--;
+
+            if (find(path)) continue;  // Already cached or loading
+
+            loadFile = SD.open(path);
+            if (!loadFile) {
+                DEBUG_PRINT(DEBUG_WARNING, "Preload failed to open: %s", path);
+                continue;
+            }
+            uint32_t size = loadFile.size();
+            loadEntry = (size > 0 && size <= capacity) ? allocate(path, size) : nullptr;
+            if (!loadEntry) {
+                DEBUG_PRINT(DEBUG_WARNING, "Preload does not fit in cache: %s", path);
+                loadFile.close();
+                continue;
+            }
+            loadedBytes = 0;
+        }
+    }
+
+public:
+    AnimationCache()
+        : arena(nullptr)
+        , capacity(0)
+        , inPSRAM(false)
+        , useCounter(0)
+        , preloadHead(0)
+        , preloadCount(0)
+        , loadEntry(nullptr)
+        , loadedBytes(0)
+        , hits(0)
+        , misses(0)
+        , evictions(0) {
+        memset(entries, 0, sizeof(entries));
+    }
+
+    // Allocate the cache arena, in PSRAM when fitted
+    // Called once during setup, never reallocated afterwards
+    bool initialize() {
+#if defined(ARDUINO_TEENSY41)
+        if (external_psram_size > 0) {
+            arena = (uint8_t*)extmem_malloc(ANIMATION_CACHE_PSRAM_BUDGET);
+            if (arena) {
+                capacity = ANIMATION_CACHE_PSRAM_BUDGET;
+                inPSRAM = true;
+            }
+        }
+#endif
+        if (!arena) {
+            arena = (uint8_t*)malloc(ANIMATION_CACHE_RAM_BUDGET);
+            capacity = arena ? ANIMATION_CACHE_RAM_BUDGET : 0;
+        }
+
+        if (!arena) {
+            DEBUG_PRINT(DEBUG_WARNING, "Animation cache allocation failed");
+            return false;
+        }
+        DEBUG_PRINT(DEBUG_INFO, "Animation cache: %luKB in %s",
+                    (unsigned long)(capacity / 1024), inPSRAM ? "PSRAM" : "RAM");
+        return true;
+    }
+
+    // Queue a file for loading during idle time
+    // Returns false if the queue is full
+    bool queuePreload(const char* path) {
+        if (!arena || path[0] == '\0') return false;
+        if (preloadCount >= ANIMATION_PRELOAD_QUEUE) {
+            DEBUG_PRINT(DEBUG_WARNING, "Preload queue full");
+            return false;
+        }
+        uint8_t index = (preloadHead + preloadCount) % ANIMATION_PRELOAD_QUEUE;
+        strlcpy(preloadQueue[index], path, ANIMATION_CACHE_PATH_LENGTH);
+        preloadCount++;
+        return true;
+    }
+
+    // Load one chunk of pending preloads - called in main loop while idle
+    void service() {
+        if (!loadEntry) beginNextLoad();
+        if (!loadEntry) return;
+
+        uint32_t chunk = min((uint32_t)LOAD_CHUNK_SIZE, loadEntry->size - loadedBytes);
+        int bytesRead = loadFile.read(arena + loadEntry->offset + loadedBytes, chunk);
+        if (bytesRead <= 0) {
+            DEBUG_PRINT(DEBUG_WARNING, "Preload read failed: %s", loadEntry->path);
+            loadEntry->used = false;
+        } else {
+            loadedBytes += bytesRead;
+            if (loadedBytes < loadEntry->size) return;
+            loadEntry->loaded = true;
+            DEBUG_PRINT(DEBUG_INFO, "Animation cached: %s (%lu bytes) - Hits: %lu, Misses: %lu, Evictions: %lu",
+                        loadEntry->path, (unsigned long)loadEntry->size, (unsigned long)hits,
+                        (unsigned long)misses, (unsigned long)evictions);
+        }
+        loadFile.close();
+        loadEntry = nullptr;
+    }
+
+    // Look up a cached file and pin it for playback
+    // A miss queues the file so the next play is served from RAM
+    const Entry* acquire(const char* path) {
+        Entry* entry = find(path);
+        if (entry && entry->loaded) {
+            hits++;
+            entry->lastUsed = ++useCounter;
+            entry->pinCount++;
+            return entry;
+        }
+        misses++;
+        if (!entry) queuePreload(path);
+        return nullptr;
+    }
+
+    // Unpin a file acquired for playback
+    void release(const Entry* entry) {
+        if (entry && entry->pinCount > 0) {
+            const_cast<Entry*>(entry)->pinCount--;
+        }
+    }
+
+    // Data of a cached file
+    const uint8_t* getData(const Entry* entry) const { return arena + entry->offset; }
+
+    // Statistics getters
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+    uint32_t getEvictions() const { return evictions; }
+    bool hasPendingLoads() const { return loadEntry || preloadCount > 0; }
+};
+
+#endif // ANIMATION_CACHE_H
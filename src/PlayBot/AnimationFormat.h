@@ -0,0 +1,105 @@
+// AnimationFormat.h
+#ifndef ANIMATION_FORMAT_H
+#define ANIMATION_FORMAT_H
+
+#include <stdint.h>
+
+// Precompiled binary animation format (.pba)
+// Produced on the host by tools/AnimationCompiler from the exported .txt
+// animations, and played back by AnimationManager without any text parsing.
+// This header is shared by the firmware and the host compiler, so it must
+// only depend on the C standard headers.
+//
+// Two layouts share the same header (little-endian):
+// - Dense frames (version 1): frameCount frames, each holding one int16 per
+//   channel set in channelMask, in channel order: head, right wheel, left wheel
+// - Keyframes (version 2): frameCount AnimationKey records. Each key belongs
+//   to one channel and sets the easing of the segment leaving it. Keys are
+//   sorted by the time of the previous key on the same channel, so the
+//   player can stream them with a single key of look-ahead.
+
+// ================= Format Identification =================
+#define ANIMATION_MAGIC "PBA\x1A"           // First 4 bytes of every .pba file
+#define ANIMATION_MAGIC_LENGTH 4
+#define ANIMATION_VERSION_FRAMES 1          // Dense frames at frameRate
+#define ANIMATION_VERSION_KEYFRAMES 2       // Sparse time-stamped keys
+#define ANIMATION_DEFAULT_FRAME_RATE 30     // fps of exported .txt animations
+
+// ================= Channel Mask =================
+// A channel missing from the mask keeps its previous value during playback
+#define ANIMATION_CHANNEL_HEAD 0x01         // Head servo position (500-2500 µs)
+#define ANIMATION_CHANNEL_WHEEL_RIGHT 0x02  // Right wheel target (encoder ticks)
+#define ANIMATION_CHANNEL_WHEEL_LEFT 0x04   // Left wheel target (encoder ticks)
+#define ANIMATION_CHANNEL_ALL 0x07
+#define ANIMATION_CHANNEL_COUNT 3
+
+// Channel indices, as stored in keyframe records
+#define ANIMATION_TRACK_HEAD 0
+#define ANIMATION_TRACK_WHEEL_RIGHT 1
+#define ANIMATION_TRACK_WHEEL_LEFT 2
+
+// ================= Keyframe Easing =================
+// Interpolation from a key to the next key on the same channel
+#define ANIMATION_EASE_STEP 0               // Hold value until the next key
+#define ANIMATION_EASE_LINEAR 1             // Constant speed
+#define ANIMATION_EASE_CUBIC 2              // Cubic ease-in/ease-out
+
+// Head servo range accepted by playback
+#define ANIMATION_HEAD_MIN 500
+#define ANIMATION_HEAD_MAX 2500
+#define ANIMATION_HEAD_CENTER 1500          // Neutral position, offsets of additive layers
+
+// File header, stored once at the start of the file
+struct AnimationHeader {
+    char magic[ANIMATION_MAGIC_LENGTH];  // ANIMATION_MAGIC
+    uint8_t version;                     // ANIMATION_VERSION_*
+    uint8_t frameRate;                   // Frames per second (source rate for keyframes)
+    uint16_t channelMask;                // ANIMATION_CHANNEL_* bits present in the file
+    uint32_t frameCount;                 // Number of frames or keys following the header
+};
+static_assert(sizeof(AnimationHeader) == 12, "AnimationHeader must stay 12 bytes");
+
+// Decoded animation frame, one value per channel
+struct AnimationFrame {
+    int16_t head;        // Head servo position (µs)
+    int16_t wheelRight;  // Right wheel target (encoder ticks)
+    int16_t wheelLeft;   // Left wheel target (encoder ticks)
+};
+static_assert(sizeof(AnimationFrame) == ANIMATION_CHANNEL_COUNT * sizeof(int16_t),
+              "AnimationFrame must match the packed channel order");
+
+// Keyframe record (version 2)
+struct AnimationKey {
+    uint32_t timeMs;     // Time from animation start (ms)
+    int16_t value;       // Channel value
+    uint8_t channel;     // Channel index: 0 head, 1 right wheel, 2 left wheel
+    uint8_t easing;      // ANIMATION_EASE_* towards the next key of the channel
+};
+static_assert(sizeof(AnimationKey) == 8, "AnimationKey must stay 8 bytes");
+
+// Size in bytes of one stored frame for a given channel mask
+inline uint8_t animationFrameSize(uint16_t channelMask) {
+    uint8_t size = 0;
+    for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+        if (channelMask & (1 << channel)) size += sizeof(int16_t);
+    }
+    return size;
+}
+
+// Check if a head value is a servo command
+// Other values mean "no head command" and hold the head
+inline bool animationIsValidHead(int32_t head) {
+    return head >= ANIMATION_HEAD_MIN && head <= ANIMATION_HEAD_MAX;
+}
+
+// FNV-1a hash of an animation path, used for constant-time lookups
+inline uint32_t animationPathHash(const char* path) {
+    uint32_t hash = 2166136261u;
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif // ANIMATION_FORMAT_H
@@ -0,0 +1,412 @@
+// AnimationIndex.h
+#ifndef ANIMATION_INDEX_H
+#define ANIMATION_INDEX_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "AnimationFormat.h"
+#include <SD.h>
+
+// Index of the animations stored on the SD card
+// Built by StorageManager at boot: the card is walked once, files already
+// in the index file with the same size are kept as they are, new or changed
+// files are read once to validate them and measure their length. The index
+// file is rewritten only when something changed.
+// Lookups go through an in-memory hash table, so the trigger path checks a
+// path without any directory walk or file open. Files that fail validation
+// stay in the index, flagged, so they are rejected with a clear reason.
+class AnimationIndex {
+public:
+    // Indexed animation file, stored as is in the index file
+    struct Entry {
+        uint32_t pathHash;        // FNV-1a hash of the path
+        uint32_t size;            // File size in bytes, detects changed files
+        uint32_t frameCount;      // Frames (text, dense) or keys (keyframes)
+        uint32_t durationMs;      // Playback length
+        uint32_t checksum;        // CRC-32 of the whole file
+        uint16_t dataOffset;      // First frame or key byte, after the binary header
+        uint8_t valid;            // File is a well formed animation
+        uint8_t reserved;
+        char path[ANIMATION_CACHE_PATH_LENGTH]; // Path without leading '/'
+    };
+
+private:
+    // Index file header
+    struct FileHeader {
+        char magic[4];            // "PBX\x1A"
+        uint16_t version;         // Bumped when Entry changes
+        uint16_t count;           // Entries following the header
+    };
+    static const uint16_t FILE_VERSION = 1;
+    static const int16_t EMPTY_SLOT = -1;
+    static const uint16_t SLOT_COUNT = ANIMATION_INDEX_ENTRIES * 2; // Hash table slots, half full at most
+
+    Entry entries[ANIMATION_INDEX_ENTRIES];
+    uint16_t entryCount;
+    int16_t slots[SLOT_COUNT];    // Entry index per hash slot, open addressing
+    bool seen[ANIMATION_INDEX_ENTRIES]; // Entry found during the current scan
+    bool ready;                   // Index built from the card
+    bool complete;                // Every animation on the card fits in the index
+    bool changed;                 // Index file needs rewriting
+
+    // Drop a leading '/' so "/anims/a.pba" and "anims/a.pba" match
+    static const char* normalizePath(const char* path) {
+        return path[0] == '/' ? path + 1 : path;
+    }
+
+    // Check if a path is one of the firmware's own files at the SD root
+    // Their lines can look like frames (PID_GAINS_FILE: "wheel/kP/kI/kD")
+    static bool isDataFile(const char* path) {
+        path = normalizePath(path);
+        return strcasecmp(path, normalizePath(ANIMATION_INDEX_FILE)) == 0 ||
+               strcasecmp(path, normalizePath(PID_GAINS_FILE)) == 0 ||
+               strcasecmp(path, normalizePath(FEEDFORWARD_FILE)) == 0;
+    }
+
+    // Check if a file name has an animation extension
+    static bool isAnimationFile(const char* name) {
+        const char* dot = strrchr(name, '.');
+        if (!dot) return false;
+        return strcasecmp(dot, ".txt") == 0 || strcasecmp(dot, ".pba") == 0;
+    }
+
+    // Update a CRC-32 (IEEE) with a block of bytes
+    static uint32_t updateChecksum(uint32_t crc, const uint8_t* data, size_t length) {
+        static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+        };
+        crc = ~crc;
+        while (length--) {
+            crc ^= *data++;
+            crc = (crc >> 4) ^ table[crc & 0x0F];
+            crc = (crc >> 4) ^ table[crc & 0x0F];
+        }
+        return ~crc;
+    }
+
+    // Rebuild the hash table from the entry list
+    void rebuildSlots() {
+        for (uint16_t i = 0; i < SLOT_COUNT; i++) slots[i] = EMPTY_SLOT;
+        for (uint16_t i = 0; i < entryCount; i++) {
+            uint16_t slot = entries[i].pathHash % SLOT_COUNT;
+            while (slots[slot] != EMPTY_SLOT) slot = (slot + 1) % SLOT_COUNT;
+            slots[slot] = i;
+        }
+    }
+
+    // Find the entry index of a normalized path, or -1
+    int16_t findIndex(const char* path) const {
+        uint32_t hash = animationPathHash(path);
+        uint16_t slot = hash % SLOT_COUNT;
+        while (slots[slot] != EMPTY_SLOT) {
+            const Entry& entry = entries[slots[slot]];
+            if (entry.pathHash == hash && strcmp(entry.path, path) == 0) return slots[slot];
+            slot = (slot + 1) % SLOT_COUNT;
+        }
+        return EMPTY_SLOT;
+    }
+
+    // Load the index file written at the previous boot
+    void loadFile() {
+        entryCount = 0;
+        File file = SD.open(ANIMATION_INDEX_FILE, FILE_READ);
+        if (!file) return;
+
+        FileHeader header;
+        if (file.read(&header, sizeof(header)) == sizeof(header) &&
+            memcmp(header.magic, "PBX\x1A", 4) == 0 && header.version == FILE_VERSION) {
+            uint16_t count = min(header.count, (uint16_t)ANIMATION_INDEX_ENTRIES);
+            while (entryCount < count &&
+                   file.read(&entries[entryCount], sizeof(Entry)) == sizeof(Entry)) {
+                entries[entryCount].path[ANIMATION_CACHE_PATH_LENGTH - 1] = '\0';
+                entryCount++;
+            }
+        }
+        file.close();
+        rebuildSlots();
+    }
+
+    // Write the index so the next boot only has to list the card
+    void saveFile() {
+        SD.remove(ANIMATION_INDEX_FILE);
+        File file = SD.open(ANIMATION_INDEX_FILE, FILE_WRITE);
+        if (!file) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to write animation index");
+            return;
+        }
+        FileHeader header = {{'P', 'B', 'X', 0x1A}, FILE_VERSION, entryCount};
+        file.write((const uint8_t*)&header, sizeof(header));
+        file.write((const uint8_t*)entries, sizeof(Entry) * entryCount);
+        file.close();
+    }
+
+    // Validate a binary animation and measure its length
+    // Reads the keys of keyframe files to find the last key time
+    bool analyzeBinary(File& file, Entry& entry, uint32_t& crc) {
+        AnimationHeader header;
+        if (file.read(&header, sizeof(header)) != sizeof(header)) return false;
+        crc = updateChecksum(crc, (const uint8_t*)&header, sizeof(header));
+        if (memcmp(header.magic, ANIMATION_MAGIC, ANIMATION_MAGIC_LENGTH) != 0) return false;
+
+        uint8_t frameRate = header.frameRate > 0 ? header.frameRate : ANIMATION_DEFAULT_FRAME_RATE;
+        entry.frameCount = header.frameCount;
+        entry.dataOffset = sizeof(header);
+
+        if (header.version == ANIMATION_VERSION_FRAMES) {
+            uint32_t expected = sizeof(header) + header.frameCount * animationFrameSize(header.channelMask);
+            entry.durationMs = (uint64_t)header.frameCount * 1000 / frameRate;
+            return entry.size == expected;
+        }
+        if (header.version == ANIMATION_VERSION_KEYFRAMES) {
+            if (entry.size != sizeof(header) + header.frameCount * sizeof(AnimationKey)) return false;
+            AnimationKey keys[32];
+            uint32_t lastKeyMs = 0;
+            int bytesRead;
+            while ((bytesRead = file.read(keys, sizeof(keys))) > 0) {
+                crc = updateChecksum(crc, (const uint8_t*)keys, bytesRead);
+                for (int i = 0; i < bytesRead / (int)sizeof(AnimationKey); i++) {
+                    if (keys[i].timeMs > lastKeyMs) lastKeyMs = keys[i].timeMs;
+                }
+            }
+            entry.durationMs = lastKeyMs;
+            return true;
+        }
+        return false;
+    }
+
+    // Validate a text animation: every line must be index/head/right/left,
+    // each field a number with an optional sign and fractional part as the
+    // AnimationCompiler reads it (strtod), blanks around it are ignored.
+    // Text files without any frame line (logs) are not animations at all
+    bool analyzeText(File& file, Entry& entry, uint32_t& crc) {
+        enum FieldState : uint8_t { FIELD_START, FIELD_SIGN, FIELD_INTEGER, FIELD_FRACTION, FIELD_END };
+        uint8_t chunk[512];
+        uint8_t slashes = 0;
+        FieldState state = FIELD_START;
+        bool fieldHasDigits = false;
+        bool lineHasData = false;
+        bool lineValid = true;
+        bool valid = true;
+        int bytesRead;
+        while ((bytesRead = file.read(chunk, sizeof(chunk))) > 0) {
+            crc = updateChecksum(crc, chunk, bytesRead);
+            for (int i = 0; i < bytesRead; i++) {
+                char c = chunk[i];
+                if (c == '\n') {
+                    if (lineHasData) {
+                        if (lineValid && slashes == 3 && fieldHasDigits) entry.frameCount++;
+                        else valid = false;
+                    }
+                    slashes = 0;
+                    state = FIELD_START;
+                    fieldHasDigits = false;
+                    lineHasData = false;
+                    lineValid = true;
+                    continue;
+                }
+                if (c == ' ' || c == '\t' || c == '\r') {
+                    if (state == FIELD_SIGN) lineValid = false;
+                    else if (state != FIELD_START) state = FIELD_END;
+                    continue;
+                }
+                lineHasData = true;
+                if (c == '/') {
+                    if (!fieldHasDigits) lineValid = false;
+                    slashes++;
+                    state = FIELD_START;
+                    fieldHasDigits = false;
+                } else if (c >= '0' && c <= '9') {
+                    if (state == FIELD_END) lineValid = false;
+                    else if (state != FIELD_FRACTION) state = FIELD_INTEGER;
+                    fieldHasDigits = true;
+                } else if ((c == '-' || c == '+') && state == FIELD_START) {
+                    state = FIELD_SIGN;
+                } else if (c == '.' && state != FIELD_FRACTION && state != FIELD_END) {
+                    state = FIELD_FRACTION;
+                } else {
+                    lineValid = false;
+                }
+            }
+        }
+        // Last line without a newline
+        if (lineHasData) {
+            if (lineValid && slashes == 3 && fieldHasDigits) entry.frameCount++;
+            else valid = false;
+        }
+        entry.dataOffset = 0;
+        entry.durationMs = (uint64_t)entry.frameCount * 1000 / ANIMATION_DEFAULT_FRAME_RATE;
+        return valid && entry.frameCount > 0;
+    }
+
+    // Read a new or changed file and add or refresh its entry
+    void indexFile(const char* path, uint32_t size) {
+        int16_t index = findIndex(path);
+        if (index != EMPTY_SLOT && entries[index].size == size) {
+            seen[index] = true;
+            return;
+        }
+        if (index == EMPTY_SLOT) {
+            if (entryCount >= ANIMATION_INDEX_ENTRIES) {
+                complete = false;
+                return;
+            }
+            index = entryCount++;
+        }
+
+        Entry& entry = entries[index];
+        memset(&entry, 0, sizeof(entry));
+        strlcpy(entry.path, path, sizeof(entry.path));
+        entry.pathHash = animationPathHash(entry.path);
+        entry.size = size;
+        seen[index] = true;
+        changed = true;
+        rebuildSlots();
+
+        File file = SD.open(path, FILE_READ);
+        if (!file) return;
+        uint32_t crc = 0;
+        const char* extension = strrchr(path, '.');
+        bool binary = extension && strcasecmp(extension, ".pba") == 0;
+        entry.valid = binary ? analyzeBinary(file, entry, crc) : analyzeText(file, entry, crc);
+        // Dense frames are validated from the header alone, the rest only feeds the checksum
+        uint8_t chunk[512];
+        int bytesRead;
+        while ((bytesRead = file.read(chunk, sizeof(chunk))) > 0) {
+            crc = updateChecksum(crc, chunk, bytesRead);
+        }
+        entry.checksum = crc;
+        file.close();
+
+        if (!entry.valid && (binary || entry.frameCount > 0)) {
+            DEBUG_PRINT(DEBUG_WARNING, "Malformed animation: %s", path);
+        }
+    }
+
+    // Walk a directory and index every animation file below it
+    // path holds the directory path and is extended in place for children
+    void scanDirectory(File& dir, char* path, size_t pathLength, uint8_t depth) {
+        File child;
+        while ((child = dir.openNextFile())) {
+            const char* name = child.name();
+            size_t nameLength = strlen(name);
+            if (name[0] == '.') {
+                child.close();
+                continue;
+            }
+            // A skipped child may hold animations, lookups missing the index then go to the card
+            if (pathLength + nameLength + 2 > ANIMATION_CACHE_PATH_LENGTH) {
+                complete = false;
+                child.close();
+                continue;
+            }
+            memcpy(path + pathLength, name, nameLength + 1);
+
+            if (child.isDirectory()) {
+                if (depth < ANIMATION_INDEX_DEPTH) {
+                    path[pathLength + nameLength] = '/';
+                    path[pathLength + nameLength + 1] = '\0';
+                    scanDirectory(child, path, pathLength + nameLength + 1, depth + 1);
+                } else {
+                    complete = false;
+                }
+            } else if (isAnimationFile(name) && !isDataFile(path)) {
+                uint32_t size = child.size();
+                child.close();
+                indexFile(path, size);
+                path[pathLength] = '\0';
+                continue;
+            }
+            child.close();
+            path[pathLength] = '\0';
+        }
+    }
+
+    // Remove entries of files no longer on the card
+    void dropMissing() {
+        uint16_t kept = 0;
+        for (uint16_t i = 0; i < entryCount; i++) {
+            if (!seen[i]) {
+                changed = true;
+                continue;
+            }
+            if (kept != i) entries[kept] = entries[i];
+            kept++;
+        }
+        entryCount = kept;
+        rebuildSlots();
+    }
+
+public:
+    AnimationIndex()
+        : entryCount(0)
+        , ready(false)
+        , complete(false)
+        , changed(false) {
+        for (uint16_t i = 0; i < SLOT_COUNT; i++) slots[i] = EMPTY_SLOT;
+    }
+
+    // Build the index from the index file and a walk of the card
+    // Called once at boot after the SD card is initialized
+    void build() {
+        uint32_t start = millis();
+        loadFile();
+        memset(seen, 0, sizeof(seen));
+        complete = true;
+        changed = false;
+
+        File root = SD.open("/");
+        if (!root) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to open SD root for animation index");
+            return;
+        }
+        char path[ANIMATION_CACHE_PATH_LENGTH] = "";
+        scanDirectory(root, path, 0, 0);
+        root.close();
+
+        dropMissing();
+        if (changed) saveFile();
+        ready = true;
+
+        if (!complete) {
+            DEBUG_PRINT(DEBUG_WARNING, "Animation index incomplete, some files were skipped");
+        }
+        DEBUG_PRINT(DEBUG_INFO, "Animation index: %u files%s in %lums",
+                    entryCount, changed ? " (updated)" : "", (unsigned long)(millis() - start));
+    }
+
+    // Look up an animation by path, nullptr if not on the card
+    const Entry* find(const char* path) const {
+        int16_t index = findIndex(normalizePath(path));
+        return index == EMPTY_SLOT ? nullptr : &entries[index];
+    }
+
+    // Check if a path can be played
+    // Unknown paths are only rejected when the index covers the whole card
+    bool isPlayable(const char* path) const {
+        if (isDataFile(path)) return false;
+        if (!ready) return true;
+        const Entry* entry = find(path);
+        if (!entry) return !complete;
+        return entry->valid;
+    }
+
+    // Send every playable animation and its duration to Playdate
+    // Format: "msg n/path/durationMs" per animation, then "msg n/" to end the list
+    void sendList() const {
+        char message[ANIMATION_CACHE_PATH_LENGTH + 24];
+        for (uint16_t i = 0; i < entryCount; i++) {
+            if (!entries[i].valid) continue;
+            snprintf(message, sizeof(message), "msg n/%s/%lu",
+                     entries[i].path, (unsigned long)entries[i].durationMs);
+            playdateLink.println(message);
+        }
+        playdateLink.println("msg n/");
+    }
+
+    // Index state getters
+    bool isReady() const { return ready; }
+    uint16_t getCount() const { return entryCount; }
+};
+
+#endif // ANIMATION_INDEX_H
@@ -0,0 +1,488 @@
+// AnimationLayer.h
+#ifndef ANIMATION_LAYER_H
+#define ANIMATION_LAYER_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "AnimationFormat.h"
+#include "AnimationStream.h"
+#include "AnimationCache.h"
+#include "AnimationTrack.h"
+
+// Playback of one animation file, as one layer of the animation mix
+// Decodes the file into one keyframe track per channel (head, right wheel,
+// left wheel) and evaluates them against its own clock. A layer has no
+// hardware access: AnimationManager blends the values of its layers and
+// drives the servo and wheel targets.
+// Wheel values are encoder positions relative to the layer start, offset by
+// an origin so a layer can start or loop from wherever the wheels are.
+// Three file formats are accepted, detected from the first bytes of the file:
+// - Text (.txt): one line per frame, index/head_position/right_wheel/left_wheel
+// - Binary frames (.pba v1): precompiled dense frames, see AnimationFormat.h
+// - Binary keyframes (.pba v2): sparse time-stamped keys with easing
+// Dense frames become one linear key per channel and frame.
+class AnimationLayer {
+private:
+    static const uint8_t MAX_LINE_LENGTH = 64; // Max animation line length
+
+    // Static buffer for string operations
+    char lineBuf[MAX_LINE_LENGTH]; // Current line buffer
+
+    // File state
+    AnimationStream stream;        // Read-ahead stream of the animation file
+    AnimationCache& cache;         // RAM cache of preloaded animations
+    const AnimationCache::Entry* cacheEntry; // Cached file being played, if any
+    char path[ANIMATION_CACHE_PATH_LENGTH]; // Path of the animation, kept to loop
+    bool active;                  // Layer is playing
+    bool looping;                 // Restart at the end instead of finishing
+
+    // Decoded frame state
+    AnimationHeader header;       // Header of binary animation (text uses defaults)
+    bool isBinary;                // True when playing a .pba file
+    uint32_t recordsRead;         // Frames or keys decoded from current binary file
+    AnimationFrame frame;         // Most recently decoded dense frame values
+
+    // Key of one channel waiting to be pushed to its track
+    struct ChannelKey {
+        uint8_t channel;          // Channel index
+        TrackKey key;             // Key data
+    };
+
+    // Keys produced by the last decoded dense frame
+    // Up to two per channel: a hold key and the frame key
+    static const uint8_t KEY_QUEUE_SIZE = 2 * ANIMATION_CHANNEL_COUNT;
+    ChannelKey keyQueue[KEY_QUEUE_SIZE];
+    uint8_t keyQueueCount;        // Keys in the queue
+    uint8_t keyQueuePos;          // Next key to hand out
+    uint32_t denseFrameIndex;     // Index of the next dense frame
+    int32_t lastDenseFrame[ANIMATION_CHANNEL_COUNT]; // Frame of last key per channel
+    int16_t lastDenseValue[ANIMATION_CHANNEL_COUNT]; // Value of last key per channel
+
+    // Keyframe playback, anchored to the layer start (or last loop restart)
+    AnimationTrack tracks[ANIMATION_CHANNEL_COUNT]; // Head, right wheel, left wheel
+    ChannelKey pendingKey;        // Next key from the file
+    bool hasPendingKey;           // False once the file is exhausted
+    uint32_t startMicros;         // Timestamp of the current pass
+    uint8_t frameRate;            // Dense frame rate (fps)
+    uint32_t lastKeyMicros;       // Latest key time seen
+    uint32_t streamDueMicros;     // Due time of the last key pushed
+    uint32_t endHoldMicros;       // Time the last key is held before finishing
+
+    // Evaluated outputs
+    float values[ANIMATION_CHANNEL_COUNT]; // Latest channel values, origin included
+    float origin[ANIMATION_CHANNEL_COUNT]; // Offset added to wheel channels
+
+    // Key timing statistics of current or last animation
+    struct KeyTimingStats {
+        uint32_t keys;            // Keys applied
+        uint32_t dropped;         // Keys skipped over to catch up with the clock
+        uint32_t maxLateMicros;   // Worst delay between key due time and use
+        uint64_t totalLateMicros; // Sum of delays, for the average
+    } timing;
+
+    // Fast number parsing without String conversion
+    // Leading blanks, a sign and a fractional part are accepted, the value is
+    // rounded half away from zero like the AnimationCompiler (lround)
+    inline int32_t parseIntFast(const char* str, size_t len) {
+        int32_t result = 0;
+        bool negative = false;
+        size_t i = 0;
+
+        while (i < len && (str[i] == ' ' || str[i] == '\t')) i++;
+        if (i < len && (str[i] == '-' || str[i] == '+')) {
+            negative = str[i] == '-';
+            i++;
+        }
+
+        for (; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+            result = result * 10 + (str[i] - '0');
+        }
+        // The first decimal decides the rounding
+        if (i + 1 < len && str[i] == '.' && str[i + 1] >= '5' && str[i + 1] <= '9') result++;
+
+        return negative ? -result : result;
+    }
+
+    // Optimized line reading from the read-ahead stream
+    bool readNextLine() {
+        size_t lineLen = 0;
+        char c;
+
+        while (lineLen < MAX_LINE_LENGTH - 1) {
+            if (!stream.readByte(c)) return false;
+            if (c == '\n') {
+                lineBuf[lineLen] = '\0';
+                return true;
+            }
+            if (c != '\r') {
+                lineBuf[lineLen++] = c;
+            }
+        }
+
+        lineBuf[lineLen] = '\0';
+        return true;
+    }
+
+    // Open the animation from the RAM cache, or from SD on a miss
+    bool openSource() {
+        cache.release(cacheEntry);
+        cacheEntry = cache.acquire(path);
+        if (cacheEntry) {
+            stream.openMemory(cache.getData(cacheEntry), cacheEntry->size);
+            return true;
+        }
+        return stream.open(path);
+    }
+
+    // Detect a precompiled binary animation from its header
+    // Text files are left untouched: the header bytes are only peeked
+    void detectFormat() {
+        isBinary = false;
+        recordsRead = 0;
+        header.version = ANIMATION_VERSION_FRAMES;
+        header.frameRate = ANIMATION_DEFAULT_FRAME_RATE;
+        header.channelMask = ANIMATION_CHANNEL_ALL;
+        header.frameCount = 0;
+
+        AnimationHeader candidate;
+        if (stream.peek((uint8_t*)&candidate, sizeof(candidate)) &&
+            memcmp(candidate.magic, ANIMATION_MAGIC, ANIMATION_MAGIC_LENGTH) == 0) {
+            if (candidate.version == ANIMATION_VERSION_FRAMES ||
+                candidate.version == ANIMATION_VERSION_KEYFRAMES) {
+                stream.read((uint8_t*)&header, sizeof(header));
+                isBinary = true;
+                return;
+            }
+            DEBUG_PRINT(DEBUG_WARNING, "Unsupported animation version: %u", candidate.version);
+        }
+    }
+
+    // Read one packed frame from a binary animation
+    // Channels absent from the header mask keep their previous value
+    bool readBinaryFrame() {
+        if (recordsRead >= header.frameCount) return false;
+
+        int16_t frameValues[ANIMATION_CHANNEL_COUNT];
+        if (!stream.read((uint8_t*)frameValues, animationFrameSize(header.channelMask))) return false;
+
+        uint8_t index = 0;
+        if (header.channelMask & ANIMATION_CHANNEL_HEAD) frame.head = frameValues[index++];
+        if (header.channelMask & ANIMATION_CHANNEL_WHEEL_RIGHT) frame.wheelRight = frameValues[index++];
+        if (header.channelMask & ANIMATION_CHANNEL_WHEEL_LEFT) frame.wheelLeft = frameValues[index++];
+        recordsRead++;
+        return true;
+    }
+
+    // Read and decode the next dense frame in either format
+    bool readNextFrame() {
+        if (isBinary) return readBinaryFrame();
+        if (!readNextLine()) return false;
+        parseAnimationLine();
+        return true;
+    }
+
+    // Parse a single animation frame line
+    // Format: index/head_position/right_wheel/left_wheel
+    void parseAnimationLine() {
+        char* ptr = lineBuf;
+        char* nextSlash;
+
+        // Skip frame index
+        nextSlash = strchr(ptr, '/');
+        if (!nextSlash) return;
+        ptr = nextSlash + 1;
+
+        // Parse head servo position (500-2500 µs)
+        nextSlash = strchr(ptr, '/');
+        if (!nextSlash) return;
+        *nextSlash = '\0';
+        int32_t headPos = parseIntFast(ptr, nextSlash - ptr);
+        ptr = nextSlash + 1;
+
+        // Parse right wheel target
+        nextSlash = strchr(ptr, '/');
+        if (!nextSlash) return;
+        int32_t wheelRight = parseIntFast(ptr, nextSlash - ptr);
+        ptr = nextSlash + 1;
+
+        // Parse left wheel target
+        int32_t wheelLeft = parseIntFast(ptr, strlen(ptr));
+
+        frame.head = constrain(headPos, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
+        frame.wheelRight = constrain(wheelRight, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
+        frame.wheelLeft = constrain(wheelLeft, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
+    }
+
+    // Check if the current file stores sparse keys rather than dense frames
+    bool isKeyframeFile() const {
+        return isBinary && header.version == ANIMATION_VERSION_KEYFRAMES;
+    }
+
+    // Start time of a dense frame (µs)
+    uint32_t denseFrameMicros(uint32_t frameIndex) const {
+        return (uint64_t)frameIndex * 1000000 / frameRate;
+    }
+
+    // Queue the key of one channel for a dense frame
+    // A channel that skipped frames (head without servo command) gets a hold
+    // key first, so it stays still until the frame before its next value.
+    void queueDenseKey(uint8_t channel, int16_t value) {
+        int32_t lastFrame = lastDenseFrame[channel];
+        if (lastFrame >= 0 && lastFrame + 1 < (int32_t)denseFrameIndex) {
+            keyQueue[keyQueueCount++] = {channel, {denseFrameMicros(denseFrameIndex - 1),
+                                                   lastDenseValue[channel], ANIMATION_EASE_LINEAR}};
+        }
+        keyQueue[keyQueueCount++] = {channel, {denseFrameMicros(denseFrameIndex),
+                                               value, ANIMATION_EASE_LINEAR}};
+        lastDenseFrame[channel] = denseFrameIndex;
+        lastDenseValue[channel] = value;
+    }
+
+    // Decode dense frames until at least one key is queued
+    bool fillKeyQueue() {
+        keyQueueCount = keyQueuePos = 0;
+        while (keyQueueCount == 0) {
+            if (!readNextFrame()) return false;
+            // Text files carry every channel, binary files only those in the mask
+            uint16_t channels = isBinary ? header.channelMask : ANIMATION_CHANNEL_ALL;
+            if ((channels & ANIMATION_CHANNEL_HEAD) && animationIsValidHead(frame.head)) {
+                queueDenseKey(ANIMATION_TRACK_HEAD, frame.head);
+            }
+            if (channels & ANIMATION_CHANNEL_WHEEL_RIGHT) queueDenseKey(ANIMATION_TRACK_WHEEL_RIGHT, frame.wheelRight);
+            if (channels & ANIMATION_CHANNEL_WHEEL_LEFT) queueDenseKey(ANIMATION_TRACK_WHEEL_LEFT, frame.wheelLeft);
+            denseFrameIndex++;
+        }
+        return true;
+    }
+
+    // Read one key record from a keyframe file
+    bool readKeyRecord(ChannelKey& out) {
+        AnimationKey record;
+        while (recordsRead < header.frameCount) {
+            if (!stream.read((uint8_t*)&record, sizeof(record))) return false;
+            recordsRead++;
+            if (record.channel >= ANIMATION_CHANNEL_COUNT) continue;
+            out.channel = record.channel;
+            out.key = {record.timeMs * 1000, record.value, record.easing};
+            return true;
+        }
+        return false;
+    }
+
+    // Produce the next key in stream order, from either layout
+    bool readNextKey(ChannelKey& out) {
+        if (!stream.isOpen()) return false;
+        if (isKeyframeFile()) {
+            if (!readKeyRecord(out)) return false;
+        } else {
+            if (keyQueuePos >= keyQueueCount && !fillKeyQueue()) return false;
+            out = keyQueue[keyQueuePos++];
+        }
+        if (out.key.timeMicros > lastKeyMicros) lastKeyMicros = out.key.timeMicros;
+        return true;
+    }
+
+    // Push every key whose predecessor on its channel has been reached
+    // A key is due once its predecessor on the channel is reached, and never
+    // before the keys ahead of it in the stream
+    void feedTracks(uint32_t now) {
+        uint8_t pushedChannels = 0;
+        while (hasPendingKey) {
+            AnimationTrack& track = tracks[pendingKey.channel];
+            if (!track.needsKey(now)) break;
+
+            // A second push on a running channel skips over a whole segment
+            uint8_t channelBit = 1 << pendingKey.channel;
+            if ((pushedChannels & channelBit) && track.hasSegment()) timing.dropped++;
+            pushedChannels |= channelBit;
+
+            if (track.getDueMicros() > streamDueMicros) streamDueMicros = track.getDueMicros();
+            recordKeyTiming(now - streamDueMicros);
+            track.push(pendingKey.key);
+            hasPendingKey = readNextKey(pendingKey);
+        }
+    }
+
+    // Record the delay between a key's due time and its use
+    void recordKeyTiming(uint32_t lateMicros) {
+        timing.keys++;
+        timing.totalLateMicros += lateMicros;
+        if (lateMicros > timing.maxLateMicros) timing.maxLateMicros = lateMicros;
+    }
+
+    // Evaluate tracks into channel values
+    // Channels without keys yet keep their previous value
+    void evaluateTracks(uint32_t now) {
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            if (tracks[channel].isActive()) {
+                values[channel] = origin[channel] + tracks[channel].evaluate(now);
+            }
+        }
+    }
+
+    // Clear decoding and track state so the file plays from its first key
+    void resetDecoder() {
+        frame.head = 0;
+        frame.wheelRight = 0;
+        frame.wheelLeft = 0;
+        keyQueueCount = keyQueuePos = 0;
+        denseFrameIndex = 0;
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            tracks[channel].reset();
+            lastDenseFrame[channel] = -1;
+        }
+        hasPendingKey = false;
+        lastKeyMicros = 0;
+        streamDueMicros = 0;
+    }
+
+    // Decode the header and first key of a freshly opened file
+    bool beginPass() {
+        resetDecoder();
+        detectFormat();
+        frameRate = header.frameRate > 0 ? header.frameRate : ANIMATION_DEFAULT_FRAME_RATE;
+        // Dense animations hold their last frame for one frame period
+        endHoldMicros = isKeyframeFile() ? 0 : denseFrameMicros(1);
+        hasPendingKey = readNextKey(pendingKey);
+        return hasPendingKey;
+    }
+
+    // Restart a looping layer at the end of a pass
+    // Wheel origins move to the end position so the loop carries on from
+    // where the wheels are instead of driving back to the loop start.
+    bool rewind(uint32_t now) {
+        uint32_t length = lastKeyMicros + endHoldMicros;
+        evaluateTracks(length);
+        origin[ANIMATION_TRACK_WHEEL_RIGHT] = values[ANIMATION_TRACK_WHEEL_RIGHT];
+        origin[ANIMATION_TRACK_WHEEL_LEFT] = values[ANIMATION_TRACK_WHEEL_LEFT];
+
+        // Zero-length loops would spin forever on their first key
+        if (length == 0 || !openSource() || !beginPass()) return false;
+        startMicros += length;
+        feedTracks(now - length);
+        return true;
+    }
+
+public:
+    AnimationLayer(AnimationCache& animationCache)
+        : cache(animationCache)
+        , cacheEntry(nullptr)
+        , active(false)
+        , looping(false)
+        , isBinary(false)
+        , recordsRead(0)
+        , startMicros(0)
+        , frameRate(ANIMATION_DEFAULT_FRAME_RATE)
+        , endHoldMicros(0)
+        , timing{0, 0, 0, 0} {
+        path[0] = '\0';
+        resetDecoder();
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            values[channel] = origin[channel] = 0;
+        }
+    }
+
+    // Start playing a file from the RAM cache or SD card
+    // wheelOrigin gives the wheel positions the animation is relative to
+    // Returns false if the file cannot be opened or holds no key
+    bool start(const char* animationPath, bool loop, float wheelOriginRight, float wheelOriginLeft) {
+        stop();
+
+        strlcpy(path, animationPath, sizeof(path));
+        if (!openSource()) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to open animation");
+            return false;
+        }
+        DEBUG_PRINT(DEBUG_INFO, "%s - Hits: %lu, Misses: %lu, Evictions: %lu",
+                    cacheEntry ? "Animation cache hit" : "Animation cache miss",
+                    (unsigned long)cache.getHits(), (unsigned long)cache.getMisses(),
+                    (unsigned long)cache.getEvictions());
+
+        // Keys at time 0 are applied immediately, the clock starts now
+        if (!beginPass()) {
+            DEBUG_PRINT(DEBUG_WARNING, "Empty animation");
+            stop();
+            return false;
+        }
+        looping = loop;
+        active = true;
+        origin[ANIMATION_TRACK_HEAD] = 0;
+        origin[ANIMATION_TRACK_WHEEL_RIGHT] = wheelOriginRight;
+        origin[ANIMATION_TRACK_WHEEL_LEFT] = wheelOriginLeft;
+        timing = {0, 0, 0, 0};
+        startMicros = micros();
+        feedTracks(0);
+        evaluateTracks(0);
+        return true;
+    }
+
+    // Stop playback and release the file
+    void stop() {
+        if (active) {
+            DEBUG_PRINT(DEBUG_INFO, "Animation read stats - Max refill: %luus, Stalls: %lu, Dropped keys: %lu",
+                        (unsigned long)stream.getMaxRefillMicros(), (unsigned long)stream.getStallCount(),
+                        (unsigned long)timing.dropped);
+        }
+        stream.close();
+        cache.release(cacheEntry);
+        cacheEntry = nullptr;
+        active = false;
+        resetDecoder();
+    }
+
+    // Advance playback to the given time (micros() timestamp)
+    // Keys are due at their time from the layer start, independent of loop timing
+    // Returns false once a one-shot layer has played to its end
+    bool update(uint32_t nowMicros) {
+        if (!active) return false;
+
+        uint32_t now = nowMicros - startMicros;
+        feedTracks(now);
+
+        if (!hasPendingKey && now >= lastKeyMicros + endHoldMicros) {
+            if (!looping || !rewind(now)) {
+                // Finish on the final key values
+                evaluateTracks(lastKeyMicros + endHoldMicros);
+                stop();
+                return false;
+            }
+            now = nowMicros - startMicros;
+        }
+
+        evaluateTracks(now);
+        return true;
+    }
+
+    // Read ahead of playback - called in main loop after time-critical work
+    // Returns true if an SD read was made
+    bool prefetch() {
+        return active && stream.prefetch();
+    }
+
+    // Layer state getters
+    bool isActive() const { return active; }
+    bool isLooping() const { return looping; }
+    bool drivesChannel(uint8_t channel) const { return active && tracks[channel].isActive(); }
+    float getValue(uint8_t channel) const { return values[channel]; }
+
+    // Shift a wheel channel so its current value lands on a new position
+    void rebaseChannel(uint8_t channel, float position) {
+        if (channel == ANIMATION_TRACK_HEAD) return;
+        origin[channel] += position - values[channel];
+        values[channel] = position;
+    }
+
+    // Key timing statistics of current or last animation
+    uint32_t getKeyCount() const { return timing.keys; }
+    uint32_t getDroppedKeys() const { return timing.dropped; }
+    uint32_t getMaxLateMicros() const { return timing.maxLateMicros; }
+    uint32_t getAverageLateMicros() const {
+        return timing.keys > 0 ? timing.totalLateMicros / timing.keys : 0;
+    }
+
+    // Read-ahead statistics of current or last animation
+    uint32_t getMaxRefillMicros() const { return stream.getMaxRefillMicros(); }
+    uint32_t getReadStallCount() const { return stream.getStallCount(); }
+};
+
+#endif // ANIMATION_LAYER_H
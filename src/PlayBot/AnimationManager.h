@@ -4,212 +4,409 @@
 
 #include "Config.h"
 #include "Debug.h"
+#include "AnimationFormat.h"
+#include "AnimationCache.h"
+#include "AnimationLayer.h"
+#include "StreamLayer.h"
+#include "StorageManager.h"
 #include <SD.h>
 
 // Manages robot animations loaded from SD card
 // Animations are triggered by Playdate messages:
-// - "a/filepath" : Start animation from SD file
-// - "x" : Stop current animation
-// Each animation frame contains: index/head_position/right_wheel/left_wheel
+// - "a/filepath" : Play a one-shot animation over the base loop (override)
+// - "o/filepath" : Play a one-shot animation added to the base loop
+// - "l/filepath" : Start a looping base animation, "l/" stops it
+// - "s/fps" : Start playing frames streamed over USB, "s/0" stops
+// - "k/head/right/left;..." : Streamed frames, one per granted credit
+// - "p/path1,path2,..." : Preload animations into the RAM cache
+// - "x" : Stop all animations
+// - "f" : Request key timing statistics of current or last animation
+// - "n" : List the animations on the SD card with their durations
+// Paths are checked against the SD animation index before anything is
+// opened, so missing or malformed files are rejected immediately.
+// Layers are mixed per channel (head, right wheel, left wheel):
+// - Base: a looping animation, typically an idle motion
+// - One-shot: played once over the base, either replacing the channels it
+//   drives (override) or offsetting them (additive)
+// - Stream: frames pushed by the Playdate, overriding both file layers
+// A channel not driven by any layer holds its last value, so a head-only
+// base loop and a wheel-only one-shot play independently.
+// Starting or stopping a layer while another plays crossfades from the
+// current pose instead of restarting: the servo stays attached and the
+// encoders keep counting. Wheel layers start from the current wheel targets.
+// Each layer is decoded by AnimationLayer, see there for file formats.
 class AnimationManager {
+public:
+    // How the one-shot layer combines with the base loop
+    enum BlendMode {
+        BLEND_OVERRIDE,           // One-shot replaces the channels it drives
+        BLEND_ADDITIVE            // One-shot is added to the base (head around center)
+    };
+
 private:
-    // Static buffer sizes for memory efficiency
-    static const size_t BUFFER_SIZE = 512;     // SD card read buffer
-    static const uint8_t MAX_LINE_LENGTH = 64; // Max animation line length
-    
-    // Static buffers for string operations
-    char buffer[BUFFER_SIZE];      // Main file reading buffer
-    char lineBuf[MAX_LINE_LENGTH]; // Current line buffer
-    char wheelRightBuf[8];         // Right wheel command buffer
-    char wheelLeftBuf[8];          // Left wheel command buffer
-    
-    // File and animation state
-    File currentFile;              // Current animation file handle
-    const char* currentAnimation;  // Path to current animation
-    size_t bufferPos;             // Position in read buffer
-    size_t bytesInBuffer;         // Valid bytes in buffer
-    bool isPlaying;               // Animation playback state
-    uint32_t lastFrameTime;       // Last frame timestamp
-    
+    // Layers
+    AnimationCache& cache;         // RAM cache of preloaded animations
+    StorageManager& storage;       // SD card and animation index
+    AnimationLayer baseLayer;      // Looping base animation
+    AnimationLayer oneShotLayer;   // One-shot animation played over the base
+    StreamLayer streamLayer;       // Frames streamed by the Playdate
+    BlendMode blendMode;           // Blend of the one-shot layer
+    AnimationLayer* statsLayer;    // Layer started last, reported by "f"
+    bool isPlaying;               // Hardware is driven by animations
+
+    // Mixed outputs
+    float outputs[ANIMATION_CHANNEL_COUNT];  // Blended channel values
+    float fadeFrom[ANIMATION_CHANNEL_COUNT]; // Pose the crossfade starts from
+    uint32_t fadeStartMicros;     // Crossfade start timestamp
+    bool isFading;                // Crossfade in progress
+    int16_t lastHeadPos;          // Last position written to the servo
+
     // Hardware references
     Servo& headServo;             // Head servo control
     DRV8835MotorShield& motors;   // Motor control
     Encoder& encoderLeft;         // Left wheel encoder
     Encoder& encoderRight;        // Right wheel encoder
 
-    // Fast integer parsing without String conversion
-    inline int32_t parseIntFast(const char* str, size_t len) {
-        int32_t result = 0;
-        bool negative = false;
-        size_t i = 0;
+    // Apply head position if motion is enabled
+    void applyHeadPosition(int16_t headPos) {
+        if (MOTION_ENABLED && animationIsValidHead(headPos) && headPos != lastHeadPos) {
+            headServo.writeMicroseconds(headPos);
+            lastHeadPos = headPos;
+        }
+    }
+
+    // Zero both wheel encoders, flagged through encoderResetCount
+    void resetEncoders() {
+        encoderResetCount = encoderResetCount + 1;
+        encoderLeft.write(0);
+        encoderRight.write(0);
+        encoderResetCount = encoderResetCount + 1;
+    }
+
+    // Take control of the hardware when the first layer starts
+    void beginPlayback() {
+        resetEncoders();
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            outputs[channel] = 0;
+        }
+        lastHeadPos = 0;
+        isFading = false;
 
-        if (str[0] == '-') {
-            negative = true;
-            i++;
+        if (MOTION_ENABLED) {
+            headServo.attach(SERVO_PIN);
         }
+        isPlaying = true;
+    }
 
-        for (; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
-            result = result * 10 + (str[i] - '0');
+    // Release the hardware once no layer plays
+    void endPlayback() {
+        headServo.detach();
+        resetEncoders();
+        motors.setM1Speed(0);
+        motors.setM2Speed(0);
+        isPlaying = false;
+        isFading = false;
+        // Reset wheel commands to 0
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            outputs[channel] = 0;
         }
+        lastHeadPos = 0;
+    }
 
-        return negative ? -result : result;
+    // Blend from the current pose to the layer mix over ANIMATION_CROSSFADE_MS
+    void startCrossfade() {
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            fadeFrom[channel] = outputs[channel];
+        }
+        fadeStartMicros = micros();
+        isFading = ANIMATION_CROSSFADE_MS > 0;
     }
 
-    // Optimized line reading from SD card
-    bool readNextLine() {
-        size_t lineLen = 0;
-        
-        while (lineLen < MAX_LINE_LENGTH - 1) {
-            // Refill buffer if needed
-            if (bufferPos >= bytesInBuffer) {
-                bytesInBuffer = currentFile.read(buffer, BUFFER_SIZE);
-                bufferPos = 0;
-                if (bytesInBuffer == 0) return false;
-            }
-            
-            char c = buffer[bufferPos++];
-            if (c == '\n') {
-                lineBuf[lineLen] = '\0';
-                return true;
+    // Move the file layers' wheels to the current targets
+    // Called when a layer above them ends so they carry on from where it
+    // left the wheels instead of driving back
+    void rebaseWheels() {
+        for (uint8_t channel = ANIMATION_TRACK_WHEEL_RIGHT; channel <= ANIMATION_TRACK_WHEEL_LEFT; channel++) {
+            if (oneShotLayer.drivesChannel(channel) && blendMode == BLEND_OVERRIDE) {
+                oneShotLayer.rebaseChannel(channel, outputs[channel]);
+            } else {
+                float offset = oneShotLayer.drivesChannel(channel) ? oneShotLayer.getValue(channel) : 0;
+                baseLayer.rebaseChannel(channel, outputs[channel] - offset);
             }
-            if (c != '\r') {
-                lineBuf[lineLen++] = c;
+        }
+    }
+
+    // Check a path against the animation index before starting a layer
+    bool isPlayable(const char* animationPath) const {
+        if (storage.isAnimationPlayable(animationPath)) return true;
+        DEBUG_PRINT(DEBUG_WARNING, "%s animation: %s",
+                    storage.findAnimation(animationPath) ? "Malformed" : "Unknown", animationPath);
+        return false;
+    }
+
+    // Check if any layer still plays
+    bool hasActiveLayer() const {
+        return baseLayer.isActive() || oneShotLayer.isActive() || streamLayer.isActive();
+    }
+
+    // Mix both layers into the channel outputs
+    void mixLayers(uint32_t nowMicros) {
+        float weight = 1.0f;
+        if (isFading) {
+            uint32_t elapsed = nowMicros - fadeStartMicros;
+            if (elapsed >= (uint32_t)ANIMATION_CROSSFADE_MS * 1000) {
+                isFading = false;
+            } else {
+                weight = elapsed / (ANIMATION_CROSSFADE_MS * 1000.0f);
             }
         }
-        
-        lineBuf[lineLen] = '\0';
-        return true;
-    }
-
-    // Parse a single animation frame line
-    // Format: index/head_position/right_wheel/left_wheel
-    void parseAnimationLine() {
-        char* ptr = lineBuf;
-        char* nextSlash;
-        
-        // Skip frame index
-        nextSlash = strchr(ptr, '/');
-        if (!nextSlash) return;
-        ptr = nextSlash + 1;
-        
-        // Parse head servo position (500-2500 µs)
-        nextSlash = strchr(ptr, '/');
-        if (!nextSlash) return;
-        *nextSlash = '\0';
-        int headPos = parseIntFast(ptr, nextSlash - ptr);
-        ptr = nextSlash + 1;
-        
-        // Parse right wheel speed
-        nextSlash = strchr(ptr, '/');
-        if (!nextSlash) return;
-        size_t len = nextSlash - ptr;
-        if (len < sizeof(wheelRightBuf)) {
-            memcpy(wheelRightBuf, ptr, len);
-            wheelRightBuf[len] = '\0';
-        }
-        ptr = nextSlash + 1;
-        
-        // Parse left wheel speed
-        len = strlen(ptr);
-        if (len < sizeof(wheelLeftBuf)) {
-            memcpy(wheelLeftBuf, ptr, len + 1);
-        }
-        
-        // Apply head position if motion is enabled
-        if (MOTION_ENABLED && headPos >= 500 && headPos <= 2500) {
-            headServo.writeMicroseconds(headPos);
+
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            // Undriven channels hold their last value
+            float value = isFading ? fadeFrom[channel] : outputs[channel];
+            if (baseLayer.drivesChannel(channel)) value = baseLayer.getValue(channel);
+
+            if (oneShotLayer.drivesChannel(channel)) {
+                float oneShot = oneShotLayer.getValue(channel);
+                if (blendMode == BLEND_OVERRIDE) {
+                    value = oneShot;
+                } else if (channel == ANIMATION_TRACK_HEAD) {
+                    if (animationIsValidHead(value)) value += oneShot - ANIMATION_HEAD_CENTER;
+                } else {
+                    value += oneShot;
+                }
+            }
+            if (streamLayer.drivesChannel(channel)) value = streamLayer.getValue(channel);
+
+            // A head that never had a position jumps straight to the mix
+            bool fadeChannel = isFading && (channel != ANIMATION_TRACK_HEAD ||
+                                            animationIsValidHead(fadeFrom[channel]));
+            if (fadeChannel) value = fadeFrom[channel] + (value - fadeFrom[channel]) * weight;
+            outputs[channel] = value;
         }
     }
 
+    // Mix layers and drive the head, wheels are read by the motor controller
+    void applyOutputs(uint32_t nowMicros) {
+        mixLayers(nowMicros);
+        applyHeadPosition((int16_t)lroundf(outputs[ANIMATION_TRACK_HEAD]));
+    }
+
 public:
     // Initialize manager with required hardware references
-    AnimationManager(Servo& servo, DRV8835MotorShield& motorController, 
-                    Encoder& encLeft, Encoder& encRight)
-        : headServo(servo)
+    AnimationManager(Servo& servo, DRV8835MotorShield& motorController,
+                    Encoder& encLeft, Encoder& encRight, AnimationCache& animationCache,
+                    StorageManager& storageManager)
+        : cache(animationCache)
+        , storage(storageManager)
+        , baseLayer(animationCache)
+        , oneShotLayer(animationCache)
+        , blendMode(BLEND_OVERRIDE)
+        , statsLayer(&oneShotLayer)
+        , isPlaying(false)
+        , fadeStartMicros(0)
+        , isFading(false)
+        , lastHeadPos(0)
+        , headServo(servo)
         , motors(motorController)
         , encoderLeft(encLeft)
-        , encoderRight(encRight)
-        , isPlaying(false)
-        , lastFrameTime(0)
-        , currentAnimation(nullptr)
-        , bufferPos(0)
-        , bytesInBuffer(0) {
-        // Initialize wheel command buffers to "0"
-        wheelRightBuf[0] = '0';
-        wheelRightBuf[1] = '\0';
-        wheelLeftBuf[0] = '0';
-        wheelLeftBuf[1] = '\0';
+        , encoderRight(encRight) {
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            outputs[channel] = fadeFrom[channel] = 0;
+        }
     }
 
     // Check if animation is currently playing
-    bool isAnimationPlaying() const { 
-        return isPlaying; 
-    }
-
-    // Start new animation from SD card
-    // Called when Playdate sends "a/filepath" message
-    void startAnimation(const char* animationPath) {
-        if (isPlaying) stopAnimation();
-        
-        currentAnimation = animationPath;
-        currentFile = SD.open(animationPath);
-        
-        if (!currentFile) {
-            DEBUG_PRINT(DEBUG_WARNING, "Failed to open animation");
+    bool isAnimationPlaying() const {
+        return isPlaying;
+    }
+
+    // Start a one-shot animation from RAM cache or SD card
+    // Called when Playdate sends "a/filepath" (override) or "o/filepath" (additive)
+    // A one-shot already playing is replaced, crossfading from the current pose
+    void startAnimation(const char* animationPath, BlendMode mode = BLEND_OVERRIDE) {
+        if (!isPlayable(animationPath)) return;
+
+        bool wasPlaying = isPlaying;
+        if (!wasPlaying) beginPlayback();
+        if (oneShotLayer.isActive()) {
+            oneShotLayer.stop();
+            rebaseWheels();
+        }
+
+        // Override wheels continue from the current targets, additive wheels are offsets
+        float originRight = mode == BLEND_ADDITIVE ? 0 : outputs[ANIMATION_TRACK_WHEEL_RIGHT];
+        float originLeft = mode == BLEND_ADDITIVE ? 0 : outputs[ANIMATION_TRACK_WHEEL_LEFT];
+
+        blendMode = mode;
+        statsLayer = &oneShotLayer;
+        if (!oneShotLayer.start(animationPath, false, originRight, originLeft)) {
+            if (!hasActiveLayer()) endPlayback();
             return;
         }
-        
-        isPlaying = true;
-        bufferPos = bytesInBuffer = 0;
-        encoderLeft.write(0);
-        encoderRight.write(0);
-        
-        if (MOTION_ENABLED) {
-            headServo.attach(SERVO_PIN);
+        if (wasPlaying) startCrossfade();
+        applyOutputs(micros());
+    }
+
+    // Start a looping base animation, replacing the current one
+    // Called when Playdate sends "l/filepath"
+    void startBaseLoop(const char* animationPath) {
+        if (!isPlayable(animationPath)) return;
+
+        bool wasPlaying = isPlaying;
+        if (!wasPlaying) beginPlayback();
+
+        statsLayer = &baseLayer;
+        if (!baseLayer.start(animationPath, true, outputs[ANIMATION_TRACK_WHEEL_RIGHT],
+                             outputs[ANIMATION_TRACK_WHEEL_LEFT])) {
+            if (!hasActiveLayer()) endPlayback();
+            return;
+        }
+        if (wasPlaying) startCrossfade();
+        applyOutputs(micros());
+    }
+
+    // Stop the base loop, other layers carry on alone
+    // Called when Playdate sends "l/" with no path
+    void stopBaseLoop() {
+        if (!baseLayer.isActive()) return;
+
+        baseLayer.stop();
+        if (hasActiveLayer()) {
+            startCrossfade();
+        } else {
+            endPlayback();
+        }
+    }
+
+    // Start playing frames streamed by the Playdate
+    // Called when Playdate sends "s/fps", grants the first credits
+    void startStream(uint8_t frameRate) {
+        bool wasPlaying = isPlaying;
+        if (!wasPlaying) beginPlayback();
+
+        streamLayer.start(frameRate, outputs[ANIMATION_TRACK_WHEEL_RIGHT],
+                          outputs[ANIMATION_TRACK_WHEEL_LEFT]);
+        if (wasPlaying) startCrossfade();
+        DEBUG_PRINT(DEBUG_INFO, "Stream started at %u fps", frameRate);
+    }
+
+    // Stop the stream, file layers carry on from the current pose
+    // Called when Playdate sends "s/0"
+    void stopStream() {
+        if (!streamLayer.isActive()) return;
+
+        streamLayer.stop();
+        if (hasActiveLayer()) {
+            rebaseWheels();
+            startCrossfade();
+        } else {
+            endPlayback();
         }
     }
 
-    // Stop current animation playback
+    // Queue a frame received from the Playdate
+    // Called for each frame of a "k/head/right/left;..." message
+    void pushStreamFrame(const AnimationFrame& frame) {
+        streamLayer.pushFrame(frame);
+    }
+
+    // Drop a streamed frame that could not be parsed, its credit is granted again
+    void dropStreamFrame() {
+        streamLayer.dropFrame();
+    }
+
+    // Frames streamed by the Playdate are being played
+    bool isStreaming() const { return streamLayer.isActive(); }
+
+    // Stop every layer and release the hardware
     // Called when Playdate sends "x" message
     void stopAnimation() {
         if (!isPlaying) return;
-        
-        headServo.detach();
-        currentFile.close();
-        encoderLeft.write(0);
-        encoderRight.write(0);
-        motors.setM1Speed(0);
-        motors.setM2Speed(0);
-        isPlaying = false;
-        // Reset wheel commands to "0"
-        wheelRightBuf[0] = '0';
-        wheelRightBuf[1] = '\0';
-        wheelLeftBuf[0] = '0';
-        wheelLeftBuf[1] = '\0';
-        bufferPos = bytesInBuffer = 0;
+
+        baseLayer.stop();
+        oneShotLayer.stop();
+        streamLayer.stop();
+        endPlayback();
     }
 
-    // Process animation frame - called in main loop
-    // Maintains ~30fps timing (33ms per frame)
+    // Move the head outside animations, e.g. for a queued head primitive
+    // Ignored while an animation drives the head; the servo stays attached
+    // until the next animation ends
+    void setHeadPosition(int16_t headPos) {
+        if (isPlaying || !MOTION_ENABLED || !animationIsValidHead(headPos)) return;
+        if (!headServo.attached()) {
+            headServo.attach(SERVO_PIN);
+        }
+        headServo.writeMicroseconds(headPos);
+    }
+
+    // Process animation keys - called in main loop
+    // Keys are due at their time from each layer's start, independent of loop timing
     void update() {
         if (!isPlaying) return;
 
-        uint32_t currentTime = millis();
-        if (currentTime - lastFrameTime > 33) {
-            if (currentFile && readNextLine()) {
-                parseAnimationLine();
-                lastFrameTime = currentTime;
-            } else {
-                stopAnimation();
-            }
+        uint32_t now = micros();
+        baseLayer.update(now);
+        bool oneShotEnded = oneShotLayer.isActive() && !oneShotLayer.update(now);
+        bool streamEnded = streamLayer.isActive() && !streamLayer.update(now);
+
+        if (!hasActiveLayer()) {
+            endPlayback();
+            return;
         }
+        if (oneShotEnded || streamEnded) {
+            // Remaining layers take over from the last pose
+            rebaseWheels();
+            startCrossfade();
+        }
+
+        applyOutputs(now);
+    }
+
+    // Send key timing statistics of the layer started last to Playdate
+    // Format: "msg f/keys/dropped/maxLateUs/avgLateUs/maxRefillUs/readStalls"
+    void sendTimingStats() {
+        char message[80];
+        snprintf(message, sizeof(message), "msg f/%lu/%lu/%lu/%lu/%lu/%lu",
+                 (unsigned long)statsLayer->getKeyCount(), (unsigned long)statsLayer->getDroppedKeys(),
+                 (unsigned long)statsLayer->getMaxLateMicros(), (unsigned long)statsLayer->getAverageLateMicros(),
+                 (unsigned long)statsLayer->getMaxRefillMicros(), (unsigned long)statsLayer->getReadStallCount());
+        playdateLink.println(message);
+    }
+
+    // Queue an animation for loading into the RAM cache
+    // Called for each path of a Playdate "p/path1,path2,..." message
+    void preloadAnimation(const char* animationPath) {
+        if (!isPlayable(animationPath)) return;
+        cache.queuePreload(animationPath);
     }
 
-    // Get current wheel commands for motor controller
-    void getWheelCommands(String& right, String& left) {
-        right = wheelRightBuf;
-        left = wheelLeftBuf;
+    // Send the animations on the SD card and their durations to Playdate
+    // Called when Playdate sends "n" message
+    void sendAnimationList() {
+        storage.sendAnimationList();
+    }
+
+    // Read ahead of playback - called in main loop after time-critical work
+    // Pending preloads are loaded on passes where no layer needed the card
+    void prefetch() {
+        bool readCard = baseLayer.prefetch();
+        readCard |= oneShotLayer.prefetch();
+        if (!readCard) {
+            cache.service();
+        }
+    }
+
+    // Read-ahead statistics of the layer started last
+    uint32_t getMaxRefillMicros() const { return statsLayer->getMaxRefillMicros(); }
+    uint32_t getReadStallCount() const { return statsLayer->getReadStallCount(); }
+
+    // Get current blended wheel targets (encoder ticks) for motor controller
+    void getWheelCommands(float& right, float& left) const {
+        right = outputs[ANIMATION_TRACK_WHEEL_RIGHT];
+        left = outputs[ANIMATION_TRACK_WHEEL_LEFT];
     }
 };
 
-#endif // ANIMATION_MANAGER_H
\ No newline at end of file
+#endif // ANIMATION_MANAGER_H
@@ -0,0 +1,186 @@
+// AnimationStream.h
+#ifndef ANIMATION_STREAM_H
+#define ANIMATION_STREAM_H
+
+#include "Config.h"
+#include "Debug.h"
+#include <SD.h>
+
+// Read-ahead byte stream for animation files on the SD card
+// Keeps a ring of buffers filled ahead of playback so frames are decoded
+// from RAM. Refills happen in prefetch(), called from the main loop after
+// the time-critical work, instead of when the playback buffer runs dry.
+// Files already in the animation cache are read straight from memory.
+// Instrumentation:
+// - Worst-case refill time (µs) of a single SD read
+// - Stalls: reads that found no prefetched data and had to wait on the card
+class AnimationStream {
+public:
+    static const size_t BUFFER_SIZE = 512;   // Bytes per SD read
+    static const uint8_t BUFFER_COUNT = 2;   // Buffers kept in the ring
+
+private:
+    char buffers[BUFFER_COUNT][BUFFER_SIZE]; // Read-ahead ring
+    size_t lengths[BUFFER_COUNT];            // Valid bytes per buffer
+    uint8_t readIndex;                       // Buffer being consumed
+    uint8_t filledCount;                     // Buffers holding unread data, current included
+    const char* current;                     // Data being consumed (ring buffer or cached file)
+    size_t currentLength;                    // Valid bytes in current data
+    size_t readPos;                          // Position in current data
+    bool endOfFile;                          // No more data to fetch from the card
+    bool fromMemory;                         // Reading a cached file
+    File file;                               // Animation file handle
+
+    // Read statistics, reset for every opened file
+    uint32_t maxRefillMicros;                // Slowest SD refill
+    uint32_t stallCount;                     // Reads that waited on the card
+
+    // Fill the next free buffer from the SD card
+    // Returns false when the ring is full or the file is exhausted
+    bool fillNext() {
+        if (endOfFile || filledCount >= BUFFER_COUNT) return false;
+
+        uint8_t index = (readIndex + filledCount) % BUFFER_COUNT;
+        uint32_t start = micros();
+        int bytesRead = file.read(buffers[index], BUFFER_SIZE);
+        uint32_t elapsed = micros() - start;
+        if (elapsed > maxRefillMicros) maxRefillMicros = elapsed;
+
+        if (bytesRead <= 0) {
+            endOfFile = true;
+            return false;
+        }
+        // A short read only happens on the last chunk of the file
+        if ((size_t)bytesRead < BUFFER_SIZE) endOfFile = true;
+        lengths[index] = bytesRead;
+        filledCount++;
+        return true;
+    }
+
+    // Point current data at the buffer being consumed
+    void selectCurrent() {
+        current = buffers[readIndex];
+        currentLength = filledCount > 0 ? lengths[readIndex] : 0;
+    }
+
+    // Release the consumed buffer and move to the next one
+    // Falls back to a blocking read when prefetch has not kept up
+    bool advance() {
+        if (fromMemory) return false;
+        if (filledCount > 0) {
+            filledCount--;
+            readIndex = (readIndex + 1) % BUFFER_COUNT;
+        }
+        readPos = 0;
+
+        if (filledCount == 0) {
+            if (!fillNext()) {
+                selectCurrent();
+                return false;
+            }
+            stallCount++;
+            DEBUG_PRINT(DEBUG_VERBOSE, "Animation read stall");
+        }
+        selectCurrent();
+        return true;
+    }
+
+    // Ensure the current data has unread bytes
+    inline bool ensureData() {
+        if (readPos < currentLength) return true;
+        return advance();
+    }
+
+public:
+    AnimationStream()
+        : readIndex(0)
+        , filledCount(0)
+        , current(nullptr)
+        , currentLength(0)
+        , readPos(0)
+        , endOfFile(true)
+        , fromMemory(false)
+        , maxRefillMicros(0)
+        , stallCount(0) {
+    }
+
+    // Open file and prime every buffer
+    // Returns false if the file cannot be opened
+    bool open(const char* path) {
+        close();
+        file = SD.open(path);
+        if (!file) return false;
+
+        endOfFile = false;
+        maxRefillMicros = 0;
+        stallCount = 0;
+        while (fillNext()) {}
+        selectCurrent();
+        return true;
+    }
+
+    // Read a file held in memory, no SD access at all
+    void openMemory(const uint8_t* data, size_t size) {
+        close();
+        fromMemory = true;
+        current = (const char*)data;
+        currentLength = size;
+        maxRefillMicros = 0;
+        stallCount = 0;
+    }
+
+    // Close file and drop buffered data
+    void close() {
+        if (file) file.close();
+        readIndex = filledCount = 0;
+        current = nullptr;
+        currentLength = 0;
+        readPos = 0;
+        endOfFile = true;
+        fromMemory = false;
+    }
+
+    // Check if a file is open
+    bool isOpen() { return fromMemory || file; }
+
+    // Fetch one chunk ahead of playback if a buffer is free
+    // Called from the main loop during slack time
+    // Returns true if the card was read
+    bool prefetch() {
+        return file && fillNext();
+    }
+
+    // Read a single byte, returns false at end of file
+    inline bool readByte(char& c) {
+        if (!ensureData()) return false;
+        c = current[readPos++];
+        return true;
+    }
+
+    // Read count bytes, returns false if the file ends first
+    bool read(uint8_t* dest, size_t count) {
+        while (count > 0) {
+            if (!ensureData()) return false;
+            size_t chunk = min(count, currentLength - readPos);
+            memcpy(dest, current + readPos, chunk);
+            readPos += chunk;
+            dest += chunk;
+            count -= chunk;
+        }
+        return true;
+    }
+
+    // Copy bytes from the current buffer without consuming them
+    // Only used on small headers at the start of a file
+    bool peek(uint8_t* dest, size_t count) {
+        if (!ensureData() || currentLength - readPos < count) return false;
+        memcpy(dest, current + readPos, count);
+        return true;
+    }
+
+    // Statistics getters
+    uint32_t getMaxRefillMicros() const { return maxRefillMicros; }
+    uint32_t getStallCount() const { return stallCount; }
+};
+
+#endif // ANIMATION_STREAM_H
@@ -0,0 +1,83 @@
+// AnimationTrack.h
+#ifndef ANIMATION_TRACK_H
+#define ANIMATION_TRACK_H
+
+#include <Arduino.h>
+#include "AnimationFormat.h"
+
+// Key of a single animation channel, timed from the animation start
+struct TrackKey {
+    uint32_t timeMicros;  // Time from animation start (µs)
+    int16_t value;        // Channel value
+    uint8_t easing;       // ANIMATION_EASE_* towards the next key
+};
+
+// Keyframe track for one animation channel (head servo or one wheel)
+// Holds the segment around the playback position: the key being left and
+// the key being approached. Keys are pushed in time order as playback
+// reaches them, so a track never needs more than two keys in memory.
+// Dense animations push one linear key per frame.
+class AnimationTrack {
+private:
+    TrackKey from;        // Key at or before the playback position
+    TrackKey to;          // Next key
+    uint8_t keyCount;     // Keys received, saturates at 2
+
+    // Map segment progress (0-1) through an easing curve
+    static float ease(uint8_t easing, float t) {
+        switch (easing) {
+            case ANIMATION_EASE_STEP:
+                return 0.0f;
+            case ANIMATION_EASE_CUBIC:
+                return t * t * (3.0f - 2.0f * t);
+            default:
+                return t;
+        }
+    }
+
+public:
+    AnimationTrack() : keyCount(0) {}
+
+    // Drop all keys
+    void reset() { keyCount = 0; }
+
+    // Check if the track has received a key
+    bool isActive() const { return keyCount > 0; }
+
+    // Check if the track has a full segment to interpolate
+    bool hasSegment() const { return keyCount >= 2; }
+
+    // Check if the next key is needed at time now (µs)
+    // True until two keys are loaded, then once the next key is reached
+    bool needsKey(uint32_t now) const {
+        return keyCount < 2 || now >= to.timeMicros;
+    }
+
+    // Time at which the next key becomes needed (µs)
+    uint32_t getDueMicros() const {
+        return keyCount < 2 ? 0 : to.timeMicros;
+    }
+
+    // Append the next key of the channel
+    void push(const TrackKey& key) {
+        if (keyCount == 0) {
+            from = key;
+            keyCount = 1;
+        } else {
+            if (keyCount == 2) from = to;
+            keyCount = 2;
+        }
+        to = key;
+    }
+
+    // Evaluate channel value at time now (µs)
+    float evaluate(uint32_t now) const {
+        if (keyCount < 2 || now >= to.timeMicros) return to.value;
+        if (now <= from.timeMicros) return from.value;
+
+        float t = (float)(now - from.timeMicros) / (float)(to.timeMicros - from.timeMicros);
+        return from.value + (to.value - from.value) * ease(from.easing, t);
+    }
+};
+
+#endif // ANIMATION_TRACK_H
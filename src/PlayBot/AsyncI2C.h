@@ -0,0 +1,238 @@
+// AsyncI2C.h
+#ifndef ASYNC_I2C_H
+#define ASYNC_I2C_H
+
+#include "Config.h"
+#include <Arduino.h>
+
+// One I2C transaction: up to 2 bytes written, then up to 2 bytes read
+// after a repeated START, ended by a STOP
+struct I2CTransaction {
+    uint8_t address;              // 7-bit device address
+    uint8_t txLength;
+    uint8_t tx[2];
+    uint8_t rxLength;
+    uint8_t rx[2];                // Filled once the transaction has completed
+};
+
+// Interrupt-driven I2C transactions on LPI2C1, the port used by Wire
+// Wire.begin() sets up the pins and bus clock. The engine then queues the
+// command words of a transaction in the LPI2C transmit FIFO, topping it up
+// from the port interrupt, and collects the received bytes when the STOP
+// is detected: the main loop never waits on the bus. The completion
+// callback runs in the interrupt and may start the next transaction, so a
+// device read made of several transactions runs without the main loop.
+// Blocking Wire users (the battery gauge) take the bus with I2CBusLock,
+// which waits for the transaction in flight and holds off new ones.
+class AsyncI2C {
+public:
+    enum Result : uint8_t {
+        I2C_OK,
+        I2C_NACK,                 // Address or data not acknowledged
+        I2C_ARBITRATION_LOST,
+        I2C_BUS_ERROR,            // FIFO error, pin low timeout or bytes missing
+        I2C_TIMEOUT               // No STOP within I2C_TRANSACTION_TIMEOUT_US
+    };
+
+    typedef void (*Callback)(Result result, void* context);
+
+    // Transaction counters, latencies in CPU cycles
+    struct Stats {
+        uint32_t transactions;    // Completed successfully
+        uint32_t nacks;
+        uint32_t arbitrationLost;
+        uint32_t busErrors;
+        uint32_t timeouts;
+        uint32_t maxLatency;      // Start to STOP detected
+        uint64_t totalLatency;
+    };
+
+private:
+    static const uint8_t FIFO_DEPTH = 4;
+    static const uint32_t ERROR_FLAGS = LPI2C_MSR_NDF | LPI2C_MSR_ALF | LPI2C_MSR_FEF | LPI2C_MSR_PLTF;
+    static const uint32_t CLEAR_FLAGS = LPI2C_MSR_EPF | LPI2C_MSR_SDF | LPI2C_MSR_DMF | ERROR_FLAGS;
+
+    uint16_t words[6];            // Command words of the current transaction
+    uint8_t wordCount;
+    uint8_t wordIndex;            // Next word to queue
+    uint8_t rxIndex;              // Next byte to receive
+    I2CTransaction* current;
+    Callback callback;
+    void* callbackContext;
+    uint32_t startCycles;
+    volatile bool busy;           // A transaction is in flight
+    volatile bool locked;         // Bus taken by a blocking Wire user
+    Stats stats;                  // Written by the interrupt only
+
+    inline static AsyncI2C* instance = nullptr;
+
+    static void portInterrupt() {
+        instance->service();
+    }
+
+    // Queue command words while the transmit FIFO has room
+    void feed() {
+        while (wordIndex < wordCount && (LPI2C1_MFSR & 0x07) < FIFO_DEPTH) {
+            LPI2C1_MTDR = words[wordIndex++];
+        }
+        if (wordIndex == wordCount) LPI2C1_MIER &= ~LPI2C_MIER_TDIE;
+    }
+
+    // Move received bytes out of the receive FIFO
+    void drain() {
+        while (rxIndex < current->rxLength) {
+            uint32_t data = LPI2C1_MRDR;
+            if (data & LPI2C_MRDR_RXEMPTY) break;
+            current->rx[rxIndex++] = data;
+        }
+    }
+
+    // Flush both FIFOs and release the bus after an error
+    void abort() {
+        LPI2C1_MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF;
+        LPI2C1_MSR = CLEAR_FLAGS;
+        if (LPI2C1_MSR & LPI2C_MSR_MBF) LPI2C1_MTDR = LPI2C_MTDR_CMD_STOP;
+    }
+
+    void finish(Result result) {
+        LPI2C1_MIER = 0;
+        switch (result) {
+            case I2C_OK: {
+                uint32_t latency = ARM_DWT_CYCCNT - startCycles;
+                stats.transactions++;
+                if (latency > stats.maxLatency) stats.maxLatency = latency;
+                stats.totalLatency += latency;
+                break;
+            }
+            case I2C_NACK: stats.nacks++; break;
+            case I2C_ARBITRATION_LOST: stats.arbitrationLost++; break;
+            case I2C_BUS_ERROR: stats.busErrors++; break;
+            case I2C_TIMEOUT: stats.timeouts++; break;
+        }
+        busy = false;
+        if (callback) callback(result, callbackContext);
+    }
+
+    // Port interrupt: errors, FIFO refill and end of transaction
+    void service() {
+        uint32_t status = LPI2C1_MSR;
+        if (!busy) {
+            LPI2C1_MIER = 0;
+            return;
+        }
+        if (status & ERROR_FLAGS) {
+            abort();
+            if (status & LPI2C_MSR_NDF) finish(I2C_NACK);
+            else if (status & LPI2C_MSR_ALF) finish(I2C_ARBITRATION_LOST);
+            else finish(I2C_BUS_ERROR);
+            return;
+        }
+        drain();
+        feed();
+        if (status & LPI2C_MSR_SDF) {
+            LPI2C1_MSR = LPI2C_MSR_SDF;
+            finish(rxIndex == current->rxLength ? I2C_OK : I2C_BUS_ERROR);
+        }
+    }
+
+public:
+    AsyncI2C()
+        : wordCount(0)
+        , wordIndex(0)
+        , rxIndex(0)
+        , current(nullptr)
+        , callback(nullptr)
+        , callbackContext(nullptr)
+        , startCycles(0)
+        , busy(false)
+        , locked(false) {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    // Hook the port interrupt, after Wire.begin()
+    void begin() {
+        instance = this;
+        LPI2C1_MIER = 0;
+        attachInterruptVector(IRQ_LPI2C1, portInterrupt);
+        NVIC_SET_PRIORITY(IRQ_LPI2C1, I2C_IRQ_PRIORITY);
+        NVIC_ENABLE_IRQ(IRQ_LPI2C1);
+    }
+
+    // Start a transaction, callback runs in the interrupt once it has ended
+    // The transaction must stay valid until then
+    // Returns false if the bus is busy or locked
+    bool start(I2CTransaction& transaction, Callback done, void* context) {
+        if (busy || locked || (LPI2C1_MSR & LPI2C_MSR_BBF)) return false;
+
+        wordCount = 0;
+        if (transaction.txLength > 0) {
+            words[wordCount++] = LPI2C_MTDR_CMD_START | (transaction.address << 1);
+            for (uint8_t i = 0; i < transaction.txLength; i++) {
+                words[wordCount++] = LPI2C_MTDR_CMD_TRANSMIT | transaction.tx[i];
+            }
+        }
+        if (transaction.rxLength > 0) {
+            words[wordCount++] = LPI2C_MTDR_CMD_START | (transaction.address << 1) | 1;
+            words[wordCount++] = LPI2C_MTDR_CMD_RECEIVE | (transaction.rxLength - 1);
+        }
+        words[wordCount++] = LPI2C_MTDR_CMD_STOP;
+        wordIndex = 0;
+        rxIndex = 0;
+        current = &transaction;
+        callback = done;
+        callbackContext = context;
+        busy = true;
+
+        LPI2C1_MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF;
+        LPI2C1_MSR = CLEAR_FLAGS;
+        startCycles = ARM_DWT_CYCCNT;
+        feed();
+        LPI2C1_MIER = (wordIndex < wordCount ? LPI2C_MIER_TDIE : 0) | LPI2C_MIER_SDIE |
+                      LPI2C_MIER_NDIE | LPI2C_MIER_ALIE | LPI2C_MIER_FEIE | LPI2C_MIER_PLTIE;
+        return true;
+    }
+
+    // Abort a transaction stuck past I2C_TRANSACTION_TIMEOUT_US - called in main loop
+    void poll() {
+        static const uint32_t timeoutCycles = (uint32_t)((uint64_t)F_CPU_ACTUAL * I2C_TRANSACTION_TIMEOUT_US / 1000000);
+        noInterrupts();
+        if (busy && ARM_DWT_CYCCNT - startCycles > timeoutCycles) {
+            abort();
+            finish(I2C_TIMEOUT);
+        }
+        interrupts();
+    }
+
+    bool isBusy() const { return busy; }
+
+    // Take the bus for blocking Wire calls, waits for the transaction in flight
+    void lock() {
+        locked = true;
+        while (busy) poll();
+    }
+
+    void unlock() {
+        locked = false;
+    }
+
+    // Copy the counters and start a new window
+    Stats takeStats() {
+        noInterrupts();
+        Stats window = stats;
+        memset(&stats, 0, sizeof(stats));
+        interrupts();
+        return window;
+    }
+};
+
+// Holds the I2C bus for blocking Wire calls within a scope
+class I2CBusLock {
+private:
+    AsyncI2C& bus;
+
+public:
+    explicit I2CBusLock(AsyncI2C& i2c) : bus(i2c) { bus.lock(); }
+    ~I2CBusLock() { bus.unlock(); }
+};
+
+#endif // ASYNC_I2C_H
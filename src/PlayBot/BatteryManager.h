@@ -7,6 +7,8 @@
 #include "HardwareConfig.h"
 #include "LEDController.h"
 #include "AnimationManager.h"
+#include "AsyncI2C.h"
+#include "SampleBus.h"
 #include <Smoothed.h>
 
 // Manages battery monitoring and charging state
@@ -19,23 +21,25 @@ private:
     // Hardware state tracking
     bool max1704x_initialized;     // MAX17048 battery gauge initialization status
     bool chargingState;           // Current charging status (true = charging)
-    unsigned long lastBatteryCheckTime; 
+    uint32_t seenUsbSamples;      // USB detection samples already checked
     bool firstReadingTaken;       // Tracks if we have initial reading
     int consecutiveReadings;      // Count of consistent readings
     
     // Hardware references
-    USBSerial_BigBuffer& userial;  // Serial communication for Playdate messages
+    PlaydateLink& link;            // Playdate messages
     LEDController& ledController;   // LED status indicator
     AnimationManager& animationManager; // Used to avoid battery updates during animations
+    AsyncI2C& i2cBus;              // Gauge setup holds the bus shared with the ToF sampler
+    SampleBus& sampleBus;          // USB detection and gauge readings
     
     // Smoothing filters for stable readings
     Smoothed<float> smoothedVoltage;
     Smoothed<float> smoothedChargeRate;
 
     // Logs battery errors to debug system
-    void recordBatteryError(const String& errorMessage) {
-        setupErrors.push_back(errorMessage.c_str());
-        DEBUG_PRINT(DEBUG_WARNING, "Battery Manager Error: " + errorMessage);
+    void recordBatteryError(const char* errorMessage) {
+        setupErrors.push_back(errorMessage);
+        DEBUG_PRINT(DEBUG_WARNING, "Battery Manager Error: %s", errorMessage);
     }
 
     // Sets up data smoothing for voltage readings
@@ -47,15 +51,18 @@ private:
 
 public:
     // Constructor initializes all dependencies
-    BatteryManager(USBSerial_BigBuffer& serial, LEDController& led, AnimationManager& anim) 
+    BatteryManager(PlaydateLink& playdate, LEDController& led, AnimationManager& anim, AsyncI2C& i2c,
+                   SampleBus& bus)
         : max1704x_initialized(false)
         , chargingState(false)
-        , lastBatteryCheckTime(0)
+        , seenUsbSamples(0)
         , firstReadingTaken(false)
         , consecutiveReadings(0)
-        , userial(serial)
+        , link(playdate)
         , ledController(led)
-        , animationManager(anim) {
+        , animationManager(anim)
+        , i2cBus(i2c)
+        , sampleBus(bus) {
     }
 
     // Initialize battery monitoring system
@@ -66,6 +73,7 @@ public:
         
         initializeBatteryDetection();
         
+        I2CBusLock lock(i2cBus);
         if (maxlipo.begin()) {
             DEBUG_PRINT(DEBUG_INFO, "MAX1704X initialized successfully");
             max1704x_initialized = true;
@@ -77,14 +85,13 @@ public:
         }
     }
 
-    // Check for USB power connection changes
+    // Check the latest USB detection sample for power connection changes
     // Sends "msg p/1" or "msg p/0" to Playdate on state change
     void detectBatteryCharging() {
-        unsigned long currentTime = millis();
-        if (currentTime - lastBatteryCheckTime >= BATTERY_CHECK_INTERVAL) {
-            // Read USB detection pin voltage
-            int adcValue = analogRead(USB_DETECT_PIN);
-            float pinVoltage = (adcValue / 1023.0) * 3.3;
+        TimedSample<uint16_t> sample;
+        if (sampleBus.usbDetect().takeLatest(seenUsbSamples, sample)) {
+            // USB detection pin voltage
+            float pinVoltage = (sample.value / 1023.0) * 3.3;
             
             bool newChargingState = (pinVoltage > 1.5); // USB present if > 1.5V
             
@@ -102,14 +109,11 @@ public:
                     ledController.setStatusIdle();
                 }
                 
-                userial.println(chargingState ? "msg p/1" : "msg p/0");
-                DEBUG_PRINT(DEBUG_INFO, "Charging state changed: " + 
-                          String(chargingState ? "Connected" : "Disconnected") +
-                          " Pin Voltage: " + String(pinVoltage) +
-                          "V Motion: " + String(MOTION_ENABLED ? "Enabled" : "Disabled"));
+                link.println(chargingState ? "msg p/1" : "msg p/0");
+                DEBUG_PRINT(DEBUG_INFO, "Charging state changed: %s Pin Voltage: %.2fV Motion: %s",
+                          chargingState ? "Connected" : "Disconnected", pinVoltage,
+                          MOTION_ENABLED ? "Enabled" : "Disabled");
             }
-            
-            lastBatteryCheckTime = currentTime;
         }
     }
 
@@ -121,9 +125,10 @@ public:
         
         // Only send update if no animation is playing
         if (!animationManager.isAnimationPlaying()) {
-            if (max1704x_initialized) {
-                float voltage = maxlipo.cellVoltage();
-                float percent = maxlipo.cellPercent();
+            TimedSample<BatteryReading> reading;
+            if (max1704x_initialized && sampleBus.battery().latest(reading)) {
+                float voltage = reading.value.voltage;
+                float percent = reading.value.percent;
                  int alertLevel = 0;
             if (percent <= BATTERY_CRITICAL_THRESHOLD) {
                 alertLevel = 2;
@@ -141,16 +146,15 @@ public:
 
                  snprintf(message, sizeof(message), "msg b/%s/%s/%d/%d", 
                     percentBuffer, voltageBuffer, chargingState ? 1 : 0, alertLevel);
-            DEBUG_PRINT(DEBUG_INFO, "Battery: " + String(voltage) + "V, " + 
-                       String(percent) + "%, Charging: " + String(chargingState) + 
-                       ", Alert: " + String(alertLevel));
+            DEBUG_PRINT(DEBUG_INFO, "Battery: %.2fV, %.2f%%, Charging: %d, Alert: %d",
+                       voltage, percent, chargingState, alertLevel);
             } else {
                   snprintf(message, sizeof(message), "msg b/NA/NA/NA/0");
             DEBUG_PRINT(DEBUG_WARNING, "Battery monitoring not available");
             message[0] = '\0';  // Empty message if animation playing
             }
 
-            userial.println(message);
+            link.println(message);
         } else {
             message[0] = '\0';  // Empty message if animation playing
         }
@@ -160,7 +164,13 @@ public:
 
     // Getters for battery state
     bool isCharging() const { return chargingState; }
-    float getVoltage() const { return max1704x_initialized ? maxlipo.cellVoltage() : 0.0; }
+    bool isGaugeAvailable() const { return max1704x_initialized; }
+    // Latest gauge voltage, 0 when the gauge is unavailable
+    float getVoltage() const {
+        TimedSample<BatteryReading> reading;
+        if (!max1704x_initialized || !sampleBus.battery().latest(reading)) return 0.0;
+        return reading.value.voltage;
+    }
 };
 
 #endif // BATTERY_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,320 @@
+// BinaryProtocol.h
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary framed protocol between Teensy and Playdate
+// Opt-in replacement of the text lines, negotiated by "v/version": the
+// firmware answers "msg s/v/version" with the version both sides speak, as
+// a text line, and from then on every message in both directions is a
+// frame. "v" (text line or text frame) goes back to the text protocol.
+// This header is shared by the firmware and the host tools, so it must
+// only depend on the C standard headers.
+//
+// Frame on the wire: COBS(type, seq, payload..., crc16) followed by 0x00
+// - type : BINARY_TYPE_*
+// - seq : counts the frames of one direction, a gap means frames were lost
+// - crc16 : CRC-16/CCITT-FALSE of type, seq and payload, little-endian
+// COBS removes every 0x00 from the frame so the delimiter always marks a
+// frame end: a receiver joining mid-stream or hitting a corrupted frame
+// loses at most that frame. Payload integers are little-endian.
+
+// ================= Protocol Identification =================
+#define BINARY_PROTOCOL_VERSION 1           // Highest version spoken by this firmware
+#define BINARY_FRAME_DELIMITER 0x00
+
+// ================= Frame Sizes =================
+#define BINARY_MAX_PAYLOAD 248
+#define BINARY_FRAME_OVERHEAD 4             // type, seq, crc16
+#define BINARY_MAX_DECODED (BINARY_MAX_PAYLOAD + BINARY_FRAME_OVERHEAD)
+// COBS adds one byte per 254 bytes, then the delimiter
+#define BINARY_MAX_ENCODED (BINARY_MAX_DECODED + BINARY_MAX_DECODED / 254 + 1)
+#define BINARY_MAX_FRAME (BINARY_MAX_ENCODED + 1)
+
+// ================= Frame Types =================
+// One message of the text protocol without its line ending, both directions
+// Every command and every message without a binary layout travels this way
+#define BINARY_TYPE_TEXT 0x01
+// Sensor data, binary form of "msg d/..." (36 bytes):
+//   int16 irRight, int16 irLeft, uint16 tofFrontMm, uint16 tofBackMm,
+//   int32 encRight, int32 encLeft, uint16 light, uint16 batteryMv,
+//   uint8 charging, uint32 distanceMm,
+//   uint16 age in ms of ir, tofFront, tofBack, encoders, light, battery
+#define BINARY_TYPE_SENSOR_DATA 0x10
+// Pose, binary form of "msg q/..." (14 bytes):
+//   int32 xMm, int32 yMm, int16 headingMrad, int16 speedMmPerS, int16 turnRateMradPerS
+#define BINARY_TYPE_POSE 0x11
+// Telemetry, binary form of "msg t/...": for each field due, one byte with
+// the field id (BINARY_TELEMETRY_*), bit 7 set when the values are
+// absolute, then each value as a zigzag varint, absolute or the change
+// since the field's previous frame
+#define BINARY_TYPE_TELEMETRY 0x12
+
+#define BINARY_SENSOR_DATA_LENGTH 36
+#define BINARY_POSE_LENGTH 14
+#define BINARY_AGE_NONE 0xFFFF              // Field without a sample yet, longer ages saturate at 0xFFFE
+
+// ================= Telemetry Fields =================
+// Ids in the order of the "e/fields/periodMs" letters e, p, i, f, l, b, d
+#define BINARY_TELEMETRY_ENCODERS 0
+#define BINARY_TELEMETRY_POSE 1
+#define BINARY_TELEMETRY_IR 2
+#define BINARY_TELEMETRY_TOF 3
+#define BINARY_TELEMETRY_LIGHT 4
+#define BINARY_TELEMETRY_BATTERY 5
+#define BINARY_TELEMETRY_DISTANCE 6
+#define BINARY_TELEMETRY_FIELD_COUNT 7
+#define BINARY_TELEMETRY_ABSOLUTE 0x80
+
+// Values carried by each telemetry field
+static const uint8_t binaryTelemetryValueCounts[BINARY_TELEMETRY_FIELD_COUNT] = {2, 5, 2, 2, 1, 3, 1};
+
+// ================= CRC =================
+// CRC-16/CCITT-FALSE (polynomial 0x1021, initial 0xFFFF), one nibble at a time
+inline uint16_t binaryCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+    for (size_t i = 0; i < length; i++) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+// ================= COBS =================
+// Encode length bytes without the delimiter, returns the encoded length
+// out must hold length + length / 254 + 1 bytes
+inline size_t binaryCobsEncode(const uint8_t* in, size_t length, uint8_t* out) {
+    size_t code = 0;               // Position of the current block's code byte
+    size_t written = 1;
+    uint8_t run = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != 0) {
+            out[written++] = in[i];
+            run++;
+        }
+        if (in[i] == 0 || run == 0xFF) {
+            out[code] = run;
+            code = written++;
+            run = 1;
+            // A full block right at the end needs no empty block after it
+            if (in[i] != 0 && i + 1 == length) return written - 1;
+        }
+    }
+    out[code] = run;
+    return written;
+}
+
+// Decode one frame without its delimiter, returns the decoded length,
+// 0 if it is malformed (a 0x00 inside or a block running past the end)
+// out must hold length bytes
+inline size_t binaryCobsDecode(const uint8_t* in, size_t length, uint8_t* out) {
+    size_t read = 0;
+    size_t written = 0;
+    while (read < length) {
+        uint8_t code = in[read++];
+        if (code == 0 || read + code - 1 > length) return 0;
+        for (uint8_t i = 1; i < code; i++) {
+            if (in[read] == 0) return 0;
+            out[written++] = in[read++];
+        }
+        if (code != 0xFF && read < length) out[written++] = 0;
+    }
+    return written;
+}
+
+// ================= Frames =================
+// Build a whole frame with its delimiter, returns its length, 0 if the payload is too long
+// out must hold BINARY_MAX_FRAME bytes
+inline size_t binaryEncodeFrame(uint8_t type, uint8_t seq, const uint8_t* payload, size_t length, uint8_t* out) {
+    if (length > BINARY_MAX_PAYLOAD) return 0;
+    uint8_t decoded[BINARY_MAX_DECODED];
+    decoded[0] = type;
+    decoded[1] = seq;
+    if (length > 0) memcpy(decoded + 2, payload, length);
+    uint16_t crc = binaryCrc16(decoded, length + 2);
+    decoded[length + 2] = (uint8_t)crc;
+    decoded[length + 3] = (uint8_t)(crc >> 8);
+    size_t encoded = binaryCobsEncode(decoded, length + BINARY_FRAME_OVERHEAD, out);
+    out[encoded] = BINARY_FRAME_DELIMITER;
+    return encoded + 1;
+}
+
+// A frame received whole, payload valid until the next byte is pushed
+struct BinaryFrame {
+    uint8_t type;
+    uint8_t seq;
+    const uint8_t* payload;
+    size_t length;
+};
+
+// Receiver side: frames rebuilt from the byte stream, in any chunk sizes
+// Bytes are pushed one at a time, a frame is checked when its delimiter
+// arrives. Bad frames are counted and dropped, the next delimiter starts
+// afresh.
+class BinaryFrameDecoder {
+public:
+    enum Result : uint8_t {
+        BINARY_PENDING,                // Frame not complete yet
+        BINARY_FRAME_READY,            // frame holds a valid frame
+        BINARY_FRAME_BAD               // Frame dropped: malformed, too long or CRC mismatch
+    };
+
+    struct Stats {
+        uint32_t frames;               // Valid frames
+        uint32_t crcErrors;            // Frames failing the CRC
+        uint32_t framingErrors;        // Malformed COBS, too short or too long
+        uint32_t lostFrames;           // Frames missing from the seq count
+    };
+
+private:
+    uint8_t encoded[BINARY_MAX_ENCODED];
+    uint8_t decoded[BINARY_MAX_ENCODED];
+    size_t length;
+    bool overflowed;                  // Frame too long, dropped up to its delimiter
+    bool seqValid;                    // expectedSeq is known
+    uint8_t expectedSeq;
+    Stats stats;
+
+    Result finishFrame(BinaryFrame& frame) {
+        size_t encodedLength = length;
+        bool tooLong = overflowed;
+        length = 0;
+        overflowed = false;
+        if (encodedLength == 0) return BINARY_PENDING;    // Back-to-back delimiters
+        size_t decodedLength = tooLong ? 0 : binaryCobsDecode(encoded, encodedLength, decoded);
+        if (decodedLength < BINARY_FRAME_OVERHEAD) {
+            stats.framingErrors++;
+            return BINARY_FRAME_BAD;
+        }
+        size_t payloadLength = decodedLength - BINARY_FRAME_OVERHEAD;
+        uint16_t crc = decoded[payloadLength + 2] | (uint16_t)(decoded[payloadLength + 3] << 8);
+        if (binaryCrc16(decoded, payloadLength + 2) != crc) {
+            stats.crcErrors++;
+            return BINARY_FRAME_BAD;
+        }
+
+        frame.type = decoded[0];
+        frame.seq = decoded[1];
+        frame.payload = decoded + 2;
+        frame.length = payloadLength;
+        if (seqValid) stats.lostFrames += (uint8_t)(frame.seq - expectedSeq);
+        expectedSeq = frame.seq + 1;
+        seqValid = true;
+        stats.frames++;
+        return BINARY_FRAME_READY;
+    }
+
+public:
+    BinaryFrameDecoder() {
+        reset();
+    }
+
+    // Forget the partial frame, the seq count and the statistics
+    void reset() {
+        length = 0;
+        overflowed = false;
+        seqValid = false;
+        expectedSeq = 0;
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    Result push(uint8_t byte, BinaryFrame& frame) {
+        if (byte == BINARY_FRAME_DELIMITER) return finishFrame(frame);
+        if (length < sizeof(encoded)) {
+            encoded[length++] = byte;
+        } else {
+            overflowed = true;
+        }
+        return BINARY_PENDING;
+    }
+
+    // No partial frame held
+    bool isIdle() const { return length == 0 && !overflowed; }
+
+    const Stats& getStats() const { return stats; }
+};
+
+// ================= Payloads =================
+// Little-endian payload builder, stops writing once full
+struct BinaryWriter {
+    uint8_t* data;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    BinaryWriter(uint8_t* buffer, size_t size) : data(buffer), capacity(size), length(0), overflow(false) {}
+
+    void putU8(uint8_t value) {
+        if (length >= capacity) {
+            overflow = true;
+            return;
+        }
+        data[length++] = value;
+    }
+    void putU16(uint16_t value) {
+        putU8((uint8_t)value);
+        putU8((uint8_t)(value >> 8));
+    }
+    void putI16(int16_t value) { putU16((uint16_t)value); }
+    void putU32(uint32_t value) {
+        putU16((uint16_t)value);
+        putU16((uint16_t)(value >> 16));
+    }
+    void putI32(int32_t value) { putU32((uint32_t)value); }
+    // Signed value in 1 to 5 bytes, small magnitudes first: zigzag then 7 bits per byte
+    void putVarint(int32_t value) {
+        uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        while (zigzag >= 0x80) {
+            putU8((uint8_t)(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        putU8((uint8_t)zigzag);
+    }
+};
+
+// Little-endian payload reader, reads 0 and sets error past the end
+struct BinaryReader {
+    const uint8_t* data;
+    size_t length;
+    size_t position;
+    bool error;
+
+    BinaryReader(const uint8_t* buffer, size_t size) : data(buffer), length(size), position(0), error(false) {}
+
+    uint8_t getU8() {
+        if (position >= length) {
+            error = true;
+            return 0;
+        }
+        return data[position++];
+    }
+    uint16_t getU16() {
+        uint16_t low = getU8();
+        return (uint16_t)(low | (getU8() << 8));
+    }
+    int16_t getI16() { return (int16_t)getU16(); }
+    uint32_t getU32() {
+        uint32_t low = getU16();
+        return low | ((uint32_t)getU16() << 16);
+    }
+    int32_t getI32() { return (int32_t)getU32(); }
+    int32_t getVarint() {
+        uint32_t zigzag = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            uint8_t byte = getU8();
+            zigzag |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        }
+        error = true;
+        return 0;
+    }
+    bool atEnd() const { return position == length; }
+};
+
+#endif // BINARY_PROTOCOL_H
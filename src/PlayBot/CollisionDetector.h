@@ -0,0 +1,206 @@
+// CollisionDetector.h
+#ifndef COLLISION_DETECTOR_H
+#define COLLISION_DETECTOR_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Front collision detection from the stream of ToF distances
+// A detector takes one sample at a time and says whether an obstacle is
+// closer than the threshold. Each implementation trades detection latency
+// for false alarms through its parameters; tools/CollisionReplay replays
+// recorded traces through them to pick the budget. No Arduino dependency,
+// the replay harness builds this header on the host.
+// A reading of 0 is a failed measurement and is skipped. Readings of
+// maxValid or more are the sensor seeing nothing in range: they go in as
+// maxValid, so the filters know the way is clear and junk readings
+// between two of them stand out.
+class CollisionDetector {
+protected:
+    float threshold;              // mm
+    uint16_t maxValid;            // mm
+    bool detected;
+
+    // New state from one valid sample
+    virtual bool step(float distance) = 0;
+
+public:
+    CollisionDetector(float thresholdMm, uint16_t maxValidMm)
+        : threshold(thresholdMm)
+        , maxValid(maxValidMm)
+        , detected(false) {
+    }
+
+    virtual ~CollisionDetector() {}
+
+    // Forget every sample seen
+    virtual void reset() {
+        detected = false;
+    }
+
+    // Feed one sample (mm), returns true while a collision is detected
+    bool update(uint16_t distance) {
+        if (distance == 0) return detected;
+        detected = step(distance < maxValid ? distance : maxValid);
+        return detected;
+    }
+
+    bool isDetected() const { return detected; }
+};
+
+// The original check: exponential smoothing (factor 1/2), then a run of
+// smoothed samples under the threshold. Robust but slow, a 30 sample run
+// at 4 ms is 120 ms on top of the smoothing lag.
+class SmoothedRunDetector : public CollisionDetector {
+private:
+    uint8_t confirm;              // Samples in a row under the threshold
+    float smoothed;
+    bool primed;
+    uint8_t count;
+
+protected:
+    bool step(float distance) override {
+        smoothed = primed ? (smoothed + distance) / 2 : distance;
+        primed = true;
+        if (smoothed >= threshold) {
+            count = 0;
+            return false;
+        }
+        if (count < confirm) count++;
+        return count >= confirm;
+    }
+
+public:
+    SmoothedRunDetector(float thresholdMm, uint16_t maxValidMm, uint8_t confirmSamples)
+        : CollisionDetector(thresholdMm, maxValidMm)
+        , confirm(confirmSamples > 0 ? confirmSamples : 1)
+        , smoothed(0)
+        , primed(false)
+        , count(0) {
+    }
+
+    void reset() override {
+        CollisionDetector::reset();
+        primed = false;
+        count = 0;
+    }
+};
+
+// Hampel filter: each sample further than sigmas scaled MADs from the
+// median of the last window samples is replaced by that median, then a
+// run of confirm filtered samples under the threshold is a collision.
+// Single spurious readings never get through, a real obstacle shows after
+// about half the window. Latency budget: window / 2 + confirm samples;
+// larger windows and fewer sigmas reject longer bursts of bad readings.
+class HampelDetector : public CollisionDetector {
+public:
+    static const uint8_t MAX_WINDOW = 15;
+
+private:
+    static constexpr float madScale = 1.4826f; // MAD to standard deviation for Gaussian noise
+
+    uint8_t window;
+    float sigmas;
+    uint8_t confirm;
+    float samples[MAX_WINDOW];    // Ring of the last window samples
+    uint8_t next;                 // Ring slot written next
+    uint8_t filled;
+    uint8_t count;                // Filtered samples in a row under the threshold
+
+    // Median of the first length values, sorts them in place
+    static float median(float* values, uint8_t length) {
+        for (uint8_t i = 1; i < length; i++) {
+            float value = values[i];
+            uint8_t j = i;
+            while (j > 0 && values[j - 1] > value) {
+                values[j] = values[j - 1];
+                j--;
+            }
+            values[j] = value;
+        }
+        return length & 1 ? values[length / 2] : (values[length / 2 - 1] + values[length / 2]) / 2;
+    }
+
+protected:
+    bool step(float distance) override {
+        samples[next] = distance;
+        next = next + 1 < window ? next + 1 : 0;
+        if (filled < window) filled++;
+
+        float sorted[MAX_WINDOW] = {};
+        for (uint8_t i = 0; i < filled; i++) sorted[i] = samples[i];
+        float center = median(sorted, filled);
+        for (uint8_t i = 0; i < filled; i++) sorted[i] = fabsf(samples[i] - center);
+        float spread = madScale * median(sorted, filled);
+
+        float filtered = fabsf(distance - center) > sigmas * spread ? center : distance;
+        if (filtered >= threshold) {
+            count = 0;
+            return false;
+        }
+        if (count < confirm) count++;
+        return count >= confirm;
+    }
+
+public:
+    HampelDetector(float thresholdMm, uint16_t maxValidMm, uint8_t windowSamples, float thresholdSigmas,
+                   uint8_t confirmSamples)
+        : CollisionDetector(thresholdMm, maxValidMm)
+        , window(windowSamples < 1 ? 1 : windowSamples > MAX_WINDOW ? MAX_WINDOW : windowSamples)
+        , sigmas(thresholdSigmas)
+        , confirm(confirmSamples > 0 ? confirmSamples : 1)
+        , next(0)
+        , filled(0)
+        , count(0) {
+    }
+
+    void reset() override {
+        CollisionDetector::reset();
+        next = 0;
+        filled = 0;
+        count = 0;
+    }
+};
+
+// One-sided CUSUM on how far the distance is under the threshold:
+// g = max(0, g + min(threshold - distance, clip) - drift), a collision
+// once g reaches limit and until it falls back to 0. An obstacle d mm
+// under the threshold is found after about limit / (d + drift) samples,
+// noise smaller than drift never accumulates, and clip bounds what a
+// single bad reading adds. Latency budget: limit / clip samples at best.
+class CusumDetector : public CollisionDetector {
+private:
+    float drift;                  // mm per sample, allowance for noise
+    float limit;                  // mm
+    float clip;                   // mm, largest step of one sample
+    float sum;
+
+protected:
+    bool step(float distance) override {
+        float deviation = threshold - distance;
+        if (deviation > clip) deviation = clip;
+        sum += deviation - drift;
+        if (sum < 0) sum = 0;
+        if (sum >= limit) {
+            sum = limit;          // Bounded, so the alarm clears soon after the obstacle
+            return true;
+        }
+        return detected && sum > 0;
+    }
+
+public:
+    CusumDetector(float thresholdMm, uint16_t maxValidMm, float driftMm, float limitMm, float clipMm)
+        : CollisionDetector(thresholdMm, maxValidMm)
+        , drift(driftMm)
+        , limit(limitMm)
+        , clip(clipMm)
+        , sum(0) {
+    }
+
+    void reset() override {
+        CollisionDetector::reset();
+        sum = 0;
+    }
+};
+
+#endif // COLLISION_DETECTOR_H
@@ -8,55 +8,95 @@
 #include "BatteryManager.h"
 #include "SensorManager.h"
 #include "MotorController.h"
+#include "SafetyMonitor.h"
+#include "TelemetryManager.h"
+#include "StreamFrames.h"
 
 // Manages bidirectional communication between Teensy and Playdate
 // Playdate -> Teensy commands:
-// - "a/filepath" : Start animation from SD
+// - "a/filepath" : Start one-shot animation from SD (overrides base loop)
+// - "o/filepath" : Start one-shot animation added to the base loop
+// - "l/filepath" : Start looping base animation, "l/" stops it
 // - "b" : Request battery status
 // - "d" : Request sensor data
-// - "v" : Verify connection
+// - "d/t" : Request sensor data handling time
+// - "v" : Verify connection, back to the text protocol
+// - "v/version" : Verify connection and switch to the binary protocol (BinaryProtocol.h)
 // - "t/turns/direction" : Turn robot
-// - "x" : Stop animation
+// - "x" : Stop all animations
+// - "f" : Request animation key timing statistics
+// - "n" : List animations on the SD card
+// - "p/path1,path2,..." : Preload animations into RAM cache
+// - "s/fps" : Start streamed animation, "s/0" stops it
+// - "k/head/right/left;head/right/left;..." : Streamed frames, one per credit
+// - "g/type/id/args;..." : Queue motion primitives, "g/c" clears the queue
+// - "y" : Calibrate the motors (feedforward table)
+// - "u/wheel" : Autotune the PID of wheel 0 (right) or 1 (left), "u" tunes both
+// - "i" : Request I2C transaction statistics
+// - "h" : Request edge and collision stop latency histograms
+// - "e/fields/periodMs" : Subscribe telemetry fields (e, p, i, f, l, b, d), period 0 drops them, "e" drops all
 //
 // Teensy -> Playdate messages:
 // - "msg b/percent/voltage/charging" : Battery status
 // - "msg p/0|1" : Power state change
-// - "msg s/" : Connection confirmation
-// - "msg d/..." : Sensor data packet
+// - "msg s/" : Connection confirmation, text protocol
+// - "msg s/v/version" : Connection confirmation, binary frames from the next message on
+// - "msg d/..." : Sensor data packet with the age of each field
+// - "msg d/t/requests/maxUs/avgUs" : Sensor data handling time
 // - "msg r/1" : Rotation completed
 // - "msg e/1" : Edge detected
 // - "msg w/1" : Collision detected
 // - "msg l/0|1" : Light level change
+// - "msg f/keys/dropped/maxLateUs/avgLateUs/maxRefillUs/readStalls" : Key timing
+// - "msg k/credits" : Streamed frames the Playdate may send
+// - "msg n/path/durationMs" : One animation of the list, "msg n/" ends it
+// - "msg g/a|r/id" : Motion primitive accepted or rejected
+// - "msg g/c|x/id" : Motion primitive completed or cancelled
+// - "msg y/1/deadbands..." : Motors calibrated and table saved, "msg y/0" if it failed
+// - "msg u/wheel/1/kP/kI/kD" : Wheel tuned and gains saved, "msg u/wheel/0" if it failed
+// - "msg h/e|w/events/maxUs/buckets..." : Stop latency histogram, edge or collision
+// - "msg i/transactions/nacks/arbLost/busErrors/timeouts/failedReads/maxLatencyUs/avgLatencyUs" : I2C statistics
+// - "msg t/seq/Fvalues/fchanges/..." : Telemetry frame of the subscribed fields due
 class CommunicationManager {
 private:
     // Hardware and subsystem references
     USBHost& myusb;                       // USB host interface
     USBSerial_BigBuffer& userial;         // Serial communication
+    PlaydateLink& link;                   // Messages to Playdate, text or binary
     AnimationManager& animationManager;    // Animation control
     BatteryManager& batteryManager;       // Battery monitoring
     SensorManager& sensorManager;         // Sensor readings
     MotorController& motorController;     // Motor control
+    SafetyMonitor& safetyMonitor;         // Edge and collision stops
+    TelemetryManager& telemetryManager;   // Subscribed telemetry
     
     // Communication settings
     uint32_t baud;                        // Current baud rate
     uint32_t format;                      // Serial format
     char buffer[512];                     // Message buffer
+    StreamFrameParser<STREAM_FRAME_MAX_BYTES> streamFrames; // "k/" frames, kept across reads
 
 public:
     // Initialize with references to all required subsystems
     CommunicationManager(
         USBHost& usb,
         USBSerial_BigBuffer& serial,
+        PlaydateLink& playdate,
         AnimationManager& anim,
         BatteryManager& battery,
         SensorManager& sensor,
-        MotorController& motor
+        MotorController& motor,
+        SafetyMonitor& safety,
+        TelemetryManager& telemetry
     ) : myusb(usb),
         userial(serial),
+        link(playdate),
         animationManager(anim),
         batteryManager(battery),
         sensorManager(sensor),
         motorController(motor),
+        safetyMonitor(safety),
+        telemetryManager(telemetry),
         baud(USBBAUD),
         format(USBHOST_SERIAL_8N1)
     {
@@ -77,7 +117,7 @@ public:
         uint32_t cur_usb_baud = Serial.baud();
         if (cur_usb_baud && (cur_usb_baud != baud)) {
             baud = cur_usb_baud;
-            DEBUG_PRINT(DEBUG_INFO, "Baud rate changed: " + String(baud));
+            DEBUG_PRINT(DEBUG_INFO, "Baud rate changed: %lu", (unsigned long)baud);
             // Special case for 57600 baud - use 58824 instead
             userial.begin(baud == 57600 ? 58824 : baud);
         }
@@ -89,45 +129,177 @@ public:
         uint16_t rd = userial.available();
         if (rd > 0) {
             // Limit message size to prevent buffer overflow
-            if (rd > 80) rd = 80;
+            if (rd > USB_READ_WINDOW) rd = USB_READ_WINDOW;
+            if (link.isBinary()) {
+                readFrames(rd);
+                return;
+            }
+            if (!animationManager.isStreaming()) streamFrames.reset();
+            if (streamFrames.isPending()) {
+                // Rest of the streamed frames of the previous read, a cut frame parsed with its start kept
+                size_t kept = streamFrames.takeTail(buffer);
+                userial.readBytes((char*)buffer + kept, rd);
+                buffer[kept + rd] = '\0';
+                handleStreamFrames();
+                return;
+            }
             userial.readBytes((char*)buffer, rd);
+            buffer[rd] = '\0';
+            // Line ending of a message cut by the end of the previous read
+            size_t ending = strspn(buffer, "\r\n");
+            if (ending > 0) memmove(buffer, buffer + ending, rd - ending + 1);
+            handleMessage();
+        }
+    }
 
-            // Ignore 'c/' commands (handled elsewhere)
-            if (buffer[0] != 'c' || buffer[1] != '/') {
-                char messageType = buffer[0];
-                
-                switch(messageType) {
-                    case 'a':  // Start animation
-                        handleAnimationMessage();
-                        break;
-                    case 'b':  // Battery status request
-                        batteryManager.getBatteryLevel();
-                        break;
-                    case 'd':  // Sensor data request
+private:
+    // Dispatch the message in buffer on its first letter
+    void handleMessage() {
+        // Ignore 'c/' commands (handled elsewhere)
+        if (buffer[0] != 'c' || buffer[1] != '/') {
+            char messageType = buffer[0];
+            
+            switch(messageType) {
+                case 'a':  // Start animation
+                    handleAnimationMessage(AnimationManager::BLEND_OVERRIDE);
+                    break;
+                case 'o':  // Start additive animation
+                    handleAnimationMessage(AnimationManager::BLEND_ADDITIVE);
+                    break;
+                case 'l':  // Start or stop base loop
+                    handleBaseLoopMessage();
+                    break;
+                case 'b':  // Battery status request
+                    batteryManager.getBatteryLevel();
+                    break;
+                case 'd':  // Sensor data request, "d/t" for its handling time
+                    if (buffer[1] == '/' && buffer[2] == 't') {
+                        sensorManager.sendSensorDataStats();
+                    } else {
                         sensorManager.sendSensorData();
-                        break;
-                    case 'v':  // Connection verification
-                        userial.println("msg s/");
-                        break;
-                    case 't':  // Turn robot command
-                        handleCrankTurns();
-                        break;
-                    case 'x':  // Stop animation
-                        animationManager.stopAnimation();
-                        motors.setM1Speed(0);
-                        motors.setM2Speed(0);
-                        DEBUG_PRINT(DEBUG_INFO, "Animation stopped by options menu");
-                        break;
+                    }
+                    break;
+                case 'v':  // Connection verification, protocol negotiation
+                    handleVerifyMessage();
+                    break;
+                case 't':  // Turn robot command
+                    handleCrankTurns();
+                    break;
+                case 'p':  // Preload animations
+                    handlePreloadMessage();
+                    break;
+                case 's':  // Start or stop streamed animation
+                    handleStreamMessage();
+                    break;
+                case 'k':  // Streamed animation frames
+                    handleStreamFrames();
+                    break;
+                case 'n':  // Animation list request
+                    animationManager.sendAnimationList();
+                    break;
+                case 'f':  // Key timing statistics request
+                    animationManager.sendTimingStats();
+                    break;
+                case 'm':  // Control loop timing statistics request
+                    motorController.sendControlStats();
+                    break;
+                case 'q':  // Pose request or pose stream period
+                    handlePoseMessage();
+                    break;
+                case 'z':  // Reset pose to the origin
+                    motorController.resetPose();
+                    break;
+                case 'g':  // Motion primitives
+                    handleMotionMessage();
+                    break;
+                case 'y':  // Motor calibration
+                    motorController.startCalibration();
+                    break;
+                case 'u':  // PID autotune
+                    handleTuneMessage();
+                    break;
+                case 'i':  // I2C statistics request
+                    sensorManager.sendI2CStats();
+                    break;
+                case 'h':  // Stop latency histograms request
+                    safetyMonitor.sendLatencyHistograms();
+                    break;
+                case 'e':  // Telemetry subscription
+                    handleTelemetryMessage();
+                    break;
+                case 'x':  // Stop animation and rotation
+                    animationManager.stopAnimation();
+                    motorController.cancelRotation();
+                    motorController.cancelTuning();
+                    motorController.cancelCalibration();
+                    motorController.clearMotion();
+                    motors.setM1Speed(0);
+                    motors.setM2Speed(0);
+                    DEBUG_PRINT(DEBUG_INFO, "Animation stopped by options menu");
+                    break;
+            }
+        }
+    }
+
+    // Binary protocol: rebuild frames from the bytes read and handle each text frame as a message
+    // A "v" text line between frames (no delimiter in it) goes back to the text protocol,
+    // for a Playdate restarted without knowing the link was binary
+    void readFrames(uint16_t rd) {
+        uint8_t received[USB_READ_WINDOW];
+        userial.readBytes((char*)received, rd);
+        BinaryFrameDecoder& decoder = link.getDecoder();
+        if (decoder.isIdle() && received[0] == 'v' && !memchr(received, BINARY_FRAME_DELIMITER, rd)) {
+            memcpy(buffer, received, rd);
+            buffer[rd] = '\0';
+            handleMessage();
+            return;
+        }
+
+        for (uint16_t i = 0; i < rd; i++) {
+            BinaryFrame frame;
+            BinaryFrameDecoder::Result result = decoder.push(received[i], frame);
+            if (result == BinaryFrameDecoder::BINARY_FRAME_BAD) {
+                const BinaryFrameDecoder::Stats& stats = decoder.getStats();
+                DEBUG_PRINT(DEBUG_WARNING, "Binary frame dropped, %lu CRC and %lu framing errors",
+                            (unsigned long)stats.crcErrors, (unsigned long)stats.framingErrors);
+            } else if (result == BinaryFrameDecoder::BINARY_FRAME_READY) {
+                if (frame.type != BINARY_TYPE_TEXT) {
+                    DEBUG_PRINT(DEBUG_WARNING, "Binary frame type %u ignored", frame.type);
+                    continue;
                 }
+                size_t length = frame.length < sizeof(buffer) - 1 ? frame.length : sizeof(buffer) - 1;
+                memcpy(buffer, frame.payload, length);
+                buffer[length] = '\0';
+                handleMessage();
+                // Back to text: the rest of the read belongs to the old protocol
+                if (!link.isBinary()) return;
             }
         }
     }
 
-private:
-    // Handle animation start command from Playdate
-    // Format: "a/filepath"
-    void handleAnimationMessage() {
-        DEBUG_PRINT(DEBUG_INFO, "Handling animation message");
+    // Handle connection verification from Playdate, "v/version" asks for the binary protocol
+    // Answered with a text line whatever the protocol in use: "msg s/" keeps or goes back to
+    // the text protocol, "msg s/v/version" switches both directions to binary frames after it
+    void handleVerifyMessage() {
+        long requested = buffer[1] == '/' ? atol((char*)buffer + 2) : 0;
+        uint8_t version = requested <= 0 ? 0 : requested > BINARY_PROTOCOL_VERSION ? BINARY_PROTOCOL_VERSION : requested;
+        if (link.isBinary() && version == 0) DEBUG_PRINT(DEBUG_INFO, "Back to the text protocol");
+        link.setVersion(0);
+        streamFrames.reset();
+        if (version == 0) {
+            link.println("msg s/");
+            return;
+        }
+        char reply[16];
+        snprintf(reply, sizeof(reply), "msg s/v/%u", version);
+        link.println(reply);
+        link.setVersion(version);
+        DEBUG_PRINT(DEBUG_INFO, "Binary protocol version %u", version);
+    }
+
+    // Extract the animation path following the command letter
+    // Returns NULL if the message has no '/'
+    char* extractAnimationPath() {
         char* animPath = strchr((char*)buffer, '/');
         if (animPath != NULL) {
             animPath++; // Skip the '/'
@@ -137,20 +309,181 @@ private:
                     animPath[i] = '\0';
                 }
             }
-            animationManager.startAnimation(animPath);
         }
-        DEBUG_PRINT(DEBUG_INFO, "Animation prepared: " + String(animPath));
+        return animPath;
+    }
+
+    // Handle animation start command from Playdate
+    // Format: "a/filepath" (override) or "o/filepath" (additive)
+    void handleAnimationMessage(AnimationManager::BlendMode mode) {
+        DEBUG_PRINT(DEBUG_INFO, "Handling animation message");
+        char* animPath = extractAnimationPath();
+        if (animPath != NULL) {
+            animationManager.startAnimation(animPath, mode);
+        }
+        DEBUG_PRINT(DEBUG_INFO, "Animation prepared: %s", animPath ? animPath : "");
+    }
+
+    // Handle base loop command from Playdate
+    // Format: "l/filepath", or "l/" to stop the loop
+    void handleBaseLoopMessage() {
+        char* animPath = extractAnimationPath();
+        if (animPath == NULL) return;
+        if (animPath[0] == '\0') {
+            animationManager.stopBaseLoop();
+            DEBUG_PRINT(DEBUG_INFO, "Base loop stopped");
+        } else {
+            animationManager.startBaseLoop(animPath);
+            DEBUG_PRINT(DEBUG_INFO, "Base loop started: %s", animPath);
+        }
+    }
+
+    // Handle preload command from Playdate
+    // Format: "p/path1,path2,..."
+    void handlePreloadMessage() {
+        char* paths = strchr((char*)buffer, '/');
+        if (paths == NULL) return;
+        paths++; // Skip the '/'
+        // Cut at the first non-printable character
+        for (int i = 0; paths[i]; i++) {
+            if (!isprint(paths[i])) {
+                paths[i] = '\0';
+                break;
+            }
+        }
+        char* path = strtok(paths, ",");
+        while (path != NULL) {
+            animationManager.preloadAnimation(path);
+            DEBUG_PRINT(DEBUG_INFO, "Preload queued: %s", path);
+            path = strtok(NULL, ",");
+        }
+    }
+
+    // Handle stream command from Playdate
+    // Format: "s/fps", "s/0" stops the stream
+    void handleStreamMessage() {
+        char* rateData = strchr((char*)buffer, '/');
+        if (rateData == NULL) return;
+        int frameRate = atoi(rateData + 1);
+        if (frameRate <= 0) {
+            animationManager.stopStream();
+            DEBUG_PRINT(DEBUG_INFO, "Stream stopped");
+        } else if (frameRate <= STREAM_MAX_FRAME_RATE) {
+            animationManager.startStream(frameRate);
+        }
+    }
+
+    // Handle streamed frames from Playdate
+    // Format: "k/head/right/left;head/right/left;..." (StreamFrames.h)
+    // Another command read along with the frames is handled after them
+    void handleStreamFrames() {
+        char* command = streamFrames.parse(buffer, animationManager);
+        if (command == NULL) return;
+        memmove(buffer, command, strlen(command) + 1);
+        handleMessage();
+    }
+
+    // Handle pose command from Playdate
+    // Format: "q" sends the pose once, "q/period" streams it every period ms, "q/0" stops
+    void handlePoseMessage() {
+        if (buffer[1] == '/') {
+            motorController.setPoseStreamPeriod(atoi((char*)buffer + 2));
+        } else {
+            motorController.sendPose();
+        }
+    }
+
+    // Handle telemetry subscriptions from Playdate
+    // Format: "e/fields/periodMs", "e" alone drops every subscription
+    void handleTelemetryMessage() {
+        if (buffer[1] != '/') {
+            telemetryManager.subscribe(NULL, 0);
+            return;
+        }
+        char* fields = (char*)buffer + 2;
+        size_t length = strcspn(fields, "/\r\n");
+        char* period = fields[length] == '/' ? fields + length + 1 : NULL;
+        fields[length] = '\0';
+        telemetryManager.subscribe(fields, period ? atoi(period) : 0);
+    }
+
+    // Handle motion primitives from Playdate, acknowledged one by one
+    // Format: "g/type/id/args;type/id/args;..." with types
+    //   d/id/distanceMm[/speed]          Drive straight, negative backward
+    //   a/id/radiusMm/angleDeg[/speed]   Arc, radius > 0 turns around a center on the left
+    //   r/id/angleDeg[/speed]            Turn in place, counterclockwise positive
+    //   w/id/durationMs                  Hold position, up to MOTION_MAX_WAIT_MS
+    //   h/id/pulseUs                     Move the head
+    // speed is the peak wheel speed in mm/s. "g/c" clears the queue.
+    void handleMotionMessage() {
+        if (buffer[1] != '/') return;
+        char* ptr = (char*)buffer + 2;
+        if (ptr[0] == 'c' && (ptr[1] == '\0' || ptr[1] == '\r' || ptr[1] == '\n')) {
+            motorController.clearMotion();
+            return;
+        }
+
+        char* context;
+        for (char* item = strtok_r(ptr, ";", &context); item != NULL; item = strtok_r(NULL, ";", &context)) {
+            while (*item == '\r' || *item == '\n') item++;
+            if (item[0] == '\0' || item[1] != '/') continue;
+
+            char type = item[0];
+            char* end;
+            long id = strtol(item + 2, &end, 10);
+            if (end == item + 2) continue;
+            float args[3] = {0, 0, 0};
+            uint8_t count = 0;
+            while (*end == '/' && count < 3) {
+                char* start = end + 1;
+                args[count] = strtof(start, &end);
+                if (end == start) break;
+                count++;
+            }
+
+            bool accepted = false;
+            switch (type) {
+                case 'd':
+                    accepted = count >= 1 && motorController.queueDrive(id, args[0], args[1]);
+                    break;
+                case 'a':
+                    accepted = count >= 2 && motorController.queueArc(id, args[0], args[1], args[2]);
+                    break;
+                case 'r':
+                    accepted = count >= 1 && motorController.queueRotate(id, args[0], args[1]);
+                    break;
+                case 'w':
+                    accepted = count >= 1 && args[0] >= 0 && args[0] <= MOTION_MAX_WAIT_MS
+                               && motorController.queueWait(id, args[0]);
+                    break;
+                case 'h':
+                    // Range checked on the parsed value, before it is narrowed to a pulse
+                    accepted = count >= 1 && args[0] >= ANIMATION_HEAD_MIN && args[0] <= ANIMATION_HEAD_MAX
+                               && motorController.queueHead(id, args[0]);
+                    break;
+            }
+            char reply[24];
+            snprintf(reply, sizeof(reply), "msg g/%c/%u", accepted ? 'a' : 'r', (uint16_t)id);
+            link.println(reply);
+        }
+    }
+
+    // Handle autotune command from Playdate
+    // Format: "u/wheel" with 0 = right and 1 = left, "u" tunes both wheels
+    void handleTuneMessage() {
+        int wheel = buffer[1] == '/' ? atoi((char*)buffer + 2) : -1;
+        motorController.startTuning(wheel);
     }
 
     // Handle turn command from Playdate
     // Format: "t/number_of_turns/direction"
-    // Direction: 1 = clockwise, -1 = counterclockwise
+    // Direction: 1 = counterclockwise (right wheel forward), -1 = clockwise, as the pose heading
     void handleCrankTurns() {
         char* turnData = strchr((char*)buffer, '/') + 1;
         int turns = atoi(turnData);
         int direction = atoi(strchr(turnData, '/') + 1);
         if(turns > 0) {
-            motorController.rotateRobot(turns, direction);
+            motorController.startRotation(turns, direction);
         }
     }
 };
@@ -8,35 +8,129 @@
 // ================= Communication Settings =================
 #define USBBAUD 115200
 #define USB_BUFFER_SIZE 512
+#define USB_READ_WINDOW 80            // Max bytes handled per read pass
 
 // ================= Light Sensor Configuration =================
-#define LIGHT_CHECK_INTERVAL 200      // ms
 #define DARKNESS_THRESHOLD 10
 
 // ================= Edge Detection Configuration =================
 #define EDGE_THRESHOLD 170            // mm
 #define FRONT_SENSOR 1
 #define BACK_SENSOR 0
-#define EDGE_CHECK_INTERVAL 12        // ms
 
 // ================= IR Sensor Configuration =================
-#define IR_CHECK_INTERVAL 8           // ms
+#define IR_EDGE_THRESHOLD_LEFT 15     // Left IR reading at or above which the table edge is seen
+#define IR_EDGE_THRESHOLD_RIGHT 15    // Right IR reading at or above which the table edge is seen
 
 // ================= Battery Monitoring Configuration =================
-#define BATTERY_CHECK_INTERVAL 250    // ms
 // Battery thresholds
 #define BATTERY_LOW_THRESHOLD 15.0f     // 15% battery threshold for warning
 #define BATTERY_CRITICAL_THRESHOLD 5.0f  // 5% battery threshold for shutdown
 // ================= Collision Detection Configuration =================
 #define FRONT_COLLISION_THRESHOLD 70  // mm
 #define COLLISION_CHECK_INTERVAL 4   // ms
+#define COLLISION_CONFIRM_SAMPLES 30  // SmoothedRunDetector: smoothed front samples in a row under the threshold
+#define TOF_MAX_VALID_DISTANCE 1800   // mm, readings this long are the sensor seeing nothing
+// Detector budgets, false alarms against latency (tools/CollisionReplay)
+#define HAMPEL_WINDOW 9               // Samples in the median window, latency about half of it
+#define HAMPEL_THRESHOLD_SIGMAS 2.5f  // Outlier distance from the median, in scaled MADs
+#define HAMPEL_CONFIRM_SAMPLES 3      // Filtered samples in a row under the threshold
+#define CUSUM_DRIFT 5.0f              // mm per sample of noise allowance
+#define CUSUM_LIMIT 40.0f             // mm accumulated under the threshold to detect
+#define CUSUM_CLIP 20.0f              // mm, most one sample can add
+// ================= Safety Stops =================
+#define SAFETY_PERIOD_US 500          // Edge and collision check period (timer interrupt)
+#define SAFETY_HISTOGRAM_BUCKETS 20   // Stop latency buckets, powers of two from 1 µs
+// ================= I2C / ToF Sampling =================
+#define TOF_SENSOR_COUNT 2            // Mux channels with a ToF sensor (BACK_SENSOR, FRONT_SENSOR)
+#define TOF_SAMPLE_INTERVAL COLLISION_CHECK_INTERVAL // ms between rounds reading every sensor
+#define I2C_TRANSACTION_TIMEOUT_US 2000 // Transaction aborted when no STOP is seen by then
+#define I2C_IRQ_PRIORITY 208          // LPI2C1 interrupt, below the motor control loop
+
+// ================= Sample Bus =================
+#define SAMPLE_RING_LENGTH 16         // Samples kept per sensor
+#define SAMPLE_IR_PERIOD_MS 10        // Averaged IR readings
+#define SAMPLE_LIGHT_PERIOD_MS 200    // Light sensor, darkness changes
+#define SAMPLE_USB_DETECT_PERIOD_MS 250 // USB detection, charging changes
+#define SAMPLE_ENCODER_PERIOD_MS 10   // Wheel encoders, travelled distance
+#define SAMPLE_BATTERY_PERIOD_MS 1000 // Battery gauge voltage and charge, blocking I2C read
+
+// ================= Telemetry =================
+#define TELEMETRY_MIN_PERIOD_MS 10    // Fastest field subscription ("e/fields/period")
+#define TELEMETRY_KEYFRAME_MS 1000    // Absolute values of each field at least this often, changes in between
+#define TELEMETRY_FRAME_BYTES 128     // One "msg t/..." frame, more fields start another
+#define TELEMETRY_BUFFER_BYTES 512    // Frames of one loop pass written to USB together
+
+// ================= Analog Sampling =================
+#define ADC_AVERAGING_SELECT 3        // ADC2 hardware averaging per result: 0: 4, 1: 8, 2: 16, 3: 32 samples
+#define ADC_SWEEPS 8                  // Results per channel averaged by reads
 
 // ================= Motion Constants =================
 
-#define ROTATION_SPEED 200
+#define ROTATION_MAX_SPEED 1500.0f    // Peak wheel speed while rotating (ticks/s)
+#define ROTATION_ACCELERATION 4000.0f // Wheel acceleration and deceleration while rotating (ticks/s²)
+#define ROTATION_TOLERANCE_TICKS 8    // Heading error accepted at the end of a rotation
+#define ROTATION_SETTLE_MS 500        // Max time to reach the heading once the profile has ended
 extern bool MOTION_ENABLED;  // Global flag to control all motor movements
+// ================= Motion Queue =================
+#define MOTION_QUEUE_LENGTH 16        // Queued primitives ("g/..."), power of two
+#define MOTION_DEFAULT_SPEED 150.0f   // Peak wheel speed of moves given no speed (mm/s)
+#define MOTION_MAX_SPEED 300.0f       // Fastest accepted wheel speed (mm/s)
+#define MOTION_ACCELERATION 500.0f    // Wheel acceleration and deceleration of moves (mm/s²)
+#define MOTION_MAX_WAIT_MS 600000     // Longest accepted wait primitive (ms)
+#define MOTION_TOLERANCE_TICKS 8      // Wheel error accepted at the end of the queue
+#define MOTION_SETTLE_MS 500          // Max time holding the last targets once the queue has run out
+// ================= Odometry =================
+#define ODOMETRY_VELOCITY_CUTOFF_HZ 20   // Low-pass on the estimated velocities
+#define POSE_MIN_PERIOD_MS 20            // Fastest pose stream ("q/period")
+// ================= Motor Control Loop =================
+#define CONTROL_PERIOD_US PID_SAMPLE_PERIOD_US // Wheel control period (1 kHz), PID gains are scaled for it
+#define CONTROL_LOOP_PRIORITY 192     // IntervalTimer priority, below encoder pin interrupts (128)
+// ================= Stall Detection =================
+#define STALL_WINDOW_MS 200           // Sliding window comparing motor command and wheel speed
+#define STALL_WINDOW_SLOTS 8          // Window resolution, checked once per slot
+#define STALL_MIN_COMMAND 200.0f      // Mean motor command (of 400) that should turn a free wheel
+#define STALL_MAX_SPEED 100.0f        // ticks/s, a wheel slower than this under that command is blocked
+#define STALL_BACKOFF_COMMAND 100.0f  // Command limit once a wheel is blocked
+#define STALL_BACKOFF_MS 300          // Time at the limit before the drive is cut
+#define STALL_CUT_MS 1000             // Time without drive before full commands are allowed again
+// ================= PID Autotune =================
+#define AUTOTUNE_RELAY_OUTPUT 150     // Motor command switched by the relay (of 400)
+#define AUTOTUNE_HYSTERESIS_TICKS 2   // Relay switches this far past the start position
+#define AUTOTUNE_SETTLE_CYCLES 2      // Oscillations ignored before measuring
+#define AUTOTUNE_CYCLES 5             // Oscillations averaged
+#define AUTOTUNE_TIMEOUT_MS 5000      // Per wheel
+#define PID_GAINS_FILE "pidgains.txt" // Tuned gains at the SD root, one "wheel/kP/kI/kD" line per wheel
+// ================= Feedforward =================
+#define FEEDFORWARD_POINTS 16         // Calibrated commands per wheel and direction
+#define FEEDFORWARD_COMMAND_STEP 25.0f // Command between points, the last one is full drive (400)
+#define FEEDFORWARD_DEADBAND_BLEND 50.0f // Target speed below which the dead band fades out (ticks/s)
+#define FEEDFORWARD_VELOCITY_CUTOFF_HZ 30 // Low-pass on the target speed
+#define FEEDFORWARD_FILE "feedfwd.txt" // Calibration at the SD root, one "wheel/direction/deadband/speeds..." line per curve
+#define CALIBRATION_RAMP_RATE 50.0f   // Command increase per second while looking for the dead band
+#define CALIBRATION_BREAKAWAY_TICKS 2 // Travel showing the wheel has started
+#define CALIBRATION_SETTLE_MS 200     // Time at each command before measuring
+#define CALIBRATION_MEASURE_MS 100    // Speed measurement window
+// ================= Animation Cache =================
+#define ANIMATION_CACHE_RAM_BUDGET 65536        // bytes, internal RAM without PSRAM
+#define ANIMATION_CACHE_PSRAM_BUDGET 4194304    // bytes, when PSRAM is fitted
+#define ANIMATION_CACHE_ENTRIES 32              // Max cached files
+#define ANIMATION_CACHE_PATH_LENGTH 64          // Max cached path length
+#define ANIMATION_PRELOAD_QUEUE 16              // Max pending preloads
+// ================= Animation Index =================
+#define ANIMATION_INDEX_FILE "animidx.bin"      // Index file at the SD root
+#define ANIMATION_INDEX_ENTRIES 128             // Max indexed animations
+#define ANIMATION_INDEX_DEPTH 2                 // Directory levels scanned below the root
+// ================= Animation Layers =================
+#define ANIMATION_CROSSFADE_MS 250              // Blend time when a layer starts or ends
+// ================= Animation Streaming =================
+#define STREAM_BUFFER_FRAMES 6                  // Jitter buffer size (frames)
+#define STREAM_PREBUFFER_FRAMES 3               // Frames buffered before playback (re)starts
+#define STREAM_FRAME_MAX_BYTES 20               // Longest frame text, "2500/-32768/-32768;"
+#define STREAM_MAX_FRAME_RATE 100               // fps
+#define STREAM_TIMEOUT_MS 1000                  // Stream ends after this long without frames
+
 // ================= Distance Tracking =================
-#define DISTANCE_UPDATE_INTERVAL 100   // ms
 #define DISTANCE_LOG_INTERVAL 10000    // ms
 
 
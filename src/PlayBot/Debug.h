@@ -3,14 +3,17 @@
 #define DEBUG_H
 
 #include <Arduino.h>
+#include <malloc.h>
+#include <stdarg.h>
 #include <vector>
 #include <string>
-#include <CircularBuffer.hpp>
 #include "HardwareConfig.h"
 
 // Debug system for robot firmware
 // Handles logging, error tracking, and setup verification
 // Integrates with Playdate communication through 'msg s/' messages
+// Logging never touches the heap: entries are formatted in place into a
+// fixed ring of character buffers, so the main loop runs allocation free.
 
 // ================= Debug Levels =================
 // Hierarchical debug levels from none to verbose
@@ -23,47 +26,139 @@
 // ================= Buffer Configuration =================
 // Circular buffer to prevent memory issues with long-running logs
 #define LOG_BUFFER_SIZE 50            // Maximum stored log entries
+#define LOG_ENTRY_LENGTH 112          // Characters per entry, longer messages are truncated
 #define LOG_SEND_INTERVAL 1000        // Milliseconds between log transmissions
+#define HEAP_REPORT_INTERVAL 60000    // Milliseconds between heap usage reports
+#define LOOP_REPORT_INTERVAL 10000    // Milliseconds between main loop timing reports
 
 // ================= Global Variables =================
-// Circular buffer for runtime logs
-static CircularBuffer<String, LOG_BUFFER_SIZE> logBuffer;
+// Circular buffer for runtime logs, oldest entries are overwritten when full
+static char logEntries[LOG_BUFFER_SIZE][LOG_ENTRY_LENGTH];
+static uint8_t logHead = 0;           // Oldest stored entry
+static uint8_t logCount = 0;          // Stored entries
+static uint32_t logOverwritten = 0;   // Entries lost because the buffer was full
 
 // Timestamp for managing log transmission
 static unsigned long lastLogSendTime = 0;
 
+// Heap usage tracking
+static unsigned long lastHeapCheckTime = 0;
+static unsigned long lastHeapReportTime = 0;
+static size_t heapPeakUsed = 0;       // Highest heap use sampled
+static size_t heapLastUsed = 0;       // Heap use at the previous check
+static uint32_t heapChanges = 0;      // Samples where heap use differed from the previous one
+
+// Main loop timing, in CPU cycles
+static unsigned long lastLoopReportTime = 0;
+static uint32_t loopLastCycles = 0;   // Cycle count at the previous pass
+static uint32_t loopPasses = 0;
+static uint32_t loopMaxCycles = 0;
+static uint64_t loopTotalCycles = 0;
+
 // Collection of errors encountered during setup
 // These trigger 'msg s/' failure messages to Playdate
 static std::vector<std::string> setupErrors;
 
+// ================= Function Implementations =================
+
+// Formats a log entry into the next slot of the log buffer
+// Use through DEBUG_PRINT so disabled levels cost nothing
+inline void debugLog(const char* levelName, const char* format, ...) __attribute__((format(printf, 2, 3)));
+inline void debugLog(const char* levelName, const char* format, ...) {
+    uint8_t slot = (logHead + logCount) % LOG_BUFFER_SIZE;
+    if (logCount == LOG_BUFFER_SIZE) {
+        logHead = (logHead + 1) % LOG_BUFFER_SIZE;
+        logOverwritten++;
+    } else {
+        logCount++;
+    }
+
+    char* entry = logEntries[slot];
+    int prefix = snprintf(entry, LOG_ENTRY_LENGTH, "DEBUG [%s]: ", levelName);
+    if (prefix < 0 || prefix >= LOG_ENTRY_LENGTH) return;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(entry + prefix, LOG_ENTRY_LENGTH - prefix, format, args);
+    va_end(args);
+}
+
 // ================= Debug Macro =================
 // Main logging macro - automatically includes level and formats message
-// Usage: DEBUG_PRINT(DEBUG_INFO, "Battery voltage: " + String(voltage));
-#define DEBUG_PRINT(level, message) \
+// Usage: DEBUG_PRINT(DEBUG_INFO, "Battery voltage: %.2f", voltage);
+#define DEBUG_PRINT(level, ...) \
     if (level <= CURRENT_DEBUG_LEVEL) { \
-        String logMessage = String("DEBUG [") + String(#level) + String("]: ") + String(message); \
-        logBuffer.push(logMessage); \
+        debugLog(#level, __VA_ARGS__); \
     }
 
-// ================= Function Implementations =================
-
 // Transmits accumulated logs at regular intervals
 // Called in main loop to maintain communication flow
 inline void sendLogs() {
     unsigned long currentTime = millis();
     if (currentTime - lastLogSendTime >= LOG_SEND_INTERVAL) {
-        while (!logBuffer.isEmpty()) {
-            Serial.println(logBuffer.shift());
+        while (logCount > 0) {
+            Serial.println(logEntries[logHead]);
+            logHead = (logHead + 1) % LOG_BUFFER_SIZE;
+            logCount--;
         }
         lastLogSendTime = currentTime;
     }
 }
 
+// Samples heap usage every LOG_SEND_INTERVAL and reports it every HEAP_REPORT_INTERVAL
+// Called in main loop: in steady state heap use must not change, so a
+// growing change count points at an allocation left behind by the loop.
+// The arena size is the high-water mark of the heap, it never shrinks.
+inline void checkHeapUsage() {
+    unsigned long currentTime = millis();
+    if (currentTime - lastHeapCheckTime < LOG_SEND_INTERVAL) return;
+    lastHeapCheckTime = currentTime;
+
+    struct mallinfo info = mallinfo();
+    size_t used = info.uordblks;
+    if (heapPeakUsed > 0 && used != heapLastUsed) heapChanges++;
+    heapLastUsed = used;
+    if (used > heapPeakUsed) heapPeakUsed = used;
+
+    if (currentTime - lastHeapReportTime >= HEAP_REPORT_INTERVAL) {
+        DEBUG_PRINT(DEBUG_INFO, "Heap: %u bytes used, peak %u, arena %u, free %u, changes %lu, logs lost %lu",
+                    (unsigned)used, (unsigned)heapPeakUsed, (unsigned)info.arena, (unsigned)info.fordblks,
+                    (unsigned long)heapChanges, (unsigned long)logOverwritten);
+        lastHeapReportTime = currentTime;
+    }
+}
+
+// Measures main loop passes and reports them every LOOP_REPORT_INTERVAL
+// Called once per pass, a pass is the time between two calls. Compare the
+// reports before and after a change to see what it costs the loop.
+inline void checkLoopTime() {
+    uint32_t now = ARM_DWT_CYCCNT;
+    if (loopLastCycles != 0) {
+        uint32_t pass = now - loopLastCycles;
+        loopPasses++;
+        loopTotalCycles += pass;
+        if (pass > loopMaxCycles) loopMaxCycles = pass;
+    }
+    loopLastCycles = now;
+
+    unsigned long currentTime = millis();
+    if (currentTime - lastLoopReportTime >= LOOP_REPORT_INTERVAL && loopPasses > 0) {
+        uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+        DEBUG_PRINT(DEBUG_INFO, "Loop: %lu passes, avg %lu us, max %lu us",
+                    (unsigned long)loopPasses,
+                    (unsigned long)(loopTotalCycles / loopPasses / cyclesPerMicro),
+                    (unsigned long)(loopMaxCycles / cyclesPerMicro));
+        loopPasses = 0;
+        loopTotalCycles = 0;
+        loopMaxCycles = 0;
+        lastLoopReportTime = currentTime;
+    }
+}
+
 // Records setup phase errors
 // These errors affect the success/failure message sent to Playdate
-inline void recordSetupError(const String& errorMessage) {
-    setupErrors.push_back(errorMessage.c_str());
-    DEBUG_PRINT(DEBUG_WARNING, "Setup Error: " + errorMessage);
+inline void recordSetupError(const char* errorMessage) {
+    setupErrors.push_back(errorMessage);
+    DEBUG_PRINT(DEBUG_WARNING, "Setup Error: %s", errorMessage);
 }
 
 // Prints setup error summary and notifies Playdate
@@ -72,19 +167,20 @@ inline void printSetupErrorSummary() {
     if (setupErrors.empty()) {
         Serial.println("Setup completed successfully with no errors.");
         DEBUG_PRINT(DEBUG_INFO, "Setup completed successfully with no errors.");
-        userial.println("msg s/1");  // Signal success to Playdate
+        playdateLink.println("msg s/1");  // Signal success to Playdate
     } else {
         Serial.println("Setup completed with the following errors:");
         for (const auto& error : setupErrors) {
-            Serial.println("- " + String(error.c_str()));
+            Serial.print("- ");
+            Serial.println(error.c_str());
         }
         DEBUG_PRINT(DEBUG_WARNING, "Setup completed with errors:");
         for (const auto& error : setupErrors) {
-            DEBUG_PRINT(DEBUG_WARNING, "- " + String(error.c_str()));
+            DEBUG_PRINT(DEBUG_WARNING, "- %s", error.c_str());
         }
         // Note: No explicit failure message sent to Playdate
         // Absence of "msg s/1" indicates setup failure
     }
 }
 
-#endif // DEBUG_H
\ No newline at end of file
+#endif // DEBUG_H
@@ -4,6 +4,7 @@
 
 #include "Config.h"
 #include "Debug.h"
+#include "SampleBus.h"
 #include <SD.h>
 
 // Class to track total distance traveled by the robot
@@ -18,21 +19,24 @@ private:
         float averageDistance;   // Average of both wheels (mm)
         long lastLeftPosition;   // Last encoder position for left wheel
         long lastRightPosition;  // Last encoder position for right wheel
-        unsigned long lastUpdateTime;  // Timestamp of last update
+        uint32_t lastResetCount; // encoderResetCount when the positions were taken
+        uint32_t lastSampleTime; // micros() of the last encoder sample counted
     } totalDistance;
 
     const char* LOG_FILENAME = "distance.txt";  // File for persistent storage
     unsigned long lastDistanceLogTime;          // Timestamp for periodic logging
-    Encoder& encoderLeft;                       // Reference to left wheel encoder
-    Encoder& encoderRight;                      // Reference to right wheel encoder
+    SampleBus& sampleBus;                       // Encoder samples
+    uint32_t seenSamples;                       // Encoder samples already counted
+    bool positionsTaken;                        // lastLeft/RightPosition hold a sample
 
 public:
-    // Constructor - initializes tracking with encoders
-    DistanceTracker(Encoder& left, Encoder& right) 
-        : encoderLeft(left)
-        , encoderRight(right)
-        , lastDistanceLogTime(0) {
-        totalDistance = {0, 0, 0, 0, 0, 0};
+    // Constructor - initializes tracking from the encoder samples
+    explicit DistanceTracker(SampleBus& bus)
+        : lastDistanceLogTime(0)
+        , sampleBus(bus)
+        , seenSamples(0)
+        , positionsTaken(false) {
+        totalDistance = {0, 0, 0, 0, 0, 0, 0};
     }
 
     // Initialize distance tracking and load previous data
@@ -40,34 +44,40 @@ public:
     void initialize() {
         DEBUG_PRINT(DEBUG_INFO, "Starting distance initialization");
         loadFromFile();  // Load previous distance from SD card
-        // Reset encoder positions for new tracking session
-        totalDistance.lastLeftPosition = encoderLeft.read();
-        totalDistance.lastRightPosition = encoderRight.read();
-        totalDistance.lastUpdateTime = millis();
+        // New tracking session: the next encoder sample gives the start positions
+        seenSamples = sampleBus.encoders().getWritten();
+        positionsTaken = false;
     }
 
-    // Update distance calculations based on encoder readings
+    // Add the wheel travel between the encoder samples taken since the last update
     // Should be called regularly in the main loop
     void update() {
-        unsigned long currentTime = millis();
-        if (currentTime - totalDistance.lastUpdateTime >= DISTANCE_UPDATE_INTERVAL) {
-            // Get current encoder positions
-            long currentLeftPos = encoderLeft.read();
-            long currentRightPos = encoderRight.read();
+        TimedSample<EncoderReading> samples[SAMPLE_RING_LENGTH];
+        uint8_t count = sampleBus.encoders().readNew(seenSamples, samples, SAMPLE_RING_LENGTH);
+        for (uint8_t i = 0; i < count; i++) {
+            const EncoderReading& reading = samples[i].value;
+
+            // First sample, or encoders zeroed since the last one: restart from the new positions
+            if (!positionsTaken || reading.resetCount != totalDistance.lastResetCount) {
+                totalDistance.lastResetCount = reading.resetCount;
+                totalDistance.lastLeftPosition = reading.left;
+                totalDistance.lastRightPosition = reading.right;
+                positionsTaken = true;
+            }
 
-            // Calculate incremental distances since last update
-            float leftIncrement = abs(currentLeftPos - totalDistance.lastLeftPosition) * MM_PER_TICK;
-            float rightIncrement = abs(currentRightPos - totalDistance.lastRightPosition) * MM_PER_TICK;
+            // Calculate incremental distances since the previous sample
+            float leftIncrement = abs(reading.left - totalDistance.lastLeftPosition) * MM_PER_TICK;
+            float rightIncrement = abs(reading.right - totalDistance.lastRightPosition) * MM_PER_TICK;
 
             // Update total distances
             totalDistance.leftDistance += leftIncrement;
             totalDistance.rightDistance += rightIncrement;
             totalDistance.averageDistance = (totalDistance.leftDistance + totalDistance.rightDistance) / 2.0f;
 
-            // Store current positions for next update
-            totalDistance.lastLeftPosition = currentLeftPos;
-            totalDistance.lastRightPosition = currentRightPos;
-            totalDistance.lastUpdateTime = currentTime;
+            // Store current positions for the next sample
+            totalDistance.lastLeftPosition = reading.left;
+            totalDistance.lastRightPosition = reading.right;
+            totalDistance.lastSampleTime = samples[i].timestamp;
         }
     }
 
@@ -97,7 +107,7 @@ public:
             dtostrf(getDistanceMeters(), 1, 2, distanceStr);
             distanceLog.print(distanceStr);
             distanceLog.close();
-            DEBUG_PRINT(DEBUG_INFO, "Distance logged: " + String(getDistanceMeters()) + "m");
+            DEBUG_PRINT(DEBUG_INFO, "Distance logged: %.2fm", getDistanceMeters());
         } else {
             DEBUG_PRINT(DEBUG_WARNING, "Failed to open distance file");
         }
@@ -110,9 +120,10 @@ private:
         if (SD.exists(LOG_FILENAME)) {
             File distanceLog = SD.open(LOG_FILENAME, FILE_READ);
             if (distanceLog) {
-                String distanceStr = distanceLog.readStringUntil('\n');
-                distanceStr.trim();
-                float savedDistance = distanceStr.toFloat();
+                char distanceStr[16];
+                size_t length = distanceLog.readBytesUntil('\n', distanceStr, sizeof(distanceStr) - 1);
+                distanceStr[length] = '\0';
+                float savedDistance = atof(distanceStr);
                 
                 // Convert loaded meters to millimeters and set all distances
                 totalDistance.averageDistance = savedDistance * 1000.0f;
@@ -120,7 +131,7 @@ private:
                 totalDistance.rightDistance = totalDistance.averageDistance;
                 
                 distanceLog.close();
-                DEBUG_PRINT(DEBUG_INFO, "Distance loaded: " + String(savedDistance) + "m");
+                DEBUG_PRINT(DEBUG_INFO, "Distance loaded: %.2fm", savedDistance);
             }
         }
     }
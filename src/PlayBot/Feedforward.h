@@ -0,0 +1,116 @@
+// Feedforward.h
+#ifndef FEEDFORWARD_H
+#define FEEDFORWARD_H
+
+#include "Config.h"
+#include <math.h>
+
+// Measured response of one wheel in one direction (see MotorCalibration)
+struct MotorResponse {
+    float deadband;                       // Lowest command that starts the wheel
+    float velocity[FEEDFORWARD_POINTS];   // Speed at command (i + 1) * FEEDFORWARD_COMMAND_STEP (ticks/s)
+};
+
+// Motor command needed for a wheel speed, from the calibrated responses
+// Each wheel and direction has its own curve: the dead band, then the
+// measured speeds interpolated linearly, extrapolated past the last point.
+// Curves are compiled once so lookup() is a short scan and one
+// multiply-add, cheap enough for every control period.
+class FeedforwardTable {
+public:
+    static const uint8_t FORWARD = 0;
+    static const uint8_t BACKWARD = 1;
+
+private:
+    // Points of one curve, speed increasing strictly
+    struct Curve {
+        uint8_t count;                            // 0 when not calibrated
+        float velocity[FEEDFORWARD_POINTS + 1];   // ticks/s
+        float command[FEEDFORWARD_POINTS + 1];
+        float slope[FEEDFORWARD_POINTS + 1];      // Command per ticks/s up to the next point
+    };
+
+    MotorResponse responses[2][2];  // [wheel][direction] as measured
+    Curve curves[2][2];
+
+    // Build the curve of one response, points that do not speed the wheel up are skipped
+    static void compile(const MotorResponse& response, Curve& curve) {
+        curve.count = 0;
+        float lastVelocity = 0;
+        for (uint8_t i = 0; i < FEEDFORWARD_POINTS; i++) {
+            float command = (i + 1) * FEEDFORWARD_COMMAND_STEP;
+            if (command <= response.deadband || response.velocity[i] <= lastVelocity) continue;
+            curve.velocity[curve.count] = response.velocity[i];
+            curve.command[curve.count] = command;
+            lastVelocity = response.velocity[i];
+            curve.count++;
+        }
+
+        // Slopes toward each point, from the dead band for the first one
+        float fromVelocity = 0;
+        float fromCommand = response.deadband;
+        for (uint8_t i = 0; i < curve.count; i++) {
+            curve.slope[i] = (curve.command[i] - fromCommand) / (curve.velocity[i] - fromVelocity);
+            fromVelocity = curve.velocity[i];
+            fromCommand = curve.command[i];
+        }
+    }
+
+public:
+    FeedforwardTable() {
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            for (uint8_t direction = 0; direction < 2; direction++) {
+                responses[wheel][direction].deadband = 0;
+                for (uint8_t i = 0; i < FEEDFORWARD_POINTS; i++) {
+                    responses[wheel][direction].velocity[i] = 0;
+                }
+                curves[wheel][direction].count = 0;
+            }
+        }
+    }
+
+    // True if the response has at least one point above its dead band
+    static bool isUsable(const MotorResponse& response) {
+        Curve curve;
+        compile(response, curve);
+        return curve.count > 0;
+    }
+
+    // Replace the response of a wheel and direction
+    void setResponse(uint8_t wheel, uint8_t direction, const MotorResponse& response) {
+        responses[wheel][direction] = response;
+        compile(response, curves[wheel][direction]);
+    }
+
+    const MotorResponse& getResponse(uint8_t wheel, uint8_t direction) const {
+        return responses[wheel][direction];
+    }
+
+    // True once both directions of the wheel have a usable curve
+    bool isCalibrated(uint8_t wheel) const {
+        return curves[wheel][FORWARD].count > 0 && curves[wheel][BACKWARD].count > 0;
+    }
+
+    // Motor command for the wheel to turn at velocity (ticks/s), 0 if not calibrated
+    // Below FEEDFORWARD_DEADBAND_BLEND ticks/s the dead band is blended in
+    // gradually so holding still does not chatter.
+    float lookup(uint8_t wheel, float velocity) const {
+        const Curve& curve = curves[wheel][velocity >= 0 ? FORWARD : BACKWARD];
+        if (curve.count == 0) return 0;
+        float speed = fabsf(velocity);
+        float deadband = curve.command[0] - curve.slope[0] * curve.velocity[0];
+
+        float command;
+        if (speed < FEEDFORWARD_DEADBAND_BLEND) {
+            command = (deadband + curve.slope[0] * speed) * (speed / FEEDFORWARD_DEADBAND_BLEND);
+        } else {
+            uint8_t i = 0;
+            while (i < curve.count - 1 && speed > curve.velocity[i]) i++;
+            command = curve.command[i] + curve.slope[i] * (speed - curve.velocity[i]);
+        }
+        if (command > MOTOR_COMMAND_LIMIT) command = MOTOR_COMMAND_LIMIT;
+        return velocity >= 0 ? command : -command;
+    }
+};
+
+#endif // FEEDFORWARD_H
@@ -20,7 +20,15 @@
 #define IR_SENSOR_LEFT_PIN 39
 #define IR_SENSOR_RIGHT_PIN 38
 #define LIGHT_SENSOR_PIN 27
+// ADC2 inputs of the analog pins (Teensy 4.1), pins 38, 39 and 27 are only on ADC2
+#define IR_SENSOR_LEFT_ADC 2
+#define IR_SENSOR_RIGHT_ADC 1
+#define LIGHT_SENSOR_ADC 4
+#define USB_DETECT_ADC 11
 #define TOF_MULTIPLEXER_ADDR 0x70  // I2C address for ToF multiplexer
+#define PCA9540_ENABLE 0x04        // Mux control register: channel enable, OR the channel number
+#define TOF_SENSOR_ADDR 0x52       // I2C address of each ToF sensor (behind the mux)
+#define TOF_DISTANCE_REGISTER 0x00 // Distance in mm, 2 bytes MSB first
 
 // Status & Control
 #define LED_PIN 28
@@ -39,7 +47,7 @@
 #define ENCODER_PPR 813      // Pulses per revolution
 
 #define MM_PER_TICK ((PI * WHEEL_DIAMETER) / ENCODER_PPR)
-#define TICKS_PER_ROBOT_ROTATION (int)((PI * WHEEL_BASE * ENCODER_PPR) / WHEEL_DIAMETER)
+#define TICKS_PER_ROBOT_ROTATION ((WHEEL_BASE * ENCODER_PPR) / WHEEL_DIAMETER)  // Wheel travel for one turn in place
 
 // Motor characteristics
 #define MOTOR_PWM_FREQUENCY 330000  // PWM frequency in Hz
@@ -49,27 +57,23 @@
 // Include libraries 
 #include <Encoder.h>
 #include <DRV8835MotorShield.h>
-#include <PID_v1.h>
-#undef REVERSE  // Undefine REVERSE before PID
 #include <WS2812FX.h>
 #include <Servo.h>
 #include <USBHost_t36.h>
 #include "Adafruit_MAX1704X.h" 
-#include <PCA9540BD.h>
+#include "PlaydateLink.h"
 
 // ================= Hardware Objects & Variables =================
-// PID variables with inline initialization
-inline double Input = 0, Output = 0, Setpoint = 0;
-inline double Input2 = 0, Output2 = 0, Setpoint2 = 0;
-
 // Core hardware objects
 inline Encoder myEnc(ENC1_PIN_A, ENC1_PIN_B);
 inline Encoder myEnc2(ENC2_PIN_A, ENC2_PIN_B);
 inline DRV8835MotorShield motors(MOTOR1_PWM_PIN, MOTOR1_DIR_PIN, MOTOR2_PWM_PIN, MOTOR2_DIR_PIN);
 
-// PID controllers
-inline PID myPID(&Input, &Output, &Setpoint, PID_KP, PID_KI, PID_KD, AUTOMATIC);
-inline PID myPID2(&Input2, &Output2, &Setpoint2, PID_KP, PID_KI, PID_KD, AUTOMATIC);
+// Wheel encoder reset counter, odd while a reset is in progress
+// Readers working on encoder increments (odometry, distance tracking)
+// compare it to their last value and take new references instead of
+// counting the jump back to zero as travel
+inline volatile uint32_t encoderResetCount = 0;
 
 // Peripheral devices
 inline WS2812FX ws2812fx(LED_COUNT, LED_PIN, NEO_GRB + NEO_KHZ800);
@@ -77,7 +81,7 @@ inline Servo headServo;
 inline USBHost myusb;
 inline USBHub hub1(myusb);
 inline USBSerial_BigBuffer userial(myusb, 1);
-inline PCA9540BD mux;
+inline PlaydateLink playdateLink(userial);   // Messages to Playdate, text lines or binary frames
 inline Adafruit_MAX17048 maxlipo;
 
 #endif // HARDWARE_CONFIG_H
\ No newline at end of file
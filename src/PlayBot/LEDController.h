@@ -101,7 +101,7 @@ public:
         if (!isInitialized) return;
         brightness = level;
         strip.setBrightness(brightness);
-        DEBUG_PRINT(DEBUG_VERBOSE, "LED brightness set to: " + String(brightness));
+        DEBUG_PRINT(DEBUG_VERBOSE, "LED brightness set to: %u", brightness);
     }
     
     // Check if LED controller is ready
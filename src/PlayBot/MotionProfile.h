@@ -0,0 +1,64 @@
+// MotionProfile.h
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <math.h>
+
+// Trapezoidal velocity profile over a fixed distance
+// Accelerates at a constant rate up to the peak speed, cruises, then
+// decelerates at the same rate to stop exactly at the distance. Moves too
+// short to reach the peak speed become triangular.
+// Units are whatever the caller uses, the control loop uses encoder ticks
+// and seconds.
+class TrapezoidProfile {
+private:
+    float distance;               // Total travel, always positive
+    float acceleration;           // Ramp rate
+    float peakSpeed;              // Speed reached at the end of the ramp
+    float rampTime;               // Duration of each ramp
+    float cruiseTime;             // Duration at peak speed
+
+public:
+    TrapezoidProfile()
+        : distance(0)
+        , acceleration(1)
+        , peakSpeed(0)
+        , rampTime(0)
+        , cruiseTime(0) {
+    }
+
+    // Plan a move of the given distance with speed and acceleration limits
+    void plan(float moveDistance, float maxSpeed, float maxAcceleration) {
+        distance = fabsf(moveDistance);
+        acceleration = maxAcceleration;
+        rampTime = maxSpeed / acceleration;
+        float rampDistance = 0.5f * acceleration * rampTime * rampTime;
+        if (2 * rampDistance > distance) {
+            // Triangular: decelerate as soon as half the distance is covered
+            rampTime = sqrtf(distance / acceleration);
+            peakSpeed = acceleration * rampTime;
+            cruiseTime = 0;
+        } else {
+            peakSpeed = maxSpeed;
+            cruiseTime = (distance - 2 * rampDistance) / maxSpeed;
+        }
+    }
+
+    // Position along the move at time t since its start
+    float positionAt(float t) const {
+        if (t <= 0) return 0;
+        if (t < rampTime) return 0.5f * acceleration * t * t;
+        float cruising = t - rampTime;
+        if (cruising < cruiseTime) return 0.5f * acceleration * rampTime * rampTime + peakSpeed * cruising;
+        float remaining = getDuration() - t;
+        if (remaining > 0) return distance - 0.5f * acceleration * remaining * remaining;
+        return distance;
+    }
+
+    // Profile getters
+    float getDistance() const { return distance; }
+    float getPeakSpeed() const { return peakSpeed; }
+    float getDuration() const { return 2 * rampTime + cruiseTime; }
+};
+
+#endif // MOTION_PROFILE_H
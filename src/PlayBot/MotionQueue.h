@@ -0,0 +1,93 @@
+// MotionQueue.h
+#ifndef MOTION_QUEUE_H
+#define MOTION_QUEUE_H
+
+#include "Config.h"
+#include <atomic>
+
+// One step of a motion sequence sent by the Playdate ("g/...")
+struct MotionPrimitive {
+    enum Type : uint8_t {
+        MOVE,                     // Wheel travel: drive, arc or rotation
+        WAIT,                     // Hold the wheels in place
+        HEAD                      // Move the head servo
+    };
+
+    enum Status : uint8_t {
+        PENDING,
+        COMPLETED,
+        CANCELLED                 // Cleared, or stopped by an animation or motion disabled
+    };
+
+    uint16_t id;                  // Chosen by the Playdate, echoed in its messages
+    Type type;
+    Status status;                // Set by the control loop once done
+    float travelRight;            // MOVE: wheel travel (ticks)
+    float travelLeft;
+    float speed;                  // MOVE: peak speed of the faster wheel (ticks/s)
+    uint32_t value;               // WAIT: duration (control periods), HEAD: servo pulse (µs)
+};
+
+// Bounded queue of motion primitives, filled by the main loop and run by
+// the control interrupt
+// One ring, three indices: primitives between reported and done wait to be
+// reported, those between done and pushed wait to be run. A slot is only
+// reused once reported, so neither side ever waits for the other.
+class MotionQueue {
+private:
+    static_assert((MOTION_QUEUE_LENGTH & (MOTION_QUEUE_LENGTH - 1)) == 0 && MOTION_QUEUE_LENGTH <= 128,
+                  "MOTION_QUEUE_LENGTH must be a power of two up to 128");
+
+    MotionPrimitive entries[MOTION_QUEUE_LENGTH];
+    volatile uint8_t pushed;      // Written by the main loop
+    volatile uint8_t done;        // Written by the interrupt
+    uint8_t reported;             // Main loop only
+
+    static uint8_t slot(uint8_t index) { return index & (MOTION_QUEUE_LENGTH - 1); }
+
+public:
+    MotionQueue()
+        : pushed(0)
+        , done(0)
+        , reported(0) {
+    }
+
+    // Main loop: append a primitive, false if the queue is full
+    bool push(const MotionPrimitive& primitive) {
+        if ((uint8_t)(pushed - reported) >= MOTION_QUEUE_LENGTH) return false;
+        MotionPrimitive& entry = entries[slot(pushed)];
+        entry = primitive;
+        entry.status = MotionPrimitive::PENDING;
+        std::atomic_signal_fence(std::memory_order_release);
+        pushed = pushed + 1;
+        return true;
+    }
+
+    // Main loop: take the next finished primitive to report, false if none
+    bool popFinished(MotionPrimitive& primitive) {
+        if (reported == done) return false;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        primitive = entries[slot(reported)];
+        reported++;
+        return true;
+    }
+
+    // True when every pushed primitive has been run
+    bool isIdle() const { return done == pushed; }
+
+    // Interrupt: primitive to run, nullptr if the queue is empty
+    const MotionPrimitive* front() {
+        if (done == pushed) return nullptr;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        return &entries[slot(done)];
+    }
+
+    // Interrupt: end the front primitive
+    void finish(MotionPrimitive::Status status) {
+        entries[slot(done)].status = status;
+        std::atomic_signal_fence(std::memory_order_release);
+        done = done + 1;
+    }
+};
+
+#endif // MOTION_QUEUE_H
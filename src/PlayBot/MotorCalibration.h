@@ -0,0 +1,164 @@
+// MotorCalibration.h
+#ifndef MOTOR_CALIBRATION_H
+#define MOTOR_CALIBRATION_H
+
+#include "Config.h"
+#include "Feedforward.h"
+#include <stdlib.h>
+
+// Open-loop sweep measuring wheel speed against motor command
+// The robot turns in place, right wheel forward and left wheel backward,
+// then the other way, so every wheel and direction is measured without the
+// robot leaving its spot. Each half runs three phases:
+// - Dead band: the command ramps up at CALIBRATION_RAMP_RATE until each
+//   wheel has moved CALIBRATION_BREAKAWAY_TICKS
+// - Steps: each FEEDFORWARD_COMMAND_STEP multiple is held
+//   CALIBRATION_SETTLE_MS, then the speed is measured over
+//   CALIBRATION_MEASURE_MS
+// - Pause: motors off for CALIBRATION_SETTLE_MS
+// Wheel 0 is the right wheel and 1 the left wheel, like the PID channels.
+// Called by the control loop every CONTROL_PERIOD_US.
+class MotorCalibration {
+public:
+    enum State : uint8_t {
+        CALIBRATION_RUNNING,
+        CALIBRATION_DONE,
+        CALIBRATION_FAILED        // A wheel did not move at full command
+    };
+
+private:
+    enum Phase : uint8_t {
+        PHASE_RAMP,
+        PHASE_STEPS,
+        PHASE_PAUSE
+    };
+
+    static constexpr float period = CONTROL_PERIOD_US / 1000000.0f;
+    static constexpr uint32_t settleTicks = (uint32_t)CALIBRATION_SETTLE_MS * 1000 / CONTROL_PERIOD_US;
+    static constexpr uint32_t measureTicks = (uint32_t)CALIBRATION_MEASURE_MS * 1000 / CONTROL_PERIOD_US;
+    static constexpr float rampStep = CALIBRATION_RAMP_RATE * period;
+    static constexpr float fullCommand = FEEDFORWARD_POINTS * FEEDFORWARD_COMMAND_STEP;
+
+    MotorResponse responses[2][2]; // [wheel][direction] being measured
+    uint8_t half;                 // 0: right forward and left backward, 1: the reverse
+    Phase phase;
+    uint8_t point;                // Step being measured
+    uint32_t phaseTicks;          // Control periods since the phase or step started
+    float rampCommand;            // Dead band search command
+    int32_t startCounts[2];       // Counts at the ramp start or measurement start
+    bool moving[2];               // Dead band found in this half
+    State state;
+
+    // Direction a wheel turns in the current half
+    uint8_t direction(uint8_t wheel) const {
+        return (wheel == 0) == (half == 0) ? FeedforwardTable::FORWARD : FeedforwardTable::BACKWARD;
+    }
+
+    void startRamp(const int32_t counts[2]) {
+        phase = PHASE_RAMP;
+        phaseTicks = 0;
+        rampCommand = 0;
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            startCounts[wheel] = counts[wheel];
+            moving[wheel] = false;
+        }
+    }
+
+public:
+    MotorCalibration()
+        : half(0)
+        , phase(PHASE_PAUSE)
+        , point(0)
+        , phaseTicks(0)
+        , rampCommand(0)
+        , state(CALIBRATION_FAILED) {
+        startCounts[0] = startCounts[1] = 0;
+        moving[0] = moving[1] = false;
+    }
+
+    // Start the sweep from the current encoder counts
+    void begin(const int32_t counts[2]) {
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            for (uint8_t dir = 0; dir < 2; dir++) {
+                responses[wheel][dir].deadband = 0;
+                for (uint8_t i = 0; i < FEEDFORWARD_POINTS; i++) {
+                    responses[wheel][dir].velocity[i] = 0;
+                }
+            }
+        }
+        half = 0;
+        state = CALIBRATION_RUNNING;
+        startRamp(counts);
+    }
+
+    // Advance one control period, commands receive the signed motor commands
+    void step(const int32_t counts[2], float commands[2]) {
+        commands[0] = commands[1] = 0;
+        if (state != CALIBRATION_RUNNING) return;
+        phaseTicks++;
+
+        float command = 0;
+        switch (phase) {
+            case PHASE_RAMP:
+                rampCommand += rampStep;
+                for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                    if (!moving[wheel] && labs(counts[wheel] - startCounts[wheel]) >= CALIBRATION_BREAKAWAY_TICKS) {
+                        moving[wheel] = true;
+                        responses[wheel][direction(wheel)].deadband = rampCommand;
+                    }
+                }
+                if (moving[0] && moving[1]) {
+                    phase = PHASE_STEPS;
+                    point = 0;
+                    phaseTicks = 0;
+                } else if (rampCommand >= fullCommand) {
+                    state = CALIBRATION_FAILED;
+                    return;
+                }
+                command = rampCommand;
+                break;
+
+            case PHASE_STEPS:
+                command = (point + 1) * FEEDFORWARD_COMMAND_STEP;
+                if (phaseTicks == settleTicks) {
+                    startCounts[0] = counts[0];
+                    startCounts[1] = counts[1];
+                } else if (phaseTicks >= settleTicks + measureTicks) {
+                    for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                        responses[wheel][direction(wheel)].velocity[point] =
+                            labs(counts[wheel] - startCounts[wheel]) / (measureTicks * period);
+                    }
+                    phaseTicks = 0;
+                    if (++point == FEEDFORWARD_POINTS) {
+                        phase = PHASE_PAUSE;
+                        command = 0;
+                    }
+                }
+                break;
+
+            case PHASE_PAUSE:
+                if (phaseTicks >= settleTicks) {
+                    if (half == 1) {
+                        state = CALIBRATION_DONE;
+                        return;
+                    }
+                    half = 1;
+                    startRamp(counts);
+                }
+                break;
+        }
+
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            commands[wheel] = direction(wheel) == FeedforwardTable::FORWARD ? command : -command;
+        }
+    }
+
+    State getState() const { return state; }
+
+    // Measured response, valid once the state is CALIBRATION_DONE
+    const MotorResponse& getResponse(uint8_t wheel, uint8_t dir) const {
+        return responses[wheel][dir];
+    }
+};
+
+#endif // MOTOR_CALIBRATION_H
@@ -4,29 +4,686 @@
 
 #include "Config.h"
 #include "Debug.h"
+#include "AnimationFormat.h"
+#include "Feedforward.h"
 #include "HardwareConfig.h"
+#include "MotionProfile.h"
+#include "MotionQueue.h"
+#include "MotorCalibration.h"
+#include "Odometry.h"
+#include "PIDController.h"
+#include "RelayAutotune.h"
+#include "SafetyMonitor.h"
+#include "StallGuard.h"
+#include "StorageManager.h"
+#include <atomic>
 
 // Manages robot motors, encoders and PID control
 // Handles:
 // - Direct motor control for animations
 // - PID-controlled precise movements
 // - Robot rotation (triggered by Playdate "t/turns/direction")
+// - Relay autotune of the wheel PIDs (triggered by Playdate "u/wheel")
+// - Motor calibration and speed feedforward (triggered by Playdate "y")
+// - Queued motion primitives: drives, arcs, turns, waits, head moves ("g/...")
 // - Motor safety and power management
+// The wheel control loop (encoders, PID, motor outputs) runs in an
+// IntervalTimer interrupt every CONTROL_PERIOD_US, independent of SD reads,
+// I2C transactions or log output in the main loop. The main loop hands
+// setpoints over through a double buffer: it fills the spare slot and then
+// publishes its index with a single byte store, so the interrupt always
+// reads a complete command without either side ever blocking.
+// Rotations are run by the interrupt as well: both wheels follow a
+// trapezoidal position profile in opposite directions through their PIDs,
+// so the heading is held closed loop on both encoders while the main loop
+// keeps running. The main loop only requests, cancels and reports them.
+// Queued motion primitives are run the same way, back to back: each move
+// starts from the wheel targets where the previous one ended, so the next
+// segment begins on the following period without a USB round trip.
+// The interrupt also integrates the odometry pose from the same encoder
+// reads and publishes it through a second double buffer.
+// Each wheel has its own PID gains: tuned on the robot by the autotune,
+// saved to the SD card and loaded at startup, the PIDConfig.h values are
+// only the defaults.
+// Once the motors are calibrated, the command for the target wheel speed
+// is looked up in the feedforward table and added to the PID output, so
+// the PIDs only correct the remaining error instead of producing the
+// whole command from it.
+// An edge or collision stop from the SafetyMonitor counts as motion
+// disabled: rotations, queued motions, autotune and calibration end, and
+// the motors stay off until the main loop has stopped the animation.
+// Each wheel driven by the control loop goes through a StallGuard: a wheel
+// pushed hard without turning has its command limited, then cut, and the
+// main loop reports every stall with "msg j/...".
 class MotorController {
+public:
+    // Why a rotation ended
+    enum RotationResult : uint8_t {
+        ROTATION_COMPLETED,         // Heading reached within ROTATION_TOLERANCE_TICKS
+        ROTATION_CANCELLED,         // Stopped by the Playdate ("x")
+        ROTATION_TIMED_OUT,         // Not settled ROTATION_SETTLE_MS after the profile ended
+        ROTATION_MOTION_DISABLED    // Motion disabled, e.g. charger plugged in or safety stop
+    };
+
 private:
+    // Setpoints handed from the main loop to the control interrupt
+    struct WheelCommand {
+        float right;                // Right wheel target (encoder ticks)
+        float left;                 // Left wheel target (encoder ticks)
+        bool engaged;               // Animation playing, the control loop drives the motors
+        bool motionEnabled;         // Motion allowed (false while charging)
+    };
+
+    // Rotation in place, owned by the control interrupt
+    struct Rotation {
+        TrapezoidProfile profile;   // Travel of each wheel (ticks, seconds)
+        float sign;                 // 1 turns counterclockwise (right wheel forward), -1 clockwise
+        float startRight;           // Encoder positions when the rotation started
+        float startLeft;
+        uint32_t elapsedTicks;      // Control periods since the start
+        bool active;
+    };
+
+    // Motion queue execution, owned by the control interrupt
+    struct Trajectory {
+        TrapezoidProfile profile;   // Progress of the current move along the faster wheel (ticks, seconds)
+        float startRight;           // Wheel targets when the current primitive started
+        float startLeft;
+        uint32_t elapsedTicks;      // Control periods since the primitive started, or since settling began
+        bool running;               // The front primitive is being run
+        bool active;                // Driving the motors: running, or settling after the last primitive
+    };
+
+    // Autotune run over one or both wheels, owned by the control interrupt
+    struct Tuning {
+        RelayAutotune relay;        // Oscillation of the wheel being tuned
+        uint8_t wheel;              // Wheel being tuned
+        uint8_t lastWheel;          // Last wheel of the run
+        bool active;
+    };
+
+    // Control loop timing statistics, in CPU cycles
+    struct ControlStats {
+        uint32_t ticks;             // Control periods run
+        uint32_t overruns;          // Periods that took more than twice CONTROL_PERIOD_US
+        uint32_t maxJitter;         // Worst deviation from the nominal period
+        uint64_t totalJitter;
+        uint32_t maxExec;           // Worst time spent in the interrupt
+        uint64_t totalExec;
+    };
+
     // Hardware references
     DRV8835MotorShield& motors;     // Motor driver
     Encoder& encoderRight;          // Right motor encoder
     Encoder& encoderLeft;           // Left motor encoder
-    PID& pidRight;                  // Right motor PID controller
-    PID& pidLeft;                   // Left motor PID controller
-    double& inputRight;             // Right encoder input
-    double& inputLeft;              // Left encoder input
-    double& setpointRight;          // Right motor target
-    double& setpointLeft;           // Left motor target
-    double& outputRight;            // Right motor output
-    double& outputLeft;             // Left motor output
-    long prevT;                     // Previous update time
+    StorageManager& storage;        // Saved wheel gains
+    SafetyMonitor& safety;          // Edge and collision stops
+
+    // Wheel PIDs, channel 0 is the right wheel and channel 1 the left wheel
+    static const uint8_t WHEEL_RIGHT = 0;
+    static const uint8_t WHEEL_LEFT = 1;
+    PIDController<WheelPIDConfig, 2> pid;
+    int32_t counts[2];              // Encoder counts read this period
+    int32_t lastCounts[2];          // Counts of the last period with consistent encoders
+    float inputs[2];                // Encoder positions (ticks)
+    float setpoints[2];             // Wheel targets (ticks)
+    float outputs[2];               // Motor commands
+    WheelGains gains[2];            // Gains in use, main loop copy
+
+    // Feedforward from the target speed, differentiated from the setpoints
+    static constexpr float feedforwardTimeConstant = 1.0f / (2.0f * 3.14159265f * FEEDFORWARD_VELOCITY_CUTOFF_HZ);
+    static constexpr float feedforwardSmoothing =
+        (CONTROL_PERIOD_US / 1000000.0f) / (CONTROL_PERIOD_US / 1000000.0f + feedforwardTimeConstant);
+    FeedforwardTable feedforward;   // Written by the interrupt once the timer runs
+    float lastSetpoints[2];         // Setpoints of the previous period
+    float targetVelocities[2];      // Filtered setpoint change (ticks/s)
+    bool feedforwardPrimed;         // lastSetpoints belong to the same motion
+
+    // Control loop
+    IntervalTimer controlTimer;
+    WheelCommand commands[2];       // Published command and the slot being filled
+    volatile uint8_t publishedCommand; // Slot read by the interrupt
+    bool publishedEngaged;          // Engaged state of the last published command
+    uint32_t lastTickCycles;        // Cycle count at the previous interrupt
+    ControlStats stats;             // Written by the interrupt only
+    bool lastEngaged;               // Engaged state seen by the previous interrupt
+    uint32_t seenSafetyTrips;       // Safety stops already acted on
+    bool safetyHold;                // Motors held off after a safety stop
+
+    // Stall handoff: the interrupt counts the stalls of each wheel and bumps
+    // a sequence whenever its guard limits or cuts the drive
+    StallGuard stallGuards[2];      // Interrupt side
+    volatile uint32_t stallCounts[2]; // Stalls detected since boot
+    volatile uint8_t stallStates[2];  // StallGuard::State when the sequence was bumped
+    volatile uint8_t stallSeq[2];
+    uint8_t stallReportedSeq[2];    // Main loop side
+
+    // Rotation handoff: the main loop bumps a request or cancel sequence,
+    // the interrupt bumps the finish sequence once the rotation has ended
+    float requestedRotationTicks;   // Wheel travel of the requested rotation
+    float requestedRotationSign;
+    volatile uint8_t rotationRequestSeq;
+    volatile uint8_t rotationCancelSeq;
+    volatile uint8_t rotationFinishSeq;
+    volatile uint8_t rotationResult;       // RotationResult of the last finished rotation
+    volatile int32_t rotationHeadingError; // Final heading error (ticks)
+    uint8_t rotationSeenSeq;        // Interrupt side
+    uint8_t cancelSeenSeq;          // Interrupt side
+    uint8_t rotationReportedSeq;    // Main loop side
+    Rotation rotation;
+
+    // Wheel travel of rotations run during an animation, added to its
+    // targets so playback carries on from the new heading
+    float wheelOffsetRight;
+    float wheelOffsetLeft;
+
+    // Motion queue: the main loop pushes and reports primitives, the
+    // interrupt runs them. Clearing is requested through a sequence.
+    MotionQueue motionQueue;
+    volatile uint8_t motionClearSeq;
+    uint8_t motionClearSeenSeq;     // Interrupt side
+    Trajectory trajectory;
+    int16_t headTarget;             // Head pulse of the last finished head primitive (µs)
+    bool headTargetPending;         // headTarget not taken yet
+
+    // Autotune handoff, same scheme as rotations. The interrupt sets the
+    // new gains of each tuned wheel itself, the main loop saves them.
+    uint8_t requestedTuneFirst;     // Wheels of the requested run
+    uint8_t requestedTuneLast;
+    volatile uint8_t tuneRequestSeq;
+    volatile uint8_t tuneCancelSeq;
+    volatile uint8_t tuneFinishSeq;
+    uint8_t tuneSeenSeq;            // Interrupt side
+    uint8_t tuneCancelSeenSeq;      // Interrupt side
+    uint8_t tuneReportedSeq;        // Main loop side
+    WheelGains tunedGains[2];       // Results of the last run
+    bool wheelTuned[2];
+    Tuning tuning;
+
+    // Calibration handoff, same scheme. The interrupt installs the new
+    // feedforward table, the main loop saves it.
+    volatile uint8_t calibrationRequestSeq;
+    volatile uint8_t calibrationCancelSeq;
+    volatile uint8_t calibrationFinishSeq;
+    volatile bool calibrationSucceeded;
+    uint8_t calibrationSeenSeq;     // Interrupt side
+    uint8_t calibrationCancelSeenSeq; // Interrupt side
+    uint8_t calibrationReportedSeq; // Main loop side
+    MotorCalibration calibration;
+    bool calibrating;               // Interrupt side
+
+    // Odometry, integrated by the interrupt and published like commands
+    Odometry odometry;
+    Pose poses[2];                  // Published pose and the slot being filled
+    volatile uint8_t publishedPose; // Slot read by the main loop
+    volatile uint8_t poseResetSeq;  // Bumped by the main loop to move the pose to the origin
+    uint8_t poseResetSeenSeq;       // Interrupt side
+    uint32_t seenEncoderResets;     // encoderResetCount already accounted for
+    uint16_t poseStreamPeriod;      // Pose message period (ms), 0 when not streaming
+    uint32_t lastPoseSent;          // millis() of the last streamed pose
+
+    inline static MotorController* controlInstance = nullptr;
+
+    static void controlInterrupt() {
+        controlInstance->controlStep();
+    }
+
+    // Read current encoder positions
+    void updateEncoders() {
+        counts[WHEEL_RIGHT] = encoderRight.read();
+        counts[WHEEL_LEFT] = encoderLeft.read();
+        inputs[WHEEL_RIGHT] = counts[WHEEL_RIGHT];
+        inputs[WHEEL_LEFT] = counts[WHEEL_LEFT];
+    }
+
+    // Follow encoders zeroed by the main loop: shift the references taken
+    // on the old counts so the jump is not seen as travel
+    void rebaseEncoders() {
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            pid.reset(wheel, inputs[wheel]);
+        }
+        feedforwardPrimed = false;
+        float shiftRight = counts[WHEEL_RIGHT] - lastCounts[WHEEL_RIGHT];
+        float shiftLeft = counts[WHEEL_LEFT] - lastCounts[WHEEL_LEFT];
+        rotation.startRight += shiftRight;
+        rotation.startLeft += shiftLeft;
+        // A queued move keeps running until the animation is published
+        trajectory.startRight += shiftRight;
+        trajectory.startLeft += shiftLeft;
+        setpoints[WHEEL_RIGHT] += shiftRight;
+        setpoints[WHEEL_LEFT] += shiftLeft;
+        odometry.rebase(counts[WHEEL_RIGHT], counts[WHEEL_LEFT]);
+        stallGuards[WHEEL_RIGHT].restartWindow();
+        stallGuards[WHEEL_LEFT].restartWindow();
+    }
+
+    // Integrate and publish the pose
+    void updateOdometry() {
+        if (poseResetSeq != poseResetSeenSeq) {
+            poseResetSeenSeq = poseResetSeq;
+            odometry.reset();
+        }
+        odometry.update(counts[WHEEL_RIGHT], counts[WHEEL_LEFT]);
+
+        uint8_t slot = publishedPose ^ 1;
+        poses[slot] = odometry.getPose();
+        std::atomic_signal_fence(std::memory_order_release);
+        publishedPose = slot;
+    }
+
+    // Calculate new PID outputs for both wheels, plus the feedforward
+    // command for the target speed while the control loop drives the motors
+    void computePID(bool driving) {
+        pid.update(setpoints, inputs, outputs);
+
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            float velocity = (setpoints[wheel] - lastSetpoints[wheel]) * (1000000.0f / CONTROL_PERIOD_US);
+            lastSetpoints[wheel] = setpoints[wheel];
+            if (!feedforwardPrimed) {
+                // Setpoints jump when a motion starts, that is not a speed
+                targetVelocities[wheel] = 0;
+                continue;
+            }
+            targetVelocities[wheel] += feedforwardSmoothing * (velocity - targetVelocities[wheel]);
+            if (driving && feedforward.isCalibrated(wheel)) {
+                float output = outputs[wheel] + feedforward.lookup(wheel, targetVelocities[wheel]);
+                outputs[wheel] = constrain(output, -WheelPIDConfig::outputLimit, WheelPIDConfig::outputLimit);
+            }
+        }
+        feedforwardPrimed = driving;
+    }
+
+    // Pass the outputs through the stall guards, 0 for wheels not driven,
+    // and hand new limits or cuts to the main loop
+    void guardStalls(bool powered) {
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            StallGuard::State previous = stallGuards[wheel].getState();
+            outputs[wheel] = stallGuards[wheel].update(powered ? outputs[wheel] : 0, counts[wheel]);
+            StallGuard::State state = stallGuards[wheel].getState();
+            if (state == previous || state == StallGuard::STALL_NONE) continue;
+
+            if (state == StallGuard::STALL_LIMITED) stallCounts[wheel] = stallCounts[wheel] + 1;
+            stallStates[wheel] = state;
+            std::atomic_signal_fence(std::memory_order_release);
+            stallSeq[wheel] = stallSeq[wheel] + 1;
+        }
+    }
+
+    // Apply motor speeds based on PID output
+    // Handles motion enable/disable, stalled wheels and motor compensation
+    void controlMotors(const WheelCommand& command) {
+        bool driving = command.engaged || rotation.active || trajectory.active;
+        // An animation frame with right 0 means motors off, tested before the
+        // rotation offsets are added; rotations and trajectories drive through 0
+        bool animationOff = command.engaged && !rotation.active && command.right == 0;
+        bool stopped = animationOff || !command.motionEnabled;
+        guardStalls(driving && !stopped);
+        if (!driving) return;
+
+        if (stopped) {
+            motors.setM1Speed(0);
+            motors.setM2Speed(0);
+        } else {
+            motors.setM1Speed(outputs[WHEEL_LEFT]);   // Left motor (M1)
+            // Apply power compensation to right motor 
+            motors.setM2Speed(outputs[WHEEL_RIGHT] * MOTOR2_POWER_COMPENSATION);
+        }
+    }
+
+    // End the running rotation and hand the result to the main loop
+    void finishRotation(RotationResult result, const WheelCommand& command) {
+        float travelRight = inputs[WHEEL_RIGHT] - rotation.startRight;
+        float travelLeft = inputs[WHEEL_LEFT] - rotation.startLeft;
+        float heading = rotation.sign * (travelRight - travelLeft) / 2;
+        rotationHeadingError = lroundf(heading - rotation.profile.getDistance());
+        wheelOffsetRight += travelRight;
+        wheelOffsetLeft += travelLeft;
+        rotation.active = false;
+
+        if (!command.engaged) {
+            motors.setM1Speed(0);
+            motors.setM2Speed(0);
+        }
+        rotationResult = result;
+        std::atomic_signal_fence(std::memory_order_release);
+        rotationFinishSeq = rotationSeenSeq;
+    }
+
+    // Relay the wheel being tuned for one period
+    void driveTunedWheel(float output) {
+        if (tuning.wheel == WHEEL_RIGHT) {
+            motors.setM1Speed(0);
+            motors.setM2Speed(output * MOTOR2_POWER_COMPENSATION);
+        } else {
+            motors.setM1Speed(output);
+            motors.setM2Speed(0);
+        }
+    }
+
+    // End the autotune run, the PIDs restart from where the wheels stopped
+    void finishTuning() {
+        motors.setM1Speed(0);
+        motors.setM2Speed(0);
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            pid.reset(wheel, inputs[wheel]);
+        }
+        tuning.active = false;
+        std::atomic_signal_fence(std::memory_order_release);
+        tuneFinishSeq = tuneSeenSeq;
+    }
+
+    // Start, advance or end an autotune run - runs in the timer interrupt
+    // Returns true while the relay drives the motors instead of the PIDs
+    bool tuningStep(const WheelCommand& command) {
+        if (tuneRequestSeq != tuneSeenSeq) {
+            tuneSeenSeq = tuneRequestSeq;
+            tuneCancelSeenSeq = tuneCancelSeq;
+            tuning.wheel = requestedTuneFirst;
+            tuning.lastWheel = requestedTuneLast;
+            wheelTuned[WHEEL_RIGHT] = wheelTuned[WHEEL_LEFT] = false;
+            trajectory.active = false;
+            tuning.relay.begin(inputs[tuning.wheel]);
+            tuning.active = true;
+        }
+        if (!tuning.active) {
+            tuneCancelSeenSeq = tuneCancelSeq;
+            return false;
+        }
+
+        // Animations and charging take over, unfinished wheels are reported as failed
+        if (tuneCancelSeq != tuneCancelSeenSeq || command.engaged || !command.motionEnabled) {
+            finishTuning();
+            return false;
+        }
+
+        driveTunedWheel(tuning.relay.step(inputs[tuning.wheel]));
+        if (tuning.relay.getState() == RelayAutotune::AUTOTUNE_RUNNING) return true;
+
+        WheelGains result;
+        if (tuning.relay.computeGains(result)) {
+            tunedGains[tuning.wheel] = result;
+            wheelTuned[tuning.wheel] = true;
+            pid.setGains(tuning.wheel, result.kP, result.kI, result.kD);
+        }
+        if (tuning.wheel < tuning.lastWheel) {
+            tuning.wheel++;
+            tuning.relay.begin(inputs[tuning.wheel]);
+            return true;
+        }
+        finishTuning();
+        return false;
+    }
+
+    // Drive both motors open loop with the calibration commands
+    void driveCalibration(const float* commands) {
+        motors.setM1Speed(commands[WHEEL_LEFT]);
+        motors.setM2Speed(commands[WHEEL_RIGHT] * MOTOR2_POWER_COMPENSATION);
+    }
+
+    // End the calibration, installing the measured table if every curve is usable
+    void finishCalibration() {
+        motors.setM1Speed(0);
+        motors.setM2Speed(0);
+
+        bool usable = calibration.getState() == MotorCalibration::CALIBRATION_DONE;
+        for (uint8_t wheel = 0; wheel < 2 && usable; wheel++) {
+            for (uint8_t direction = 0; direction < 2; direction++) {
+                usable = usable && FeedforwardTable::isUsable(calibration.getResponse(wheel, direction));
+            }
+        }
+        if (usable) {
+            for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                for (uint8_t direction = 0; direction < 2; direction++) {
+                    feedforward.setResponse(wheel, direction, calibration.getResponse(wheel, direction));
+                }
+                pid.reset(wheel, inputs[wheel]);
+            }
+        }
+        calibrationSucceeded = usable;
+        calibrating = false;
+        std::atomic_signal_fence(std::memory_order_release);
+        calibrationFinishSeq = calibrationSeenSeq;
+    }
+
+    // Start, advance or end a calibration - runs in the timer interrupt
+    // Returns true while the sweep drives the motors instead of the PIDs
+    bool calibrationStep(const WheelCommand& command) {
+        if (calibrationRequestSeq != calibrationSeenSeq) {
+            calibrationSeenSeq = calibrationRequestSeq;
+            calibrationCancelSeenSeq = calibrationCancelSeq;
+            calibration.begin(counts);
+            trajectory.active = false;
+            calibrating = true;
+        }
+        if (!calibrating) {
+            calibrationCancelSeenSeq = calibrationCancelSeq;
+            return false;
+        }
+
+        if (calibrationCancelSeq != calibrationCancelSeenSeq || command.engaged || !command.motionEnabled) {
+            finishCalibration();
+            return false;
+        }
+
+        float commands[2];
+        calibration.step(counts, commands);
+        if (calibration.getState() != MotorCalibration::CALIBRATION_RUNNING) {
+            finishCalibration();
+            return false;
+        }
+        driveCalibration(commands);
+        return true;
+    }
+
+    // Cancel the running and queued primitives
+    void clearTrajectory(const WheelCommand& command) {
+        while (motionQueue.front() != nullptr) {
+            motionQueue.finish(MotionPrimitive::CANCELLED);
+        }
+        if (trajectory.active && !command.engaged && !rotation.active) {
+            motors.setM1Speed(0);
+            motors.setM2Speed(0);
+        }
+        trajectory.running = false;
+        trajectory.active = false;
+    }
+
+    // Start the primitive at the front of the queue
+    void beginPrimitive(const MotionPrimitive& primitive) {
+        if (!trajectory.active) {
+            // The PIDs were idle, start from where the wheels are
+            for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                setpoints[wheel] = inputs[wheel];
+                pid.reset(wheel, inputs[wheel]);
+            }
+            trajectory.active = true;
+        }
+        trajectory.startRight = setpoints[WHEEL_RIGHT];
+        trajectory.startLeft = setpoints[WHEEL_LEFT];
+        trajectory.elapsedTicks = 0;
+        trajectory.running = true;
+        if (primitive.type == MotionPrimitive::MOVE) {
+            float travel = fmaxf(fabsf(primitive.travelRight), fabsf(primitive.travelLeft));
+            trajectory.profile.plan(travel, primitive.speed, MOTION_ACCELERATION / MM_PER_TICK);
+        }
+    }
+
+    // Hold the end of the last primitive until both wheels have reached it
+    void settleTrajectory(const WheelCommand& command) {
+        trajectory.elapsedTicks++;
+        bool settled = fabsf(setpoints[WHEEL_RIGHT] - inputs[WHEEL_RIGHT]) <= MOTION_TOLERANCE_TICKS &&
+                       fabsf(setpoints[WHEEL_LEFT] - inputs[WHEEL_LEFT]) <= MOTION_TOLERANCE_TICKS;
+        if (settled || trajectory.elapsedTicks * CONTROL_PERIOD_US >= MOTION_SETTLE_MS * 1000UL) {
+            clearTrajectory(command);
+        }
+    }
+
+    // Start, advance or end queued primitives - runs in the timer interrupt
+    void motionStep(const WheelCommand& command) {
+        if (motionClearSeq != motionClearSeenSeq) {
+            motionClearSeenSeq = motionClearSeq;
+            clearTrajectory(command);
+            return;
+        }
+        const MotionPrimitive* primitive = motionQueue.front();
+        if (primitive == nullptr && !trajectory.active) return;
+
+        // Animations, rotations and charging take over, the queue is dropped
+        if (command.engaged || rotation.active || !command.motionEnabled) {
+            clearTrajectory(command);
+            return;
+        }
+
+        if (!trajectory.running) {
+            if (primitive == nullptr) {
+                settleTrajectory(command);
+                return;
+            }
+            beginPrimitive(*primitive);
+        }
+
+        trajectory.elapsedTicks++;
+        bool finished = true;
+        if (primitive->type == MotionPrimitive::MOVE) {
+            float t = trajectory.elapsedTicks * (CONTROL_PERIOD_US / 1000000.0f);
+            float distance = trajectory.profile.getDistance();
+            float progress = distance > 0 ? trajectory.profile.positionAt(t) / distance : 1;
+            setpoints[WHEEL_RIGHT] = trajectory.startRight + primitive->travelRight * progress;
+            setpoints[WHEEL_LEFT] = trajectory.startLeft + primitive->travelLeft * progress;
+            finished = t >= trajectory.profile.getDuration();
+        } else if (primitive->type == MotionPrimitive::WAIT) {
+            finished = trajectory.elapsedTicks >= primitive->value;
+        }
+
+        // The next primitive starts on the following period from these targets
+        if (finished) {
+            motionQueue.finish(MotionPrimitive::COMPLETED);
+            trajectory.running = false;
+            trajectory.elapsedTicks = 0;
+        }
+    }
+
+    // Start, advance or end a rotation - runs in the timer interrupt
+    void rotationStep(const WheelCommand& command) {
+        if (rotationRequestSeq != rotationSeenSeq) {
+            rotationSeenSeq = rotationRequestSeq;
+            cancelSeenSeq = rotationCancelSeq;
+            rotation.profile.plan(requestedRotationTicks, ROTATION_MAX_SPEED, ROTATION_ACCELERATION);
+            rotation.sign = requestedRotationSign;
+            rotation.startRight = inputs[WHEEL_RIGHT];
+            rotation.startLeft = inputs[WHEEL_LEFT];
+            rotation.elapsedTicks = 0;
+            rotation.active = true;
+        }
+        if (!rotation.active) {
+            cancelSeenSeq = rotationCancelSeq;
+            return;
+        }
+
+        if (rotationCancelSeq != cancelSeenSeq) {
+            finishRotation(ROTATION_CANCELLED, command);
+            return;
+        }
+        if (!command.motionEnabled) {
+            finishRotation(ROTATION_MOTION_DISABLED, command);
+            return;
+        }
+
+        rotation.elapsedTicks++;
+        float t = rotation.elapsedTicks * (CONTROL_PERIOD_US / 1000000.0f);
+        float travel = rotation.sign * rotation.profile.positionAt(t);
+        setpoints[WHEEL_RIGHT] = rotation.startRight + travel;
+        setpoints[WHEEL_LEFT] = rotation.startLeft - travel;
+
+        // Once the profile has ended, wait for both wheels to settle on the heading
+        float overtime = t - rotation.profile.getDuration();
+        if (overtime >= 0) {
+            float heading = rotation.sign * ((inputs[WHEEL_RIGHT] - rotation.startRight) - (inputs[WHEEL_LEFT] - rotation.startLeft)) / 2;
+            if (fabsf(heading - rotation.profile.getDistance()) <= ROTATION_TOLERANCE_TICKS) {
+                finishRotation(ROTATION_COMPLETED, command);
+            } else if (overtime * 1000 >= ROTATION_SETTLE_MS) {
+                finishRotation(ROTATION_TIMED_OUT, command);
+            }
+        }
+    }
+
+    // One control period - runs in the timer interrupt
+    void controlStep() {
+        uint32_t startCycles = ARM_DWT_CYCCNT;
+        const WheelCommand& command = commands[publishedCommand];
+
+        updateEncoders();
+
+        // Skip the period while the main loop is zeroing the encoders,
+        // the two counts may come from either side of the reset
+        uint32_t resets = encoderResetCount;
+        if (resets & 1) {
+            recordTiming(startCycles);
+            return;
+        }
+        if (resets != seenEncoderResets) {
+            seenEncoderResets = resets;
+            rebaseEncoders();
+        }
+        lastCounts[WHEEL_RIGHT] = counts[WHEEL_RIGHT];
+        lastCounts[WHEEL_LEFT] = counts[WHEEL_LEFT];
+        updateOdometry();
+
+        // A new animation starts from reset encoders, earlier rotations no longer apply
+        if (command.engaged && !lastEngaged) {
+            wheelOffsetRight = wheelOffsetLeft = 0;
+        }
+        lastEngaged = command.engaged;
+
+        // After a safety stop motion stays disabled until no animation is published
+        uint32_t trips = safety.getTripCount();
+        if (trips != seenSafetyTrips) {
+            seenSafetyTrips = trips;
+            safetyHold = true;
+        } else if (safetyHold && !command.engaged) {
+            safetyHold = false;
+        }
+        WheelCommand allowed = command;
+        allowed.motionEnabled = command.motionEnabled && !safetyHold;
+
+        if (tuningStep(allowed) || calibrationStep(allowed)) {
+            feedforwardPrimed = false;
+            recordTiming(startCycles);
+            return;
+        }
+
+        motionStep(allowed);
+        rotationStep(allowed);
+        if (!rotation.active && command.engaged) {
+            setpoints[WHEEL_RIGHT] = command.right + wheelOffsetRight;
+            setpoints[WHEEL_LEFT] = command.left + wheelOffsetLeft;
+        }
+        computePID(command.engaged || rotation.active || trajectory.active);
+        controlMotors(allowed);
+        recordTiming(startCycles);
+    }
+
+    // Timing statistics of one period, the first period has no reference
+    void recordTiming(uint32_t startCycles) {
+        uint32_t nominal = (uint32_t)((uint64_t)F_CPU_ACTUAL * CONTROL_PERIOD_US / 1000000);
+        if (stats.ticks > 0) {
+            uint32_t period = startCycles - lastTickCycles;
+            uint32_t jitter = period > nominal ? period - nominal : nominal - period;
+            if (period > 2 * nominal) stats.overruns++;
+            if (jitter > stats.maxJitter) stats.maxJitter = jitter;
+            stats.totalJitter += jitter;
+        }
+        lastTickCycles = startCycles;
+        stats.ticks++;
+
+        uint32_t exec = ARM_DWT_CYCCNT - startCycles;
+        if (exec > stats.maxExec) stats.maxExec = exec;
+        stats.totalExec += exec;
+    }
+
+    static uint32_t cyclesToNanos(uint64_t cycles) {
+        return (uint32_t)(cycles * 1000 / (F_CPU_ACTUAL / 1000000));
+    }
 
 public:
     // Initialize controller with all required components
@@ -34,30 +691,88 @@ public:
         DRV8835MotorShield& motorsRef,
         Encoder& encRight,
         Encoder& encLeft,
-        PID& pidRight,
-        PID& pidLeft,
-        double& setpRight,
-        double& setpLeft,
-        double& inRight,
-        double& inLeft,
-        double& outRight,
-        double& outLeft
+        StorageManager& storageRef,
+        SafetyMonitor& safetyRef
     ) : motors(motorsRef),
         encoderRight(encRight),
         encoderLeft(encLeft),
-        pidRight(pidRight),
-        pidLeft(pidLeft),
-        inputRight(inRight),
-        inputLeft(inLeft),
-        setpointRight(setpRight),
-        setpointLeft(setpLeft),
-        outputRight(outRight),
-        outputLeft(outLeft),
-        prevT(0)
+        storage(storageRef),
+        safety(safetyRef),
+        feedforwardPrimed(false),
+        publishedCommand(0),
+        publishedEngaged(false),
+        lastTickCycles(0),
+        lastEngaged(false),
+        seenSafetyTrips(0),
+        safetyHold(false),
+        requestedRotationTicks(0),
+        requestedRotationSign(1),
+        rotationRequestSeq(0),
+        rotationCancelSeq(0),
+        rotationFinishSeq(0),
+        rotationResult(ROTATION_COMPLETED),
+        rotationHeadingError(0),
+        rotationSeenSeq(0),
+        cancelSeenSeq(0),
+        rotationReportedSeq(0),
+        wheelOffsetRight(0),
+        wheelOffsetLeft(0),
+        motionClearSeq(0),
+        motionClearSeenSeq(0),
+        headTarget(0),
+        headTargetPending(false),
+        requestedTuneFirst(WHEEL_RIGHT),
+        requestedTuneLast(WHEEL_LEFT),
+        tuneRequestSeq(0),
+        tuneCancelSeq(0),
+        tuneFinishSeq(0),
+        tuneSeenSeq(0),
+        tuneCancelSeenSeq(0),
+        tuneReportedSeq(0),
+        calibrationRequestSeq(0),
+        calibrationCancelSeq(0),
+        calibrationFinishSeq(0),
+        calibrationSucceeded(false),
+        calibrationSeenSeq(0),
+        calibrationCancelSeenSeq(0),
+        calibrationReportedSeq(0),
+        calibrating(false),
+        publishedPose(0),
+        poseResetSeq(0),
+        poseResetSeenSeq(0),
+        seenEncoderResets(0),
+        poseStreamPeriod(0),
+        lastPoseSent(0)
     {
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            counts[wheel] = lastCounts[wheel] = 0;
+            inputs[wheel] = setpoints[wheel] = outputs[wheel] = 0;
+            lastSetpoints[wheel] = targetVelocities[wheel] = 0;
+            gains[wheel].kP = WheelPIDConfig::kP;
+            gains[wheel].kI = WheelPIDConfig::kI;
+            gains[wheel].kD = WheelPIDConfig::kD;
+            wheelTuned[wheel] = false;
+            stallCounts[wheel] = 0;
+            stallStates[wheel] = StallGuard::STALL_NONE;
+            stallSeq[wheel] = stallReportedSeq[wheel] = 0;
+        }
+        poses[0] = poses[1] = odometry.getPose();
+        memset(commands, 0, sizeof(commands));
+        commands[0].motionEnabled = commands[1].motionEnabled = true;
+        memset(&stats, 0, sizeof(stats));
+        rotation.sign = 1;
+        rotation.startRight = rotation.startLeft = 0;
+        rotation.elapsedTicks = 0;
+        rotation.active = false;
+        trajectory.startRight = trajectory.startLeft = 0;
+        trajectory.elapsedTicks = 0;
+        trajectory.running = false;
+        trajectory.active = false;
+        tuning.wheel = tuning.lastWheel = WHEEL_RIGHT;
+        tuning.active = false;
     }
 
-    // Initialize motor hardware and PID controllers
+    // Initialize motor hardware and PID controllers, then start the control loop
     void initialize() {
         DEBUG_PRINT(DEBUG_INFO, "Initializing motors and PID controllers");
         
@@ -70,118 +785,433 @@ public:
         // Set motor directions (LEFT motor is flipped)
         motors.flipM1(true); // LEFT
         motors.flipM2(false);
+
+        // Gains tuned on this robot replace the defaults
+        if (storage.loadWheelGains(gains)) {
+            for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                pid.setGains(wheel, gains[wheel].kP, gains[wheel].kI, gains[wheel].kD);
+            }
+            DEBUG_PRINT(DEBUG_INFO, "PID gains loaded - Right: %.4f/%.4f/%.4f Left: %.4f/%.4f/%.4f",
+                        gains[WHEEL_RIGHT].kP, gains[WHEEL_RIGHT].kI, gains[WHEEL_RIGHT].kD,
+                        gains[WHEEL_LEFT].kP, gains[WHEEL_LEFT].kI, gains[WHEEL_LEFT].kD);
+        }
+
+        // Feedforward from the last calibration, none until the motors are calibrated
+        MotorResponse responses[2][2];
+        if (storage.loadMotorResponses(responses)) {
+            for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                for (uint8_t direction = 0; direction < 2; direction++) {
+                    feedforward.setResponse(wheel, direction, responses[wheel][direction]);
+                }
+            }
+            DEBUG_PRINT(DEBUG_INFO, "Feedforward loaded - Dead bands R: %.0f/%.0f L: %.0f/%.0f",
+                        responses[WHEEL_RIGHT][FeedforwardTable::FORWARD].deadband,
+                        responses[WHEEL_RIGHT][FeedforwardTable::BACKWARD].deadband,
+                        responses[WHEEL_LEFT][FeedforwardTable::FORWARD].deadband,
+                        responses[WHEEL_LEFT][FeedforwardTable::BACKWARD].deadband);
+        }
+
+        // Start the PIDs and odometry from the current wheel positions
+        updateEncoders();
+        seenEncoderResets = encoderResetCount;
+        seenSafetyTrips = safety.getTripCount();
+        lastCounts[WHEEL_RIGHT] = counts[WHEEL_RIGHT];
+        lastCounts[WHEEL_LEFT] = counts[WHEEL_LEFT];
+        rebaseEncoders();
+
+        // Encoder edges preempt the control loop so no count is lost
+        controlInstance = this;
+        controlTimer.priority(CONTROL_LOOP_PRIORITY);
+        if (!controlTimer.begin(controlInterrupt, CONTROL_PERIOD_US)) {
+            recordSetupError("Motor control timer unavailable");
+            return;
+        }
         
-        // Configure PID controllers for both motors
-        pidRight.SetTunings(PID_KP, PID_KI, PID_KD);
-        pidRight.SetOutputLimits(-1023, 1023);
-        pidRight.SetMode(AUTOMATIC);
-        pidRight.SetSampleTime(1);
-
-        pidLeft.SetTunings(PID_KP, PID_KI, PID_KD);
-        pidLeft.SetOutputLimits(-1023, 1023);
-        pidLeft.SetMode(AUTOMATIC);
-        pidLeft.SetSampleTime(1);
-        
-        DEBUG_PRINT(DEBUG_INFO, "Motors and PID controllers initialized");
+        DEBUG_PRINT(DEBUG_INFO, "Motors and PID controllers initialized, control loop at %lu us",
+                    (unsigned long)CONTROL_PERIOD_US);
     }
 
-    // Update timing variables for PID calculations
-    void updateTimers() {
-        long currT = micros();
-        prevT = currT;
-        DEBUG_PRINT(DEBUG_VERBOSE, "Timers updated");
+    // Hand new wheel targets from animations over to the control loop
+    // Called once per main loop pass; the interrupt drives the motors only
+    // while an animation is playing and stops them when playback ends
+    void publishSetpoints(float rightWheel, float leftWheel, bool isAnimationPlaying, bool motionEnabled) {
+        uint8_t slot = publishedCommand ^ 1;
+        commands[slot].right = rightWheel;
+        commands[slot].left = leftWheel;
+        commands[slot].engaged = isAnimationPlaying;
+        commands[slot].motionEnabled = motionEnabled;
+        std::atomic_signal_fence(std::memory_order_release);
+        publishedCommand = slot;
+
+        // The interrupt no longer touches the motors, leave them stopped
+        if (publishedEngaged && !isAnimationPlaying && !isRotating()) {
+            motors.setM1Speed(0);
+            motors.setM2Speed(0);
+        }
+        publishedEngaged = isAnimationPlaying;
+        DEBUG_PRINT(DEBUG_VERBOSE, "Setpoints published: Right=%.2f, Left=%.2f", rightWheel, leftWheel);
     }
 
-    // Read current encoder positions
-    void updateEncoders() {
-        inputRight = encoderRight.read();
-        inputLeft = encoderLeft.read();
-        DEBUG_PRINT(DEBUG_VERBOSE, "Encoders updated: InputRight=" + String(inputRight) + 
-                                 ", InputLeft=" + String(inputLeft));
+    // Send control loop timing statistics to Playdate and start a new window
+    // Format: "msg m/ticks/overruns/maxJitterNs/avgJitterNs/maxExecNs/avgExecNs"
+    void sendControlStats() {
+        noInterrupts();
+        ControlStats window = stats;
+        memset(&stats, 0, sizeof(stats));
+        interrupts();
+
+        uint32_t periods = window.ticks > 1 ? window.ticks - 1 : 1;
+        uint32_t ticks = window.ticks > 0 ? window.ticks : 1;
+        char message[80];
+        snprintf(message, sizeof(message), "msg m/%lu/%lu/%lu/%lu/%lu/%lu",
+                 (unsigned long)window.ticks, (unsigned long)window.overruns,
+                 (unsigned long)cyclesToNanos(window.maxJitter),
+                 (unsigned long)cyclesToNanos(window.totalJitter / periods),
+                 (unsigned long)cyclesToNanos(window.maxExec),
+                 (unsigned long)cyclesToNanos(window.totalExec / ticks));
+        playdateLink.println(message);
     }
 
-    // Update motor target positions from animation commands
-    void updateSetpoints(const String& rightWheel, const String& leftWheel, bool isAnimationPlaying) {
-        if (isAnimationPlaying) {
-            setpointRight = rightWheel.toFloat();
-            setpointLeft = leftWheel.toFloat();
-        }
-        DEBUG_PRINT(DEBUG_VERBOSE, "Setpoints updated: SetpointRight=" + String(setpointRight) + 
-                    ", SetpointLeft=" + String(setpointLeft));
+    // Latest pose integrated by the control loop
+    Pose getPose() const {
+        return poses[publishedPose];
     }
 
-    // Apply motor speeds based on PID output
-    // Handles motion enable/disable and motor compensation
-    void controlMotors(bool isAnimationPlaying, bool motionEnabled) {
-        if (setpointRight == 0) {  
-            motors.setM1Speed(0);
-            motors.setM2Speed(0);
-            DEBUG_PRINT(DEBUG_VERBOSE, "Motors stopped - zero setpoint");
+    // Move the pose back to the origin on the next control period
+    // Called when Playdate sends "z"
+    void resetPose() {
+        poseResetSeq = poseResetSeq + 1;
+    }
+
+    // Send the current pose to Playdate
+    // Format: "msg q/xMm/yMm/headingMrad/speedMmPerS/turnRateMradPerS", a BINARY_TYPE_POSE frame with the binary protocol
+    void sendPose() {
+        Pose pose = getPose();
+        if (playdateLink.isBinary()) {
+            uint8_t payload[BINARY_POSE_LENGTH];
+            BinaryWriter writer(payload, sizeof(payload));
+            writer.putI32(lroundf(pose.x));
+            writer.putI32(lroundf(pose.y));
+            writer.putI16(lroundf(pose.heading * 1000));
+            writer.putI16(lroundf(pose.linearVelocity));
+            writer.putI16(lroundf(pose.angularVelocity * 1000));
+            playdateLink.sendFrame(BINARY_TYPE_POSE, payload, writer.length);
             return;
         }
+        char message[64];
+        snprintf(message, sizeof(message), "msg q/%ld/%ld/%ld/%ld/%ld",
+                 lroundf(pose.x), lroundf(pose.y), lroundf(pose.heading * 1000),
+                 lroundf(pose.linearVelocity), lroundf(pose.angularVelocity * 1000));
+        playdateLink.println(message);
+    }
 
-        if (isAnimationPlaying) {
-            if (!motionEnabled) {
-                motors.setM1Speed(0);
-                motors.setM2Speed(0);
-                DEBUG_PRINT(DEBUG_VERBOSE, "Motors stopped - Motion disabled during animation");
-            } else {
-                motors.setM1Speed(outputLeft);   // Left motor (M1)
-                // Apply power compensation to right motor 
-                motors.setM2Speed(outputRight * MOTOR2_POWER_COMPENSATION);
-                DEBUG_PRINT(DEBUG_VERBOSE, "Motors speed set: M1=" + String(outputLeft) + 
-                           ", M2=" + String(outputRight * MOTOR2_POWER_COMPENSATION));
-            }
+    // Stream the pose every periodMs, 0 stops the stream
+    // Called when Playdate sends "q/period"
+    void setPoseStreamPeriod(uint16_t periodMs) {
+        poseStreamPeriod = periodMs > 0 && periodMs < POSE_MIN_PERIOD_MS ? POSE_MIN_PERIOD_MS : periodMs;
+        lastPoseSent = millis() - poseStreamPeriod;
+    }
+
+    // Start rotating the robot in place in response to Playdate crank turns
+    // Runs in the control loop, update() sends "msg r/1" once it has ended
+    // Returns false if a rotation is already running
+    bool startRotation(int numberOfTurns, int direction) {
+        if (isRotating()) {
+            DEBUG_PRINT(DEBUG_WARNING, "Rotation ignored - previous rotation still running");
+            return false;
         }
+        if (isTuning() || isCalibrating() || isMoving()) {
+            DEBUG_PRINT(DEBUG_WARNING, "Rotation ignored - autotune, calibration or motion queue running");
+            return false;
+        }
+        requestedRotationTicks = TICKS_PER_ROBOT_ROTATION * numberOfTurns;
+        requestedRotationSign = direction > 0 ? 1 : -1;
+        std::atomic_signal_fence(std::memory_order_release);
+        rotationRequestSeq = rotationRequestSeq + 1;
+
+        DEBUG_PRINT(DEBUG_INFO, "Starting rotation - Direction: %d Target: %.0f ticks",
+                    direction, requestedRotationTicks);
+        return true;
     }
 
-    // Calculate new PID outputs
-    void computePID() {
-        pidRight.Compute();
-        pidLeft.Compute();
-        DEBUG_PRINT(DEBUG_VERBOSE, "PID computed: OutputRight=" + String(outputRight) + 
-                    ", OutputLeft=" + String(outputLeft));
+    // Stop a running rotation, it still ends with "msg r/1"
+    // Called when Playdate sends "x"
+    void cancelRotation() {
+        if (isRotating()) rotationCancelSeq = rotationCancelSeq + 1;
     }
 
-    // Rotate robot in response to Playdate crank turns
-    // Sends "msg r/1" when rotation complete
-    void rotateRobot(int numberOfTurns, int direction) {
-        // Reset encoders for accurate rotation
-        encoderRight.write(0);
-        encoderLeft.write(0);
-        
-        // Calculate required encoder ticks for rotation
-        // One 360° turn requires 1854 ticks (2.21 wheel rotations)
-        const int TICKS_FOR_360 = 1854;
-        long targetTicks = TICKS_FOR_360 * numberOfTurns;
-        
-        DEBUG_PRINT(DEBUG_INFO, "Starting rotation - Direction: " + String(direction) + 
-                    " Target: " + String(targetTicks));
-        
-        // Set motor speeds with direction
-        int m2_speed = direction > 0 ? ROTATION_SPEED : -ROTATION_SPEED;
-        int m1_speed = direction > 0 ? 
-            -ROTATION_SPEED * MOTOR2_POWER_COMPENSATION : 
-            ROTATION_SPEED * MOTOR2_POWER_COMPENSATION;
-        
-        motors.setM1Speed(m1_speed);
-        motors.setM2Speed(m2_speed);
-        
-        // Wait for target rotation
-        while(abs(encoderRight.read()) < targetTicks) {
-            delay(1);
+    // True from startRotation() until the control loop has ended the rotation
+    bool isRotating() const {
+        return rotationRequestSeq != rotationFinishSeq;
+    }
+
+    // Autotune the PID of one wheel (WHEEL_RIGHT or WHEEL_LEFT), or of both
+    // one after the other when wheel is out of range
+    // Each tuned wheel oscillates a few ticks around its position for about
+    // a second, so the robot should stand still with nothing playing.
+    // update() reports each wheel with "msg u/..." and saves the new gains.
+    // Returns false if a rotation, an animation or another run is active
+    bool startTuning(int wheel) {
+        if (isTuning() || isCalibrating() || isRotating() || isMoving() || publishedEngaged) {
+            DEBUG_PRINT(DEBUG_WARNING, "Autotune ignored - robot busy");
+            return false;
         }
-        
-        // Notify Playdate rotation is complete
-        userial.println("msg r/1");
-        
-        // Stop and reset
-        motors.setM1Speed(0);
-        motors.setM2Speed(0);
-        encoderRight.write(0);
-        encoderLeft.write(0);
-        DEBUG_PRINT(DEBUG_INFO, "Rotation complete - Final positions E1: " + 
-                    String(encoderRight.read()) + " E2: " + String(encoderLeft.read()));
+        bool single = wheel == WHEEL_RIGHT || wheel == WHEEL_LEFT;
+        requestedTuneFirst = single ? wheel : WHEEL_RIGHT;
+        requestedTuneLast = single ? wheel : WHEEL_LEFT;
+        std::atomic_signal_fence(std::memory_order_release);
+        tuneRequestSeq = tuneRequestSeq + 1;
+
+        DEBUG_PRINT(DEBUG_INFO, "Starting PID autotune - Wheels %u to %u",
+                    requestedTuneFirst, requestedTuneLast);
+        return true;
+    }
+
+    // Stop a running autotune, wheels not finished keep their gains
+    // Called when Playdate sends "x"
+    void cancelTuning() {
+        if (isTuning()) tuneCancelSeq = tuneCancelSeq + 1;
+    }
+
+    // True from startTuning() until the control loop has ended the run
+    bool isTuning() const {
+        return tuneRequestSeq != tuneFinishSeq;
+    }
+
+    // Measure both motors and install a new feedforward table
+    // The robot turns in place at increasing speeds, both ways, for about
+    // ten seconds. update() sends "msg y/..." and saves the table.
+    // Returns false if a rotation, an animation or another run is active
+    bool startCalibration() {
+        if (isCalibrating() || isTuning() || isRotating() || isMoving() || publishedEngaged) {
+            DEBUG_PRINT(DEBUG_WARNING, "Calibration ignored - robot busy");
+            return false;
+        }
+        calibrationRequestSeq = calibrationRequestSeq + 1;
+        DEBUG_PRINT(DEBUG_INFO, "Starting motor calibration");
+        return true;
+    }
+
+    // Stop a running calibration, the previous table stays in use
+    // Called when Playdate sends "x"
+    void cancelCalibration() {
+        if (isCalibrating()) calibrationCancelSeq = calibrationCancelSeq + 1;
+    }
+
+    // True from startCalibration() until the control loop has ended it
+    bool isCalibrating() const {
+        return calibrationRequestSeq != calibrationFinishSeq;
+    }
+
+    // Queue a straight move, negative distances drive backward
+    // speedMmPerS is the peak wheel speed, 0 for MOTION_DEFAULT_SPEED
+    // Returns false if the queue is full or the robot is busy
+    bool queueDrive(uint16_t id, float distanceMm, float speedMmPerS) {
+        return queueMove(id, distanceMm, 0, speedMmPerS);
+    }
+
+    // Queue an arc changing the heading by angleDeg (counterclockwise positive)
+    // around a center radiusMm to the left (right when negative). The robot
+    // drives forward when both have the same sign, backward otherwise.
+    bool queueArc(uint16_t id, float radiusMm, float angleDeg, float speedMmPerS) {
+        float turn = angleDeg * (PI / 180);
+        return queueMove(id, radiusMm * turn, turn, speedMmPerS);
+    }
+
+    // Queue a turn in place by angleDeg, counterclockwise positive
+    bool queueRotate(uint16_t id, float angleDeg, float speedMmPerS) {
+        return queueArc(id, 0, angleDeg, speedMmPerS);
+    }
+
+    // Queue a pause holding the wheels in place
+    bool queueWait(uint16_t id, uint32_t durationMs) {
+        if (durationMs > MOTION_MAX_WAIT_MS) return false;
+        MotionPrimitive primitive = {};
+        primitive.id = id;
+        primitive.type = MotionPrimitive::WAIT;
+        primitive.value = (uint64_t)durationMs * 1000 / CONTROL_PERIOD_US;
+        return queuePrimitive(primitive);
+    }
+
+    // Queue a head move, applied through takeHeadTarget() when reached
+    bool queueHead(uint16_t id, int16_t pulseUs) {
+        if (!animationIsValidHead(pulseUs)) return false;
+        MotionPrimitive primitive = {};
+        primitive.id = id;
+        primitive.type = MotionPrimitive::HEAD;
+        primitive.value = pulseUs;
+        return queuePrimitive(primitive);
+    }
+
+    // Drop the running and queued primitives, each is reported as cancelled
+    // Called when Playdate sends "g/c" or "x"
+    void clearMotion() {
+        motionClearSeq = motionClearSeq + 1;
+    }
+
+    // True while queued primitives remain to be run
+    bool isMoving() const {
+        return !motionQueue.isIdle();
+    }
+
+    // Head position reached in the motion queue, true once per head primitive
+    bool takeHeadTarget(int16_t& pulseUs) {
+        if (!headTargetPending) return false;
+        headTargetPending = false;
+        pulseUs = headTarget;
+        return true;
+    }
+
+    // Stalls detected on a wheel (WHEEL_RIGHT or WHEEL_LEFT) since boot
+    uint32_t getStallCount(uint8_t wheel) const {
+        return stallCounts[wheel];
+    }
+
+    // Report rotations, queued primitives, autotune runs and stalls seen by the control loop and stream the pose - called in main loop
+    // Sends "msg r/1" once per rotation, whatever ended it
+    void update() {
+        if (poseStreamPeriod > 0 && millis() - lastPoseSent >= poseStreamPeriod) {
+            lastPoseSent += poseStreamPeriod;
+            if (millis() - lastPoseSent >= poseStreamPeriod) lastPoseSent = millis();
+            sendPose();
+        }
+
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            if (stallReportedSeq[wheel] == stallSeq[wheel]) continue;
+            stallReportedSeq[wheel] = stallSeq[wheel];
+            std::atomic_signal_fence(std::memory_order_acquire);
+            reportStall(wheel);
+        }
+
+        MotionPrimitive finished;
+        while (motionQueue.popFinished(finished)) {
+            reportPrimitive(finished);
+        }
+
+        if (calibrationReportedSeq != calibrationFinishSeq) {
+            calibrationReportedSeq = calibrationFinishSeq;
+            std::atomic_signal_fence(std::memory_order_acquire);
+            reportCalibration();
+        }
+
+        if (tuneReportedSeq != tuneFinishSeq) {
+            tuneReportedSeq = tuneFinishSeq;
+            std::atomic_signal_fence(std::memory_order_acquire);
+            reportTuning();
+        }
+
+        if (rotationReportedSeq == rotationFinishSeq) return;
+        rotationReportedSeq = rotationFinishSeq;
+        std::atomic_signal_fence(std::memory_order_acquire);
+
+        static const char* const resultNames[] = {"complete", "cancelled", "timed out", "stopped, motion disabled"};
+        playdateLink.println("msg r/1");
+        DEBUG_PRINT(DEBUG_INFO, "Rotation %s - Heading error: %ld ticks",
+                    resultNames[rotationResult], (long)rotationHeadingError);
+    }
+
+private:
+    // Add a wheel travel in mm and radians of heading to the motion queue
+    bool queueMove(uint16_t id, float distanceMm, float turn, float speedMmPerS) {
+        float speed = speedMmPerS > 0 ? fminf(speedMmPerS, MOTION_MAX_SPEED) : MOTION_DEFAULT_SPEED;
+        MotionPrimitive primitive = {};
+        primitive.id = id;
+        primitive.type = MotionPrimitive::MOVE;
+        primitive.travelRight = (distanceMm + turn * WHEEL_BASE / 2) / MM_PER_TICK;
+        primitive.travelLeft = (distanceMm - turn * WHEEL_BASE / 2) / MM_PER_TICK;
+        primitive.speed = speed / MM_PER_TICK;
+        return queuePrimitive(primitive);
+    }
+
+    bool queuePrimitive(const MotionPrimitive& primitive) {
+        if (isRotating() || isTuning() || isCalibrating() || publishedEngaged) {
+            DEBUG_PRINT(DEBUG_WARNING, "Motion %u rejected - robot busy", primitive.id);
+            return false;
+        }
+        if (!motionQueue.push(primitive)) {
+            DEBUG_PRINT(DEBUG_WARNING, "Motion %u rejected - queue full", primitive.id);
+            return false;
+        }
+        return true;
+    }
+
+    // Send a stall to Playdate
+    // Format: "msg j/wheel/count/response", response 1 when the command is
+    // limited, 2 when the drive is cut because the wheel stayed blocked
+    void reportStall(uint8_t wheel) {
+        uint32_t count = stallCounts[wheel];
+        uint8_t response = stallStates[wheel];
+        char message[32];
+        snprintf(message, sizeof(message), "msg j/%u/%lu/%u", wheel, (unsigned long)count, response);
+        playdateLink.println(message);
+        DEBUG_PRINT(DEBUG_WARNING, "Wheel %u stalled (%lu since boot) - drive %s", wheel, (unsigned long)count,
+                    response == StallGuard::STALL_CUT ? "cut" : "limited");
+    }
+
+    // Send the end of a queued primitive to Playdate
+    // Format: "msg g/c/id" when completed, "msg g/x/id" when cancelled
+    void reportPrimitive(const MotionPrimitive& primitive) {
+        bool completed = primitive.status == MotionPrimitive::COMPLETED;
+        if (completed && primitive.type == MotionPrimitive::HEAD) {
+            headTarget = primitive.value;
+            headTargetPending = true;
+        }
+        char message[24];
+        snprintf(message, sizeof(message), "msg g/%c/%u", completed ? 'c' : 'x', primitive.id);
+        playdateLink.println(message);
+    }
+
+    // Send the calibration result and save the new table
+    // Format: "msg y/1/rightForward/rightBackward/leftForward/leftBackward" with
+    // the dead bands in motor command units, "msg y/0" when it failed
+    void reportCalibration() {
+        if (!calibrationSucceeded) {
+            playdateLink.println("msg y/0");
+            DEBUG_PRINT(DEBUG_WARNING, "Motor calibration failed, feedforward unchanged");
+            return;
+        }
+
+        MotorResponse responses[2][2];
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            for (uint8_t direction = 0; direction < 2; direction++) {
+                responses[wheel][direction] = feedforward.getResponse(wheel, direction);
+            }
+        }
+        char message[48];
+        snprintf(message, sizeof(message), "msg y/1/%.0f/%.0f/%.0f/%.0f",
+                 responses[WHEEL_RIGHT][FeedforwardTable::FORWARD].deadband,
+                 responses[WHEEL_RIGHT][FeedforwardTable::BACKWARD].deadband,
+                 responses[WHEEL_LEFT][FeedforwardTable::FORWARD].deadband,
+                 responses[WHEEL_LEFT][FeedforwardTable::BACKWARD].deadband);
+        playdateLink.println(message);
+        DEBUG_PRINT(DEBUG_INFO, "Motor calibration complete - top speeds R: %.0f/%.0f L: %.0f/%.0f ticks/s",
+                    responses[WHEEL_RIGHT][FeedforwardTable::FORWARD].velocity[FEEDFORWARD_POINTS - 1],
+                    responses[WHEEL_RIGHT][FeedforwardTable::BACKWARD].velocity[FEEDFORWARD_POINTS - 1],
+                    responses[WHEEL_LEFT][FeedforwardTable::FORWARD].velocity[FEEDFORWARD_POINTS - 1],
+                    responses[WHEEL_LEFT][FeedforwardTable::BACKWARD].velocity[FEEDFORWARD_POINTS - 1]);
+        storage.saveMotorResponses(responses);
+    }
+
+    // Send the result of each wheel of the finished autotune run and save the new gains
+    // Format: "msg u/wheel/1/kP/kI/kD" when tuned, "msg u/wheel/0" when it failed
+    void reportTuning() {
+        bool changed = false;
+        char message[80];
+        for (uint8_t wheel = requestedTuneFirst; wheel <= requestedTuneLast; wheel++) {
+            if (wheelTuned[wheel]) {
+                gains[wheel] = tunedGains[wheel];
+                changed = true;
+                snprintf(message, sizeof(message), "msg u/%u/1/%.4f/%.4f/%.5f", wheel,
+                         gains[wheel].kP, gains[wheel].kI, gains[wheel].kD);
+                DEBUG_PRINT(DEBUG_INFO, "Wheel %u tuned - kP: %.4f kI: %.4f kD: %.5f", wheel,
+                            gains[wheel].kP, gains[wheel].kI, gains[wheel].kD);
+            } else {
+                snprintf(message, sizeof(message), "msg u/%u/0", wheel);
+                DEBUG_PRINT(DEBUG_WARNING, "Wheel %u autotune failed, gains unchanged", wheel);
+            }
+            playdateLink.println(message);
+        }
+        if (changed) storage.saveWheelGains(gains);
     }
 };
 
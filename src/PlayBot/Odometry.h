@@ -0,0 +1,76 @@
+// Odometry.h
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include "Config.h"
+#include <math.h>
+
+// Robot pose in the frame set by the last reset
+// x points forward at reset, y to the left, heading counterclockwise
+struct Pose {
+    float x;                      // mm
+    float y;                      // mm
+    float heading;                // rad, -PI to PI
+    float linearVelocity;         // mm/s, forward positive
+    float angularVelocity;        // rad/s, counterclockwise positive
+};
+
+// Differential-drive pose estimator fed with encoder counts
+// Called by the control loop every CONTROL_PERIOD_US. Each period's wheel
+// increments are integrated along an arc approximated by its midpoint
+// heading. Velocities are low-passed (ODOMETRY_VELOCITY_CUTOFF_HZ) since a
+// single encoder tick per period is already ~130 mm/s at 1 kHz.
+class Odometry {
+private:
+    static constexpr float period = CONTROL_PERIOD_US / 1000000.0f;
+    static constexpr float velocityTimeConstant = 1.0f / (2.0f * 3.14159265f * ODOMETRY_VELOCITY_CUTOFF_HZ);
+    static constexpr float velocitySmoothing = period / (period + velocityTimeConstant);
+
+    Pose pose;
+    int32_t lastRight;            // Encoder counts at the previous update
+    int32_t lastLeft;
+
+public:
+    Odometry()
+        : lastRight(0)
+        , lastLeft(0) {
+        reset();
+    }
+
+    // Move the pose back to the origin, velocities are kept
+    void reset() {
+        pose.x = pose.y = pose.heading = 0;
+    }
+
+    // Take new reference counts without moving, after encoders were reset
+    void rebase(int32_t right, int32_t left) {
+        lastRight = right;
+        lastLeft = left;
+    }
+
+    // Integrate the wheel travel since the previous update
+    void update(int32_t right, int32_t left) {
+        float travelRight = (right - lastRight) * MM_PER_TICK;
+        float travelLeft = (left - lastLeft) * MM_PER_TICK;
+        lastRight = right;
+        lastLeft = left;
+
+        float distance = (travelRight + travelLeft) / 2;
+        float turn = (travelRight - travelLeft) / WHEEL_BASE;
+        if (distance != 0 || turn != 0) {
+            float midHeading = pose.heading + turn / 2;
+            pose.x += distance * cosf(midHeading);
+            pose.y += distance * sinf(midHeading);
+            pose.heading += turn;
+            if (pose.heading > PI) pose.heading -= 2 * PI;
+            else if (pose.heading <= -PI) pose.heading += 2 * PI;
+        }
+
+        pose.linearVelocity += velocitySmoothing * (distance / period - pose.linearVelocity);
+        pose.angularVelocity += velocitySmoothing * (turn / period - pose.angularVelocity);
+    }
+
+    const Pose& getPose() const { return pose; }
+};
+
+#endif // ODOMETRY_H
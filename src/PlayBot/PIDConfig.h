@@ -2,8 +2,32 @@
 #ifndef PID_CONFIG_H
 #define PID_CONFIG_H
 
+#include <stdint.h>
+
 #define PID_KP 5
 #define PID_KI 0.1
 #define PID_KD 0.025
+#define MOTOR_COMMAND_LIMIT 400          // Motor command range, symmetric (DRV8835 setM1Speed/setM2Speed clamp)
+#define PID_OUTPUT_LIMIT MOTOR_COMMAND_LIMIT // Output and integral clamp, at full drive the integral stops growing
+#define PID_DERIVATIVE_CUTOFF_HZ 50      // Low-pass on the derivative, smooths encoder quantization
+#define PID_SAMPLE_PERIOD_US 1000        // Control loop period the gains are scaled for
+
+// Wheel PID parameters, compiled into the controller (PIDController.h)
+// kP, kI and kD are the defaults until gains tuned on the robot are loaded
+struct WheelPIDConfig {
+    static constexpr float kP = PID_KP;
+    static constexpr float kI = PID_KI;
+    static constexpr float kD = PID_KD;
+    static constexpr float outputLimit = PID_OUTPUT_LIMIT;
+    static constexpr float derivativeCutoffHz = PID_DERIVATIVE_CUTOFF_HZ;
+    static constexpr uint32_t samplePeriodUs = PID_SAMPLE_PERIOD_US;
+};
+
+// Gains of one wheel, found by the autotune and saved on the SD card
+struct WheelGains {
+    float kP;
+    float kI;                            // per second
+    float kD;                            // seconds
+};
 
-#endif
\ No newline at end of file
+#endif
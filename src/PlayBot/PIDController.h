@@ -0,0 +1,84 @@
+// PIDController.h
+#ifndef PID_CONTROLLER_H
+#define PID_CONTROLLER_H
+
+#include <stdint.h>
+
+// Single-precision PID controller for several channels sharing parameters
+// Config supplies the parameters at compile time (see WheelPIDConfig):
+//   kP, kI, kD            Default gains, same units as PID_v1 (kI per second, kD in seconds)
+//   outputLimit           Symmetric output clamp
+//   derivativeCutoffHz    First-order low-pass on the derivative term
+//   samplePeriodUs        Fixed period between update() calls
+// Each channel can be given its own gains with setGains(). The sample
+// period is fixed, so the integral and derivative gains are scaled once
+// when set and update() is a handful of multiply-adds per channel with no
+// timing calls. All channels are updated in one call.
+// - Derivative on measurement: setpoint steps do not kick the output
+// - Anti-windup: the integral is clamped to the output range and stops
+//   growing while the output saturates in the direction of the error
+template <class Config, uint8_t Channels>
+class PIDController {
+private:
+    static constexpr float samplePeriod = Config::samplePeriodUs / 1000000.0f;
+    static constexpr float derivativeTimeConstant = 1.0f / (2.0f * 3.14159265f * Config::derivativeCutoffHz);
+    static constexpr float derivativeSmoothing = samplePeriod / (samplePeriod + derivativeTimeConstant);
+    static constexpr float limit = Config::outputLimit;
+
+    float integral[Channels];     // Accumulated integral term (output units)
+    float lastInput[Channels];    // Input at the previous update
+    float slope[Channels];        // Filtered input change per period, sign inverted
+    float proportionalGain[Channels]; // Gains set per channel
+    float integralGain[Channels];     // kI scaled by the sample period
+    float derivativeGain[Channels];   // kD divided by the sample period
+
+public:
+    PIDController() {
+        for (uint8_t channel = 0; channel < Channels; channel++) {
+            setGains(channel, Config::kP, Config::kI, Config::kD);
+            reset(channel, 0);
+        }
+    }
+
+    // Change the gains of a channel, in the same units as Config
+    // The accumulated integral is kept so the output does not jump
+    void setGains(uint8_t channel, float kP, float kI, float kD) {
+        proportionalGain[channel] = kP;
+        integralGain[channel] = kI * samplePeriod;
+        derivativeGain[channel] = kD / samplePeriod;
+    }
+
+    // Restart a channel from the given input without output bump
+    void reset(uint8_t channel, float input) {
+        integral[channel] = 0;
+        lastInput[channel] = input;
+        slope[channel] = 0;
+    }
+
+    // Compute the output of every channel from its setpoint and measured input
+    void update(const float* setpoint, const float* input, float* output) {
+        for (uint8_t channel = 0; channel < Channels; channel++) {
+            float error = setpoint[channel] - input[channel];
+
+            slope[channel] += derivativeSmoothing * ((lastInput[channel] - input[channel]) - slope[channel]);
+            lastInput[channel] = input[channel];
+
+            float accumulated = integral[channel] + integralGain[channel] * error;
+            if (accumulated > limit) accumulated = limit;
+            else if (accumulated < -limit) accumulated = -limit;
+
+            float value = proportionalGain[channel] * error + accumulated + derivativeGain[channel] * slope[channel];
+            if (value > limit) {
+                value = limit;
+                if (error > 0) accumulated = integral[channel];
+            } else if (value < -limit) {
+                value = -limit;
+                if (error < 0) accumulated = integral[channel];
+            }
+            integral[channel] = accumulated;
+            output[channel] = value;
+        }
+    }
+};
+
+#endif // PID_CONTROLLER_H
@@ -31,45 +31,56 @@
 #include "DistanceTracker.h"
 #include "LEDController.h"
 #include "BatteryManager.h"
+#include "AnimationCache.h"
 #include "AnimationManager.h"
+#include "SampleBus.h"
 #include "SensorManager.h"
+#include "SafetyMonitor.h"
 #include "MotorController.h"
+#include "TelemetryManager.h"
 #include "CommunicationManager.h"
 #include <string>
-#include <PID_v1.h>
 #include <SD.h>
 #include <vector>
 #include <Smoothed.h>
 
 // ================= Global Objects =================
 LEDController ledController(ws2812fx);
-AnimationManager animationManager(headServo, motors, myEnc, myEnc2);
-BatteryManager batteryManager(userial, ledController, animationManager);
-DistanceTracker distanceTracker(myEnc, myEnc2);
-String rightWheel, leftWheel;
-SensorManager sensorManager(userial, animationManager, motors, ws2812fx, mux, 
-                          myEnc, myEnc2, batteryManager, distanceTracker);
+AnimationCache animationCache;
+StorageManager storageManager;
+AnimationManager animationManager(headServo, motors, myEnc, myEnc2, animationCache, storageManager);
+AsyncI2C i2cBus;
+AdcSampler adcSampler;
+TofSampler tofSampler(i2cBus);
+SampleBus sampleBus(adcSampler, tofSampler, i2cBus, myEnc, myEnc2);
+BatteryManager batteryManager(playdateLink, ledController, animationManager, i2cBus, sampleBus);
+DistanceTracker distanceTracker(sampleBus);
+float rightWheel = 0, leftWheel = 0;
+int16_t headTarget = 0;
+SensorManager sensorManager(playdateLink, animationManager, motors, ws2812fx, i2cBus, tofSampler, adcSampler,
+                          sampleBus, batteryManager, distanceTracker);
+// Front collision detector, SmoothedRunDetector and CusumDetector plug in the same way
+HampelDetector collisionDetector(FRONT_COLLISION_THRESHOLD, TOF_MAX_VALID_DISTANCE, HAMPEL_WINDOW,
+                                 HAMPEL_THRESHOLD_SIGMAS, HAMPEL_CONFIRM_SAMPLES);
+SafetyMonitor safetyMonitor(motors, adcSampler, tofSampler, collisionDetector, animationManager);
 MotorController motorController(
     motors, 
     myEnc,      // Left encoder
     myEnc2,     // Right encoder
-    myPID2,     // Left PID
-    myPID,      // Right PID
-    Setpoint,   // Right setpoint
-    Setpoint2,  // Left setpoint
-    Input,      // Right input
-    Input2,     // Left input
-    Output,     // Right output
-    Output2     // Left output
+    storageManager,
+    safetyMonitor
 );
-StorageManager storageManager;
+TelemetryManager telemetryManager(playdateLink, sensorManager, motorController);
 CommunicationManager communicationManager(
     myusb,
     userial,
+    playdateLink,
     animationManager,
     batteryManager,
     sensorManager,
-    motorController
+    motorController,
+    safetyMonitor,
+    telemetryManager
 );
 
 // ================= Global Variables =================
@@ -84,10 +95,13 @@ void setup() {
     DEBUG_PRINT(DEBUG_INFO, "Setup started");
     //Initialize classes
     storageManager.initialize();
+    animationCache.initialize();
     sensorManager.initialize();
+    safetyMonitor.initialize();
     ledController.initialize();
     motorController.initialize();
     batteryManager.initialize();
+    sampleBus.initialize(batteryManager.isGaugeAvailable());
     communicationManager.initialize();
     distanceTracker.initialize();
     printSetupErrorSummary();
@@ -108,15 +122,6 @@ void setup() {
 void loop() {
     ledController.update();
 
-    // Update system states
-    motorController.updateTimers();
-    motorController.updateEncoders();
-    motorController.computePID();
-
-    animationManager.getWheelCommands(rightWheel, leftWheel);
-    motorController.updateSetpoints(rightWheel, leftWheel, animationManager.isAnimationPlaying());
-    motorController.controlMotors(animationManager.isAnimationPlaying(), MOTION_ENABLED);
-
     // Handle animation if active
     animationManager.update();
 
@@ -124,15 +129,31 @@ void loop() {
     communicationManager.readFromUSBHostSerialAndWriteToSerial();
     communicationManager.handleBaudRateChange();
     
-    sensorManager.detectTableEdgeIR();
+    sensorManager.updateTofSampling();
+    sampleBus.update();
+    safetyMonitor.update();
     sensorManager.checkLightSensor();
-    sensorManager.checkFrontCollision();
+
+    // Hand wheel targets to the control loop once stops and starts are known
+    animationManager.getWheelCommands(rightWheel, leftWheel);
+    motorController.publishSetpoints(rightWheel, leftWheel, animationManager.isAnimationPlaying(), MOTION_ENABLED);
+    motorController.update();
+    if (motorController.takeHeadTarget(headTarget)) {
+        animationManager.setHeadPosition(headTarget);
+    }
 
     distanceTracker.update();
     distanceTracker.checkAndLog(animationManager.isAnimationPlaying());
 
     batteryManager.detectBatteryCharging();
+    sensorManager.updateSnapshot();
+    telemetryManager.update();
     sendLogs();
+    checkHeapUsage();
+    checkLoopTime();
+
+    // Refill animation buffers or load preloads once time-critical work is done
+    animationManager.prefetch();
     DEBUG_PRINT(DEBUG_VERBOSE, "Loop iteration completed");
 }
 
@@ -0,0 +1,82 @@
+// PlaydateLink.h
+#ifndef PLAYDATE_LINK_H
+#define PLAYDATE_LINK_H
+
+#include <Arduino.h>
+#include <USBHost_t36.h>
+#include "BinaryProtocol.h"
+
+#define PLAYDATE_LINE_BYTES 256          // Longest text message sent as one frame
+
+// Output path of every message to Playdate
+// Messages are printed as before ("msg x/..." lines). With the text
+// protocol they go straight to the USB serial port; once the binary
+// protocol is negotiated each line becomes a BINARY_TYPE_TEXT frame, and
+// senders with a binary layout (sensor data, pose, telemetry) send their
+// own frames with sendFrame(). Incoming frames are rebuilt by the decoder,
+// CommunicationManager feeds it.
+class PlaydateLink : public Print {
+private:
+    USBSerial_BigBuffer& serial;
+    uint8_t version;                  // Binary protocol version in use, 0 for text
+    uint8_t sendSeq;                  // seq of the next frame sent
+    char line[PLAYDATE_LINE_BYTES];   // Line being printed, binary protocol
+    size_t lineLength;
+    uint8_t frame[BINARY_MAX_FRAME];
+    BinaryFrameDecoder decoder;
+
+    void sendLine() {
+        sendFrame(BINARY_TYPE_TEXT, (const uint8_t*)line, lineLength);
+        lineLength = 0;
+    }
+
+public:
+    explicit PlaydateLink(USBSerial_BigBuffer& usbSerial)
+        : serial(usbSerial)
+        , version(0)
+        , sendSeq(0)
+        , lineLength(0) {
+    }
+
+    using Print::write;
+
+    size_t write(uint8_t byte) override {
+        return write(&byte, 1);
+    }
+
+    // Text protocol: passed through. Binary protocol: each line ending sends the line as a frame
+    size_t write(const uint8_t* data, size_t size) override {
+        if (version == 0) return serial.write(data, size);
+        for (size_t i = 0; i < size; i++) {
+            if (data[i] == '\n') {
+                sendLine();
+            } else if (data[i] != '\r') {
+                if (lineLength == sizeof(line)) sendLine();
+                line[lineLength++] = data[i];
+            }
+        }
+        return size;
+    }
+
+    // Send one frame, binary protocol only
+    void sendFrame(uint8_t type, const uint8_t* payload, size_t length) {
+        size_t frameLength = binaryEncodeFrame(type, sendSeq, payload, length, frame);
+        if (frameLength == 0) return;
+        sendSeq++;
+        serial.write(frame, frameLength);
+    }
+
+    // Switch protocol, 0 for text - frames and partial lines of the previous one are dropped
+    void setVersion(uint8_t binaryVersion) {
+        version = binaryVersion;
+        sendSeq = 0;
+        lineLength = 0;
+        decoder.reset();
+    }
+
+    bool isBinary() const { return version > 0; }
+    uint8_t getVersion() const { return version; }
+    BinaryFrameDecoder& getDecoder() { return decoder; }
+};
+
+#endif // PLAYDATE_LINK_H
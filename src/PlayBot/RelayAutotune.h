@@ -0,0 +1,114 @@
+// RelayAutotune.h
+#ifndef RELAY_AUTOTUNE_H
+#define RELAY_AUTOTUNE_H
+
+#include "Config.h"
+#include <math.h>
+
+// Relay feedback autotune of one wheel position loop (Astrom-Hagglund)
+// The PID is replaced by a relay: the wheel is driven forward with
+// AUTOTUNE_RELAY_OUTPUT while it is behind its start position and backward
+// once it is past it, with AUTOTUNE_HYSTERESIS_TICKS of hysteresis against
+// encoder noise. The wheel settles into a small oscillation at the loop's
+// critical frequency, whose period Tu and amplitude a give the ultimate gain
+//   Ku = 4 * output / (PI * sqrt(a^2 - hysteresis^2))
+// Gains follow the Tyreus-Luyben rules, less aggressive than Ziegler-Nichols
+// and better suited to geared motors with backlash.
+// Called by the control loop every CONTROL_PERIOD_US.
+class RelayAutotune {
+public:
+    enum State : uint8_t {
+        AUTOTUNE_RUNNING,
+        AUTOTUNE_DONE,                // Enough oscillations measured
+        AUTOTUNE_FAILED               // No steady oscillation within AUTOTUNE_TIMEOUT_MS
+    };
+
+private:
+    static constexpr float period = CONTROL_PERIOD_US / 1000000.0f;
+    static constexpr uint32_t timeoutTicks = (uint32_t)AUTOTUNE_TIMEOUT_MS * 1000 / CONTROL_PERIOD_US;
+
+    float target;                 // Position the wheel oscillates around (ticks)
+    float output;                 // Current relay output
+    float high;                   // Extremes since the last switch to forward
+    float low;
+    uint32_t elapsedTicks;        // Control periods since begin()
+    uint32_t lastRiseTick;        // Period of the last switch to forward
+    bool measuring;               // A switch to forward has been seen
+    uint8_t cycles;               // Oscillations completed, settling ones included
+    float periodSum;              // Measured periods (control periods)
+    float amplitudeSum;           // Measured amplitudes (ticks)
+    State state;
+
+    // Forward switch: one full oscillation since the previous one
+    void completeCycle(float input) {
+        if (measuring) {
+            cycles++;
+            if (cycles > AUTOTUNE_SETTLE_CYCLES) {
+                periodSum += elapsedTicks - lastRiseTick;
+                amplitudeSum += (high - low) / 2;
+            }
+            if (cycles >= AUTOTUNE_SETTLE_CYCLES + AUTOTUNE_CYCLES) state = AUTOTUNE_DONE;
+        }
+        measuring = true;
+        lastRiseTick = elapsedTicks;
+        high = low = input;
+    }
+
+public:
+    RelayAutotune() {
+        begin(0);
+        state = AUTOTUNE_FAILED;
+    }
+
+    // Start oscillating around the current wheel position
+    void begin(float position) {
+        target = position;
+        output = AUTOTUNE_RELAY_OUTPUT;
+        high = low = position;
+        elapsedTicks = 0;
+        lastRiseTick = 0;
+        measuring = false;
+        cycles = 0;
+        periodSum = 0;
+        amplitudeSum = 0;
+        state = AUTOTUNE_RUNNING;
+    }
+
+    // Advance one control period, returns the motor command
+    float step(float input) {
+        if (state != AUTOTUNE_RUNNING) return 0;
+        elapsedTicks++;
+        if (input > high) high = input;
+        if (input < low) low = input;
+
+        if (output > 0 && input > target + AUTOTUNE_HYSTERESIS_TICKS) {
+            output = -AUTOTUNE_RELAY_OUTPUT;
+        } else if (output < 0 && input < target - AUTOTUNE_HYSTERESIS_TICKS) {
+            output = AUTOTUNE_RELAY_OUTPUT;
+            completeCycle(input);
+        }
+
+        if (state == AUTOTUNE_RUNNING && elapsedTicks >= timeoutTicks) state = AUTOTUNE_FAILED;
+        return state == AUTOTUNE_RUNNING ? output : 0;
+    }
+
+    State getState() const { return state; }
+
+    // PID gains from the measured oscillation
+    // Returns false if the oscillation did not clear the hysteresis
+    bool computeGains(WheelGains& gains) const {
+        if (state != AUTOTUNE_DONE) return false;
+        float amplitude = amplitudeSum / AUTOTUNE_CYCLES;
+        float ultimatePeriod = periodSum / AUTOTUNE_CYCLES * period;
+        if (amplitude <= AUTOTUNE_HYSTERESIS_TICKS || ultimatePeriod <= 0) return false;
+
+        float ultimateGain = 4 * AUTOTUNE_RELAY_OUTPUT /
+            (PI * sqrtf(amplitude * amplitude - AUTOTUNE_HYSTERESIS_TICKS * AUTOTUNE_HYSTERESIS_TICKS));
+        gains.kP = ultimateGain / 2.2f;
+        gains.kI = gains.kP / (2.2f * ultimatePeriod);
+        gains.kD = gains.kP * ultimatePeriod / 6.3f;
+        return true;
+    }
+};
+
+#endif // RELAY_AUTOTUNE_H
@@ -0,0 +1,212 @@
+// SafetyMonitor.h
+#ifndef SAFETY_MONITOR_H
+#define SAFETY_MONITOR_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "AdcSampler.h"
+#include "TofSampler.h"
+#include "CollisionDetector.h"
+#include "AnimationManager.h"
+
+// Table edge and front collision stops, checked from a timer interrupt
+// Every SAFETY_PERIOD_US the interrupt reads the IR and ToF values the
+// samplers keep up to date in the background and, when a condition
+// appears, sets both motors to 0 itself: how late the main loop runs no
+// longer matters. The control loop sees the trip count change and holds
+// the motors (see MotorController) until the main loop has stopped the
+// animation; update() does that and sends the message to Playdate:
+// - "msg e/1" : Edge detected
+// - "msg w/1" : Collision detected
+// - "msg h/source/events/maxUs/buckets..." : Detection to stop latency
+// Each stop records its latency from the sensor crossing the threshold to
+// the motors set to 0 in a histogram per source: bucket i counts
+// latencies of 2^i to 2^(i+1) µs, the last bucket everything longer.
+// The crossing is the first check seeing the newest raw IR result over
+// the threshold, or the arrival of the first front ToF sample under it.
+// Front samples go through the CollisionDetector given at construction,
+// its parameters set how much filtering, and latency, comes before a stop.
+// All IntervalTimers share the PIT interrupt on the Teensy 4, so checks
+// run between two control periods and never interleave with the control
+// loop's motor writes.
+class SafetyMonitor {
+public:
+    enum Source : uint8_t {
+        SAFETY_EDGE,
+        SAFETY_COLLISION,
+        SAFETY_SOURCE_COUNT
+    };
+
+    struct LatencyHistogram {
+        uint32_t events;
+        uint32_t maxLatency;      // µs
+        uint32_t buckets[SAFETY_HISTOGRAM_BUCKETS];
+    };
+
+private:
+    // Edge and collision state, owned by the interrupt
+    struct EdgeCheck {
+        bool active;              // Filtered IR over the threshold
+        bool crossed;             // Raw IR went over since the filtered value was last under
+        uint32_t crossTime;       // micros() of that crossing
+    };
+
+    struct CollisionCheck {
+        uint32_t lastSample;      // Timestamp of the last front sample checked
+        bool active;              // Detector reported a collision, until it clears
+        bool crossed;             // A raw sample went under since the distance was last clear
+        uint32_t crossTime;       // Timestamp of that sample
+    };
+
+    inline static const char sourceLetters[SAFETY_SOURCE_COUNT] = {'e', 'w'};
+
+    DRV8835MotorShield& motors;
+    AdcSampler& adc;
+    TofSampler& tof;
+    CollisionDetector& detector;
+    AnimationManager& animationManager;
+    IntervalTimer safetyTimer;
+
+    EdgeCheck edge;
+    CollisionCheck collision;
+    volatile uint32_t tripCount;  // Stops made, read by the control loop
+    volatile uint8_t tripSeq[SAFETY_SOURCE_COUNT];
+    volatile uint32_t lastLatency[SAFETY_SOURCE_COUNT];
+    uint8_t reportedSeq[SAFETY_SOURCE_COUNT]; // Main loop side
+    LatencyHistogram histograms[SAFETY_SOURCE_COUNT]; // Written by the interrupt
+
+    inline static SafetyMonitor* instance = nullptr;
+
+    static void safetyInterrupt() {
+        instance->check();
+    }
+
+    // Cut the motors and record the stop
+    void trip(Source source, uint32_t crossTime) {
+        motors.setM1Speed(0);
+        motors.setM2Speed(0);
+        uint32_t latency = micros() - crossTime;
+
+        LatencyHistogram& histogram = histograms[source];
+        uint8_t bucket = 0;
+        while (bucket < SAFETY_HISTOGRAM_BUCKETS - 1 && (latency >> (bucket + 1)) != 0) bucket++;
+        histogram.buckets[bucket]++;
+        histogram.events++;
+        if (latency > histogram.maxLatency) histogram.maxLatency = latency;
+
+        lastLatency[source] = latency;
+        tripCount = tripCount + 1;
+        std::atomic_signal_fence(std::memory_order_release);
+        tripSeq[source] = tripSeq[source] + 1;
+    }
+
+    // Table edge: averaged IR reading at or above its threshold on either side
+    void checkEdge() {
+        bool rawOver = adc.latest(AdcSampler::ADC_IR_LEFT) >= IR_EDGE_THRESHOLD_LEFT ||
+                       adc.latest(AdcSampler::ADC_IR_RIGHT) >= IR_EDGE_THRESHOLD_RIGHT;
+        bool over = adc.read(AdcSampler::ADC_IR_LEFT) >= IR_EDGE_THRESHOLD_LEFT ||
+                    adc.read(AdcSampler::ADC_IR_RIGHT) >= IR_EDGE_THRESHOLD_RIGHT;
+        if ((rawOver || over) && !edge.crossed) {
+            edge.crossed = true;
+            edge.crossTime = micros();
+        }
+        if (over && !edge.active) trip(SAFETY_EDGE, edge.crossTime);
+        edge.active = over;
+        if (!over && !rawOver) edge.crossed = false;
+    }
+
+    // Front collision: each new front sample goes through the detector, a stop when it starts detecting
+    void checkCollision() {
+        TofSample sample;
+        if (!tof.peekSample(FRONT_SENSOR, sample) || sample.timestamp == collision.lastSample) return;
+        collision.lastSample = sample.timestamp;
+        if (sample.distance == 0) return;
+
+        bool under = sample.distance < FRONT_COLLISION_THRESHOLD;
+        if (under && !collision.crossed) {
+            collision.crossed = true;
+            collision.crossTime = sample.timestamp;
+        }
+
+        bool detected = detector.update(sample.distance);
+        if (detected && !collision.active) {
+            trip(SAFETY_COLLISION, collision.crossed ? collision.crossTime : sample.timestamp);
+        }
+        collision.active = detected;
+        if (!detected && !under) collision.crossed = false;
+    }
+
+    // One check - runs in the timer interrupt
+    void check() {
+        checkEdge();
+        checkCollision();
+    }
+
+public:
+    SafetyMonitor(DRV8835MotorShield& mot, AdcSampler& adcSampler, TofSampler& tofSampler,
+                  CollisionDetector& collisionDetector, AnimationManager& anim)
+        : motors(mot)
+        , adc(adcSampler)
+        , tof(tofSampler)
+        , detector(collisionDetector)
+        , animationManager(anim)
+        , tripCount(0) {
+        memset(&edge, 0, sizeof(edge));
+        memset(&collision, 0, sizeof(collision));
+        memset(histograms, 0, sizeof(histograms));
+        for (uint8_t source = 0; source < SAFETY_SOURCE_COUNT; source++) {
+            tripSeq[source] = 0;
+            lastLatency[source] = 0;
+            reportedSeq[source] = 0;
+        }
+    }
+
+    // Start the checks, once the samplers run
+    void initialize() {
+        instance = this;
+        safetyTimer.priority(CONTROL_LOOP_PRIORITY);
+        if (!safetyTimer.begin(safetyInterrupt, SAFETY_PERIOD_US)) {
+            recordSetupError("Safety timer unavailable");
+            return;
+        }
+        DEBUG_PRINT(DEBUG_INFO, "Safety checks running every %lu us", (unsigned long)SAFETY_PERIOD_US);
+    }
+
+    // Stops made since boot, the control loop holds the motors when it changes
+    uint32_t getTripCount() const { return tripCount; }
+
+    // Stop the animation and tell Playdate about new stops - called in main loop
+    void update() {
+        for (uint8_t source = 0; source < SAFETY_SOURCE_COUNT; source++) {
+            if (reportedSeq[source] == tripSeq[source]) continue;
+            reportedSeq[source] = tripSeq[source];
+            std::atomic_signal_fence(std::memory_order_acquire);
+
+            animationManager.stopAnimation();
+            playdateLink.println(source == SAFETY_EDGE ? "msg e/1" : "msg w/1");
+            DEBUG_PRINT(DEBUG_INFO, "%s stop - %lu us from threshold to motors off",
+                        source == SAFETY_EDGE ? "Edge" : "Collision", (unsigned long)lastLatency[source]);
+        }
+    }
+
+    // Send the latency histograms to Playdate, one message per source
+    // Format: "msg h/e|w/events/maxUs/bucket0/.../bucketN" counted since boot
+    void sendLatencyHistograms() {
+        for (uint8_t source = 0; source < SAFETY_SOURCE_COUNT; source++) {
+            noInterrupts();
+            LatencyHistogram histogram = histograms[source];
+            interrupts();
+
+            char message[32 + SAFETY_HISTOGRAM_BUCKETS * 11];
+            int length = snprintf(message, sizeof(message), "msg h/%c/%lu/%lu", sourceLetters[source],
+                                  (unsigned long)histogram.events, (unsigned long)histogram.maxLatency);
+            for (uint8_t bucket = 0; bucket < SAFETY_HISTOGRAM_BUCKETS && length < (int)sizeof(message); bucket++) {
+                length += snprintf(message + length, sizeof(message) - length, "/%lu",
+                                   (unsigned long)histogram.buckets[bucket]);
+            }
+            playdateLink.println(message);
+        }
+    }
+};
+
+#endif // SAFETY_MONITOR_H
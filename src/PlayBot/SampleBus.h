@@ -0,0 +1,236 @@
+// SampleBus.h
+#ifndef SAMPLE_BUS_H
+#define SAMPLE_BUS_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "HardwareConfig.h"
+#include "AdcSampler.h"
+#include "AsyncI2C.h"
+#include "TofSampler.h"
+
+// One sensor value with the micros() it was taken at
+template <typename T>
+struct TimedSample {
+    uint32_t timestamp;           // micros()
+    T value;
+};
+
+// Fixed ring of the last Length samples of one sensor
+// Written and read by the main loop only. Readers either take the newest
+// sample, the newest few, or every sample pushed since they last looked;
+// samples overwritten before a reader got to them are skipped.
+template <typename T, uint8_t Length>
+class SampleRing {
+private:
+    TimedSample<T> samples[Length];
+    uint32_t written;             // Samples pushed since boot
+
+public:
+    SampleRing() : written(0) {
+        memset(samples, 0, sizeof(samples));
+    }
+
+    void push(uint32_t timestamp, const T& value) {
+        TimedSample<T>& sample = samples[written % Length];
+        sample.timestamp = timestamp;
+        sample.value = value;
+        written++;
+    }
+
+    // Samples pushed since boot, 0 until the sensor has been read once
+    uint32_t getWritten() const { return written; }
+
+    // Newest sample, false before the first one
+    bool latest(TimedSample<T>& sample) const {
+        if (written == 0) return false;
+        sample = samples[(written - 1) % Length];
+        return true;
+    }
+
+    // Copy up to count newest samples, oldest first, returns how many
+    uint8_t window(TimedSample<T>* out, uint8_t count) const {
+        uint32_t available = written < Length ? written : Length;
+        if (count > available) count = available;
+        for (uint8_t i = 0; i < count; i++) {
+            out[i] = samples[(written - count + i) % Length];
+        }
+        return count;
+    }
+
+    // Copy the samples pushed after the reader's position seen, oldest first,
+    // up to count, and move seen past them
+    uint8_t readNew(uint32_t& seen, TimedSample<T>* out, uint8_t count) const {
+        if (written - seen > Length) seen = written - Length;
+        uint8_t copied = 0;
+        while (seen != written && copied < count) {
+            out[copied++] = samples[seen % Length];
+            seen++;
+        }
+        return copied;
+    }
+
+    // Newest sample if one was pushed after seen, which moves to the end
+    bool takeLatest(uint32_t& seen, TimedSample<T>& sample) const {
+        if (seen == written) return false;
+        seen = written;
+        return latest(sample);
+    }
+};
+
+struct IrReading {
+    uint16_t left;
+    uint16_t right;
+};
+
+struct EncoderReading {
+    int32_t left;                 // Encoder counts
+    int32_t right;
+    uint32_t resetCount;          // encoderResetCount the counts belong to
+};
+
+struct BatteryReading {
+    float voltage;                // V
+    float percent;
+};
+
+// Central producer of the main loop's sensor values
+// update() reads each sensor once per configured period into its ring,
+// stamped with the time it was read; every consumer (light, charging,
+// travelled distance, sensor data for Playdate) reads the rings instead
+// of the hardware. ToF distances are taken from the sampler as each read
+// completes, with the sampler's own timestamp. The edge and collision
+// stops stay on the samplers directly: they run in a timer interrupt.
+class SampleBus {
+public:
+    typedef SampleRing<IrReading, SAMPLE_RING_LENGTH> IrRing;
+    typedef SampleRing<uint16_t, SAMPLE_RING_LENGTH> AnalogRing;
+    typedef SampleRing<uint16_t, SAMPLE_RING_LENGTH> TofRing;
+    typedef SampleRing<EncoderReading, SAMPLE_RING_LENGTH> EncoderRing;
+    typedef SampleRing<BatteryReading, SAMPLE_RING_LENGTH> BatteryRing;
+
+private:
+    enum Source : uint8_t {
+        SOURCE_IR,
+        SOURCE_LIGHT,
+        SOURCE_USB_DETECT,
+        SOURCE_ENCODERS,
+        SOURCE_BATTERY,
+        SOURCE_COUNT
+    };
+
+    static constexpr uint16_t periods[SOURCE_COUNT] = {
+        SAMPLE_IR_PERIOD_MS, SAMPLE_LIGHT_PERIOD_MS, SAMPLE_USB_DETECT_PERIOD_MS,
+        SAMPLE_ENCODER_PERIOD_MS, SAMPLE_BATTERY_PERIOD_MS
+    };
+
+    AdcSampler& adc;
+    TofSampler& tofSampler;
+    AsyncI2C& i2cBus;             // Gauge reads hold the bus shared with the ToF sampler
+    Encoder& encoderLeft;
+    Encoder& encoderRight;
+    bool gaugeAvailable;          // MAX17048 answered at startup
+    uint32_t lastRead[SOURCE_COUNT]; // millis() of the last read of each source
+    uint32_t lastTofTimestamp[TOF_SENSOR_COUNT];
+
+    IrRing irRing;
+    AnalogRing lightRing;
+    AnalogRing usbDetectRing;
+    TofRing tofRings[TOF_SENSOR_COUNT];
+    EncoderRing encoderRing;
+    BatteryRing batteryRing;
+
+    // Move a source read on time to its next period, one late by a whole period restarts from now
+    void advance(Source source, uint32_t now) {
+        lastRead[source] += periods[source];
+        if (now - lastRead[source] >= periods[source]) lastRead[source] = now;
+    }
+
+    // Read one source into its ring, false to try again on the next pass
+    bool read(Source source) {
+        uint32_t timestamp = micros();
+        switch (source) {
+            case SOURCE_IR:
+                irRing.push(timestamp, {adc.read(AdcSampler::ADC_IR_LEFT), adc.read(AdcSampler::ADC_IR_RIGHT)});
+                return true;
+            case SOURCE_LIGHT:
+                lightRing.push(timestamp, adc.read(AdcSampler::ADC_LIGHT));
+                return true;
+            case SOURCE_USB_DETECT:
+                usbDetectRing.push(timestamp, adc.read(AdcSampler::ADC_USB_DETECT));
+                return true;
+            case SOURCE_ENCODERS: {
+                // Odd while the main loop is zeroing the encoders
+                uint32_t resets = encoderResetCount;
+                if (resets & 1) return false;
+                EncoderReading reading = {encoderLeft.read(), encoderRight.read(), resets};
+                if (encoderResetCount != resets) return false;
+                encoderRing.push(timestamp, reading);
+                return true;
+            }
+            case SOURCE_BATTERY: {
+                if (!gaugeAvailable) return true;
+                I2CBusLock lock(i2cBus);
+                BatteryReading reading = {maxlipo.cellVoltage(), maxlipo.cellPercent()};
+                batteryRing.push(micros(), reading);
+                return true;
+            }
+            default:
+                return true;
+        }
+    }
+
+public:
+    SampleBus(AdcSampler& adcSampler, TofSampler& tof, AsyncI2C& i2c, Encoder& encLeft, Encoder& encRight)
+        : adc(adcSampler)
+        , tofSampler(tof)
+        , i2cBus(i2c)
+        , encoderLeft(encLeft)
+        , encoderRight(encRight)
+        , gaugeAvailable(false) {
+        for (uint8_t source = 0; source < SOURCE_COUNT; source++) {
+            lastRead[source] = 0;
+        }
+        for (uint8_t sensor = 0; sensor < TOF_SENSOR_COUNT; sensor++) {
+            lastTofTimestamp[sensor] = 0;
+        }
+    }
+
+    // Start producing, once the samplers run and the battery gauge is set up
+    void initialize(bool batteryGaugeAvailable) {
+        gaugeAvailable = batteryGaugeAvailable;
+        uint32_t now = millis();
+        for (uint8_t source = 0; source < SOURCE_COUNT; source++) {
+            lastRead[source] = now - periods[source];
+        }
+        update();
+        DEBUG_PRINT(DEBUG_INFO, "Sample bus running, battery gauge %s", gaugeAvailable ? "read" : "unavailable");
+    }
+
+    // Read every source that is due - called in main loop
+    void update() {
+        for (uint8_t sensor = 0; sensor < TOF_SENSOR_COUNT; sensor++) {
+            TofSample sample = tofSampler.getSample(sensor);
+            if (sample.timestamp == lastTofTimestamp[sensor]) continue;
+            lastTofTimestamp[sensor] = sample.timestamp;
+            tofRings[sensor].push(sample.timestamp, sample.distance);
+        }
+
+        uint32_t now = millis();
+        for (uint8_t source = 0; source < SOURCE_COUNT; source++) {
+            if (now - lastRead[source] < periods[source]) continue;
+            if (read((Source)source)) advance((Source)source, now);
+        }
+    }
+
+    const IrRing& ir() const { return irRing; }
+    const AnalogRing& light() const { return lightRing; }
+    const AnalogRing& usbDetect() const { return usbDetectRing; }
+    // Distances of a ToF sensor (mux channel) in mm, 0 when it had no echo
+    const TofRing& tof(uint8_t channel) const { return tofRings[channel]; }
+    const EncoderRing& encoders() const { return encoderRing; }
+    // Empty when the battery gauge is unavailable
+    const BatteryRing& battery() const { return batteryRing; }
+};
+
+#endif // SAMPLE_BUS_H
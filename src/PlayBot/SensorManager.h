@@ -6,241 +6,274 @@
 #include "Debug.h"
 #include "BatteryManager.h"
 #include "DistanceTracker.h"
+#include "AsyncI2C.h"
+#include "TofSampler.h"
+#include "AdcSampler.h"
+#include "SampleBus.h"
 #include <Wire.h>
-#include <Smoothed.h>
 
 // Manages all robot sensors and communicates with Playdate via messages:
-// - "msg d/..." : Complete sensor data packet
-// - "msg e/1" : Edge detected
-// - "msg w/1" : Collision detected
+// - "msg d/..." : Complete sensor data packet, served from a snapshot kept up to date every loop pass,
+//   a BINARY_TYPE_SENSOR_DATA frame with the binary protocol
 // - "msg l/0|1" : Dark/Light state change
+// - "msg i/..." : I2C transaction statistics
+// Values come from the sample bus, the hardware is only read by its producers.
+// Edge and collision stops are made by SafetyMonitor from the same samplers.
 class SensorManager {
+public:
+    // Fields of the "d" snapshot that have had a sample
+    enum SnapshotField : uint8_t {
+        FIELD_IR = 1,
+        FIELD_TOF_FRONT = 2,
+        FIELD_TOF_BACK = 4,
+        FIELD_ENCODERS = 8,
+        FIELD_LIGHT = 16,
+        FIELD_BATTERY = 32
+    };
+
+    // Values served by "d" and telemetry, refreshed from the sample bus
+    // every loop pass, each with the micros() its sample was taken at
+    struct SensorSnapshot {
+        int irRight;
+        int irLeft;
+        uint32_t irTime;
+        float tof[2];                  // Front, back (mm), last reading with an echo
+        uint32_t tofTime[2];
+        int32_t encRight;
+        int32_t encLeft;
+        uint32_t encoderTime;
+        int light;
+        uint32_t lightTime;
+        float batteryVoltage;
+        float batteryPercent;
+        uint32_t batteryTime;
+        bool charging;
+        float distanceMeters;
+        uint8_t fields;                // SnapshotField bits
+    };
+
 private:
-    // ToF sensor variables with exponential smoothing 
-    // to handle unreliable sensors
-    Smoothed<float> TOFsensor1;        // Front sensor smoothing
-    Smoothed<float> TOFsensor2;        // Back sensor smoothing
-    float TOFsensorFront = 0;          // Cached front distance
-    float TOFsensorBack = 0;           // Cached back distance
-    unsigned char i2c_rx_buf[16];      // I2C reading buffer
-    unsigned short lenth_val = 0;      // Current distance value
+    // "d" handling time since the last "d/t", in CPU cycles
+    struct RequestStats {
+        uint32_t requests;
+        uint32_t maxCycles;
+        uint64_t totalCycles;
+    };
+
+    SensorSnapshot snapshot;
+    RequestStats requestStats;
 
     // Light sensor state tracking
-    unsigned long lastLightCheckTime = 0;
+    uint32_t seenLightSamples = 0;
     bool isInDarkness = false;
     bool previousDarknessState = false;
 
-    // Collision detection with enhanced validation
-    unsigned long lastCollisionCheckTime = 0;
-    bool collisionMessageSent = false;
-
-    // IR edge detection with adjustable thresholds
-    int IR_THRESHOLD_LEFT = 15;         // Left sensor threshold
-    int IR_THRESHOLD_RIGHT = 15;        // Right sensor threshold
-    unsigned long lastIRCheckTime = 0;
-    bool isEdgeDetectedIR = false;
-    Smoothed<float> smoothedIRLeft;     // IR value smoothing
-    Smoothed<float> smoothedIRRight;    // IR value smoothing
-
     // Hardware interface references
-    USBSerial_BigBuffer& userial;       // Serial communication
+    PlaydateLink& link;                 // Playdate messages
     AnimationManager& animationManager;  // Animation control
     DRV8835MotorShield& motors;         // Motor control
     WS2812FX& ws2812fx;                 // LED control
-    PCA9540BD& mux;                     // ToF multiplexer
-    Encoder& encoderLeft;               // Left wheel encoder
-    Encoder& encoderRight;              // Right wheel encoder
+    AsyncI2C& i2cBus;                   // Shared I2C bus
+    TofSampler& tofSampler;             // Background ToF reads behind the mux
+    AdcSampler& adc;                    // Background IR and light conversions
+    SampleBus& sampleBus;               // Timestamped sensor samples
     BatteryManager& batteryManager;     // Battery monitoring
     DistanceTracker& distanceTracker;   // Distance tracking
 
-    // Read raw data from ToF sensor via I2C
-    void SensorRead(unsigned char addr, unsigned char* datbuf, unsigned char cnt) {
-        Wire.beginTransmission(82);
-        Wire.write(byte(addr));
-        Wire.endTransmission();
-        Wire.requestFrom((uint8_t)82, (uint8_t)cnt);
-        if (cnt <= Wire.available()) {
-            *datbuf++ = Wire.read();
-            *datbuf++ = Wire.read();
-        }
+    // Age of a snapshot field in ms, -1 before its first sample
+    long fieldAge(SnapshotField field, uint32_t time, uint32_t now) const {
+        if (!(snapshot.fields & field)) return -1;
+        return (long)((now - time) / 1000);
     }
 
-    // Convert raw ToF data to distance value
-    int ReadDistance() {
-        SensorRead(0x00, i2c_rx_buf, 2);
-        lenth_val = i2c_rx_buf[0];
-        lenth_val = lenth_val << 8;
-        lenth_val |= i2c_rx_buf[1];
-        return lenth_val;
+    // Binary form of "msg d/...", BINARY_TYPE_SENSOR_DATA in BinaryProtocol.h
+    void sendSensorDataFrame(const long* ages) {
+        uint8_t payload[BINARY_SENSOR_DATA_LENGTH];
+        BinaryWriter writer(payload, sizeof(payload));
+        writer.putI16(snapshot.irRight);
+        writer.putI16(snapshot.irLeft);
+        writer.putU16(lroundf(snapshot.tof[0]));
+        writer.putU16(lroundf(snapshot.tof[1]));
+        writer.putI32(snapshot.encRight);
+        writer.putI32(snapshot.encLeft);
+        writer.putU16(snapshot.light);
+        writer.putU16(lroundf(snapshot.batteryVoltage * 1000));
+        writer.putU8(snapshot.charging ? 1 : 0);
+        writer.putU32(lroundf(snapshot.distanceMeters * 1000));
+        for (uint8_t i = 0; i < 6; i++) {
+            writer.putU16(ages[i] < 0 ? BINARY_AGE_NONE : ages[i] >= BINARY_AGE_NONE ? BINARY_AGE_NONE - 1 : ages[i]);
+        }
+        link.sendFrame(BINARY_TYPE_SENSOR_DATA, payload, writer.length);
     }
 
 public:
     // Initialize manager with hardware references
-    SensorManager(USBSerial_BigBuffer& serial, AnimationManager& anim, 
-                 DRV8835MotorShield& mot, WS2812FX& led, PCA9540BD& multiplexer,
-                 Encoder& encLeft, Encoder& encRight,
-                 BatteryManager& battery, DistanceTracker& distance)
-        : userial(serial)
+    SensorManager(PlaydateLink& playdate, AnimationManager& anim, 
+                 DRV8835MotorShield& mot, WS2812FX& led, AsyncI2C& i2c, TofSampler& tof, AdcSampler& adcSampler,
+                 SampleBus& bus, BatteryManager& battery, DistanceTracker& distance)
+        : link(playdate)
         , animationManager(anim)
         , motors(mot)
         , ws2812fx(led)
-        , mux(multiplexer)
-        , encoderLeft(encLeft)
-        , encoderRight(encRight)
+        , i2cBus(i2c)
+        , tofSampler(tof)
+        , adc(adcSampler)
+        , sampleBus(bus)
         , batteryManager(battery)
         , distanceTracker(distance) {
-        // Configure smoothing filters
-        smoothedIRLeft.begin(SMOOTHED_EXPONENTIAL, 1000);
-        smoothedIRRight.begin(SMOOTHED_EXPONENTIAL, 1000);
-        TOFsensor1.begin(SMOOTHED_EXPONENTIAL, 2);    // Increased smoothing for unreliable ToF
-        TOFsensor2.begin(SMOOTHED_EXPONENTIAL, 2);
+        memset(&snapshot, 0, sizeof(snapshot));
+        memset(&requestStats, 0, sizeof(requestStats));
     }
 
     // Initialize sensor hardware
     void initialize() {
         pinMode(IR_SENSOR_RIGHT_PIN, INPUT_DISABLE);
         pinMode(IR_SENSOR_LEFT_PIN, INPUT_DISABLE);
+        adc.begin();
         DEBUG_PRINT(DEBUG_INFO, "IR sensors initialized");
 
         Wire.begin();
+        i2cBus.begin();
         DEBUG_PRINT(DEBUG_INFO, "ToF sensors initialized");
     }
 
-    // Read distance from specific ToF sensor
-    // Includes caching for reliability
-    float readTofSensor(int channel) {
-        mux.selectChannel(channel);
-        float rawDistance = ReadDistance();
-        
-        if (rawDistance > 0) {
-            if (channel == FRONT_SENSOR) {
-                TOFsensorFront = rawDistance;
-                return TOFsensorFront;
-            } else {
-                TOFsensorBack = rawDistance;
-                return TOFsensorBack;
-            }
-        }
-        
-        return (channel == FRONT_SENSOR) ? TOFsensorFront : TOFsensorBack;
+    // Keep the background ToF reads going - called in main loop
+    void updateTofSampling() {
+        tofSampler.update();
     }
 
-    // Read averaged IR sensor values
-    int readIRSensor(int sensorPin) {
-        long sum = 0;
-        const int numReadings = 10;
-        
-        for (int i = 0; i < numReadings; i++) {
-            sum += analogRead(sensorPin);
+    // Copy the newest sample bus values into the "d" snapshot - called in main loop
+    // ToF readings of 0 (no echo) keep the previous distance.
+    void updateSnapshot() {
+        TimedSample<IrReading> ir;
+        if (sampleBus.ir().latest(ir)) {
+            snapshot.irRight = ir.value.right;
+            snapshot.irLeft = ir.value.left;
+            snapshot.irTime = ir.timestamp;
+            snapshot.fields |= FIELD_IR;
+        }
+        for (uint8_t sensor = 0; sensor < 2; sensor++) {
+            uint8_t channel = sensor == 0 ? FRONT_SENSOR : BACK_SENSOR;
+            TimedSample<uint16_t> tof;
+            if (sampleBus.tof(channel).latest(tof) && tof.value > 0) {
+                snapshot.tof[sensor] = tof.value;
+                snapshot.tofTime[sensor] = tof.timestamp;
+                snapshot.fields |= sensor == 0 ? FIELD_TOF_FRONT : FIELD_TOF_BACK;
+            }
+        }
+        TimedSample<EncoderReading> encoders;
+        if (sampleBus.encoders().latest(encoders)) {
+            snapshot.encRight = encoders.value.right;
+            snapshot.encLeft = encoders.value.left;
+            snapshot.encoderTime = encoders.timestamp;
+            snapshot.fields |= FIELD_ENCODERS;
+        }
+        TimedSample<uint16_t> light;
+        if (sampleBus.light().latest(light)) {
+            snapshot.light = light.value;
+            snapshot.lightTime = light.timestamp;
+            snapshot.fields |= FIELD_LIGHT;
+        }
+        TimedSample<BatteryReading> battery;
+        if (sampleBus.battery().latest(battery)) {
+            snapshot.batteryVoltage = battery.value.voltage;
+            snapshot.batteryPercent = battery.value.percent;
+            snapshot.batteryTime = battery.timestamp;
+            snapshot.fields |= FIELD_BATTERY;
         }
-        return sum / numReadings;
+        snapshot.charging = batteryManager.isCharging();
+        snapshot.distanceMeters = distanceTracker.getDistanceMeters();
     }
 
-    // Monitor ambient light changes
+    // Monitor ambient light changes on each new light sample
     void checkLightSensor() {
-        unsigned long currentTime = millis();
-        if (currentTime - lastLightCheckTime >= LIGHT_CHECK_INTERVAL) {
-            int lightValue = analogRead(LIGHT_SENSOR_PIN);
+        TimedSample<uint16_t> sample;
+        if (sampleBus.light().takeLatest(seenLightSamples, sample)) {
+            int lightValue = sample.value;
             bool currentDarknessState = (lightValue < DARKNESS_THRESHOLD);
             
             if (currentDarknessState != previousDarknessState) {
                 isInDarkness = currentDarknessState;
-                userial.println(isInDarkness ? "msg l/0" : "msg l/1");
+                link.println(isInDarkness ? "msg l/0" : "msg l/1");
                 previousDarknessState = isInDarkness;
-                DEBUG_PRINT(DEBUG_VERBOSE, "Light state changed. Is in darkness: " + String(isInDarkness));
+                DEBUG_PRINT(DEBUG_VERBOSE, "Light state changed. Is in darkness: %d", isInDarkness);
             }
             
-            lastLightCheckTime = currentTime;
             ws2812fx.setBrightness(isInDarkness ? 50 : 10);
         }
     }
 
-    // Detect table edges using IR sensors
-    void detectTableEdgeIR() {
-        unsigned long currentTime = millis();
-        if (currentTime - lastIRCheckTime >= IR_CHECK_INTERVAL) {
-            float sensorLeftValue = readIRSensor(IR_SENSOR_LEFT_PIN);
-            float sensorRightValue = readIRSensor(IR_SENSOR_RIGHT_PIN);
-            
-            bool currentEdgeDetected = (sensorLeftValue >= IR_THRESHOLD_LEFT || 
-                                      sensorRightValue >= IR_THRESHOLD_RIGHT);
-            
-            if (currentEdgeDetected != isEdgeDetectedIR) {
-                isEdgeDetectedIR = currentEdgeDetected;
-                
-                if (isEdgeDetectedIR) {
-                    animationManager.stopAnimation();
-                    motors.setM1Speed(0);
-                    motors.setM2Speed(0);
-                    userial.println("msg e/1");
-                    DEBUG_PRINT(DEBUG_INFO, "Edge detected by IR sensors. Left: " + 
-                              String(sensorLeftValue) + ", Right: " + String(sensorRightValue));
-                }
-            }
-            
-            lastIRCheckTime = currentTime;
+    // Send the sensor snapshot to Playdate, only formatting and writing happen here
+    // Binary protocol: a BINARY_TYPE_SENSOR_DATA frame with the same values
+    // Format: "msg d/irRight/irLeft/tofFront/tofBack/encRight/encLeft/light/batteryVoltage/charging/distanceM/
+    //          irAge/tofFrontAge/tofBackAge/encoderAge/lightAge/batteryAge", ages in ms, -1 before the first sample
+    void sendSensorData() {
+        uint32_t startCycles = ARM_DWT_CYCCNT;
+        uint32_t now = micros();
+        long ages[6] = {
+            fieldAge(FIELD_IR, snapshot.irTime, now), fieldAge(FIELD_TOF_FRONT, snapshot.tofTime[0], now),
+            fieldAge(FIELD_TOF_BACK, snapshot.tofTime[1], now), fieldAge(FIELD_ENCODERS, snapshot.encoderTime, now),
+            fieldAge(FIELD_LIGHT, snapshot.lightTime, now), fieldAge(FIELD_BATTERY, snapshot.batteryTime, now)
+        };
+
+        if (link.isBinary()) {
+            sendSensorDataFrame(ages);
+        } else {
+            char buffer[160];
+            snprintf(buffer, sizeof(buffer),
+                    "msg d/%d/%d/%.2f/%.2f/%ld/%ld/%d/%.2f/%d/%.2f/%ld/%ld/%ld/%ld/%ld/%ld",
+                    snapshot.irRight, snapshot.irLeft, snapshot.tof[0], snapshot.tof[1],
+                    (long)snapshot.encRight, (long)snapshot.encLeft, snapshot.light,
+                    snapshot.batteryVoltage, snapshot.charging ? 1 : 0, snapshot.distanceMeters,
+                    ages[0], ages[1], ages[2], ages[3], ages[4], ages[5]);
+            link.println(buffer);
+            DEBUG_PRINT(DEBUG_VERBOSE, "Sent sensor data: %s", buffer);
         }
+
+        uint32_t cycles = ARM_DWT_CYCCNT - startCycles;
+        requestStats.requests++;
+        requestStats.totalCycles += cycles;
+        if (cycles > requestStats.maxCycles) requestStats.maxCycles = cycles;
     }
 
-    // Check for front collisions with enhanced ToF validation
-    // Uses multiple readings and threshold to handle unreliable sensors --> slow :(, V2 will use an array of IR sensors 
-    void checkFrontCollision() {
-        unsigned long currentTime = millis();
-        if (currentTime - lastCollisionCheckTime >= COLLISION_CHECK_INTERVAL) {
-            float frontDistance = readTofSensor(FRONT_SENSOR);
-            
-            // Strict range validation to filter void detections
-            if (frontDistance > 0 && frontDistance < 1800) {
-                TOFsensor2.add(frontDistance);
-                float smoothedFrontDistance = TOFsensor2.get();
-                
-                static uint8_t collisionCount = 0;
-                static uint8_t validationThreshold = 30;  // Increased for reliability
-                
-                if (smoothedFrontDistance < FRONT_COLLISION_THRESHOLD) {
-                    collisionCount++;
-                    if (collisionCount >= validationThreshold && !collisionMessageSent) {
-                        userial.println("msg w/1");
-                        collisionMessageSent = true;
-                        DEBUG_PRINT(DEBUG_INFO, "Front collision validated. Distance: " + 
-                                  String(smoothedFrontDistance) + "mm, Raw: " + 
-                                  String(frontDistance) + "mm");
-                    }
-                } else {
-                    collisionCount = 0;
-                    collisionMessageSent = false;
-                }
-            }
-            
-            lastCollisionCheckTime = currentTime;
-        }
+    // Send the "d" handling time since the last request to Playdate
+    // Format: "msg d/t/requests/maxUs/avgUs", formatting and write of each response
+    void sendSensorDataStats() {
+        uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+        uint32_t avgNanos = requestStats.requests > 0
+            ? (uint32_t)(requestStats.totalCycles * 1000 / cyclesPerMicro / requestStats.requests) : 0;
+
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "msg d/t/%lu/%lu/%lu.%03lu",
+                 (unsigned long)requestStats.requests,
+                 (unsigned long)(requestStats.maxCycles / cyclesPerMicro),
+                 (unsigned long)(avgNanos / 1000), (unsigned long)(avgNanos % 1000));
+        link.println(buffer);
+        memset(&requestStats, 0, sizeof(requestStats));
     }
 
-    // Send complete sensor data package to Playdate
-    void sendSensorData() {
-        int irRight = readIRSensor(IR_SENSOR_RIGHT_PIN);
-        int irLeft = readIRSensor(IR_SENSOR_LEFT_PIN);
-        float tofFront = readTofSensor(FRONT_SENSOR);
-        Wire.flush(); // Clear I2C bus
-        float tofBack = readTofSensor(BACK_SENSOR);
-        long encRight = encoderRight.read();
-        long encLeft = encoderLeft.read();
-        int lightValue = analogRead(LIGHT_SENSOR_PIN);
-        float batteryVoltage = batteryManager.getVoltage();
-        float distanceInMeters = distanceTracker.getDistanceMeters();
-
-        char buffer[120];
-        snprintf(buffer, sizeof(buffer), 
-                "msg d/%d/%d/%.2f/%.2f/%ld/%ld/%d/%.2f/%d/%.2f", 
-                irRight, irLeft, tofFront, tofBack, encRight, encLeft, lightValue, 
-                batteryVoltage, batteryManager.isCharging() ? 1 : 0, distanceInMeters);
-        userial.println(buffer);
-        DEBUG_PRINT(DEBUG_INFO, "Sent sensor data with distance: " + String(buffer));
+    // Send I2C statistics since the last request to Playdate
+    // Format: "msg i/transactions/nacks/arbitrationLost/busErrors/timeouts/failedReads/maxLatencyUs/avgLatencyUs"
+    void sendI2CStats() {
+        AsyncI2C::Stats stats = i2cBus.takeStats();
+        uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+        uint32_t avgLatency = stats.transactions > 0
+            ? (uint32_t)(stats.totalLatency / stats.transactions / cyclesPerMicro) : 0;
+
+        char buffer[100];
+        snprintf(buffer, sizeof(buffer), "msg i/%lu/%lu/%lu/%lu/%lu/%lu/%lu/%lu",
+                 (unsigned long)stats.transactions, (unsigned long)stats.nacks,
+                 (unsigned long)stats.arbitrationLost, (unsigned long)stats.busErrors,
+                 (unsigned long)stats.timeouts, (unsigned long)tofSampler.getFailedReads(),
+                 (unsigned long)(stats.maxLatency / cyclesPerMicro), (unsigned long)avgLatency);
+        link.println(buffer);
+        DEBUG_PRINT(DEBUG_INFO, "I2C stats: %s", buffer);
     }
 
     // Get current sensor states
-    float getTOFSensorFront() const { return TOFsensorFront; }
-    float getTOFSensorBack() const { return TOFsensorBack; }
+    const SensorSnapshot& getSnapshot() const { return snapshot; }
+    float getTOFSensorFront() const { return snapshot.tof[0]; }
+    float getTOFSensorBack() const { return snapshot.tof[1]; }
     bool getIsInDarkness() const { return isInDarkness; }
 };
 
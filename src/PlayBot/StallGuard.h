@@ -0,0 +1,131 @@
+// StallGuard.h
+#ifndef STALL_GUARD_H
+#define STALL_GUARD_H
+
+#include "Config.h"
+#include <math.h>
+#include <stdint.h>
+
+// Stall detection and drive limiting of one wheel
+// Over a sliding window of STALL_WINDOW_MS, split in STALL_WINDOW_SLOTS
+// slots, the mean motor command is compared with the wheel speed measured
+// on the encoder. A wheel driven with STALL_MIN_COMMAND or more on average
+// that turns slower than STALL_MAX_SPEED is blocked: its command is limited
+// to STALL_BACKOFF_COMMAND for STALL_BACKOFF_MS, enough to keep pushing
+// gently or to back away. If it has not moved again by then, the drive is
+// cut for STALL_CUT_MS before full commands are allowed again and a fresh
+// window has to fill before the next detection.
+// Called by the control loop every CONTROL_PERIOD_US, the window is only
+// evaluated once per slot.
+class StallGuard {
+public:
+    enum State : uint8_t {
+        STALL_NONE,                   // Commands passed through
+        STALL_LIMITED,                // Blocked, command limited to STALL_BACKOFF_COMMAND
+        STALL_CUT                     // Still blocked after the back off, no drive
+    };
+
+private:
+    static const uint32_t slotTicks = (uint32_t)STALL_WINDOW_MS * 1000 / CONTROL_PERIOD_US / STALL_WINDOW_SLOTS;
+    static const uint32_t backoffTicks = (uint32_t)STALL_BACKOFF_MS * 1000 / CONTROL_PERIOD_US;
+    static const uint32_t cutTicks = (uint32_t)STALL_CUT_MS * 1000 / CONTROL_PERIOD_US;
+    static constexpr float windowSeconds = (float)slotTicks * STALL_WINDOW_SLOTS * CONTROL_PERIOD_US / 1000000.0f;
+
+    int32_t positions[STALL_WINDOW_SLOTS]; // Encoder count at each of the last slot ends
+    float commands[STALL_WINDOW_SLOTS];   // Sum of |command| over each of the last slots
+    uint8_t slot;                 // Ring entry written at the next slot end
+    uint8_t filled;               // Slot ends stored since the window was cleared
+    uint32_t slotElapsed;         // Control periods into the current slot
+    float slotCommand;            // Sum of |command| in the current slot
+    State state;
+    uint32_t stateTicks;          // Control periods since the state was entered
+    float lastSpeed;              // Wheel speed over the last full window (ticks/s)
+
+    void enter(State next) {
+        state = next;
+        stateTicks = 0;
+    }
+
+    // Store the slot that just ended and check the window
+    void closeSlot(int32_t count) {
+        int32_t oldest = positions[slot];
+        positions[slot] = count;
+        commands[slot] = slotCommand;
+        slot = (slot + 1) % STALL_WINDOW_SLOTS;
+        slotElapsed = 0;
+        slotCommand = 0;
+        if (filled < STALL_WINDOW_SLOTS) {
+            filled++;
+            return;
+        }
+
+        float commandSum = 0;
+        for (uint8_t i = 0; i < STALL_WINDOW_SLOTS; i++) commandSum += commands[i];
+        float meanCommand = commandSum / (slotTicks * STALL_WINDOW_SLOTS);
+        lastSpeed = (count - oldest) / windowSeconds;
+        bool moving = fabsf(lastSpeed) >= STALL_MAX_SPEED;
+
+        if (state == STALL_NONE && !moving && meanCommand >= STALL_MIN_COMMAND) {
+            enter(STALL_LIMITED);
+        } else if (state == STALL_LIMITED && moving) {
+            enter(STALL_NONE);
+        }
+    }
+
+public:
+    StallGuard() {
+        reset();
+    }
+
+    // Forget the window and release any limit
+    void reset() {
+        for (uint8_t i = 0; i < STALL_WINDOW_SLOTS; i++) {
+            positions[i] = 0;
+            commands[i] = 0;
+        }
+        slot = 0;
+        restartWindow();
+        state = STALL_NONE;
+        stateTicks = 0;
+        lastSpeed = 0;
+    }
+
+    // Fill a new window before the next check, the current limit stays
+    // For encoder counts that jumped, which would read as travel
+    void restartWindow() {
+        filled = 0;
+        slotElapsed = 0;
+        slotCommand = 0;
+    }
+
+    // One control period: the command wanted for the wheel and its encoder count,
+    // returns the command to apply
+    float update(float command, int32_t count) {
+        stateTicks++;
+        if (state == STALL_LIMITED && stateTicks >= backoffTicks) {
+            enter(STALL_CUT);
+        } else if (state == STALL_CUT && stateTicks >= cutTicks) {
+            enter(STALL_NONE);
+            restartWindow();
+        }
+
+        // The window averages the drive the motor can actually get
+        float applied = fmaxf(-MOTOR_COMMAND_LIMIT, fminf(command, MOTOR_COMMAND_LIMIT));
+        if (state == STALL_CUT) {
+            applied = 0;
+        } else if (state == STALL_LIMITED) {
+            applied = fmaxf(-STALL_BACKOFF_COMMAND, fminf(command, STALL_BACKOFF_COMMAND));
+        }
+
+        slotCommand += fabsf(applied);
+        if (++slotElapsed >= slotTicks) closeSlot(count);
+        return applied;
+    }
+
+    State getState() const { return state; }
+
+    // Wheel speed over the last full window (ticks/s)
+    float getSpeed() const { return lastSpeed; }
+};
+
+#endif // STALL_GUARD_H
@@ -4,16 +4,22 @@
 
 #include "Config.h"
 #include "Debug.h"
+#include "AnimationIndex.h"
+#include "Feedforward.h"
 #include <SD.h>
 
 // Manages SD card storage for robot animations and data
 // The SD card stores:
 // - Animation files (loaded when Playdate sends "a/filepath")
 // - Distance logs (updated periodically by DistanceTracker)
+// - Animation index (rebuilt at boot, see AnimationIndex)
+// - Wheel PID gains found by the autotune (PID_GAINS_FILE)
+// - Motor responses measured by the calibration (FEEDFORWARD_FILE)
 // Initialization failure will trigger error message to Playdate
 class StorageManager {
 private:
     bool isInitialized;   // Tracks if SD card is ready for use
+    AnimationIndex animationIndex; // Animations found on the card
 
 public:
     // Constructor - Sets initial state
@@ -37,6 +43,7 @@ public:
             // Card successfully initialized
             DEBUG_PRINT(DEBUG_INFO, "SD card initialized");
             isInitialized = true;
+            animationIndex.build();
             return true;
         }
     }
@@ -45,7 +52,183 @@ public:
     // Used by AnimationManager before file operations
     bool isReady() const { return isInitialized; }
 
+    // Check an animation path against the index before playing it
+    // Rejects missing or malformed files without touching the card
+    bool isAnimationPlayable(const char* path) const {
+        return animationIndex.isPlayable(path);
+    }
+
+    // Look up an indexed animation, nullptr if unknown
+    const AnimationIndex::Entry* findAnimation(const char* path) const {
+        return animationIndex.find(path);
+    }
+
+    // Send the list of playable animations to Playdate
+    // Called when Playdate sends "n" message
+    void sendAnimationList() const {
+        animationIndex.sendList();
+    }
+
+    // Load the per-wheel PID gains saved by the autotune
+    // gains[0] is the right wheel and gains[1] the left wheel, a wheel
+    // missing from the file keeps the gains passed in
+    // Returns true if at least one wheel was loaded
+    bool loadWheelGains(WheelGains gains[2]) {
+        if (!isInitialized || !SD.exists(PID_GAINS_FILE)) return false;
+        File gainsFile = SD.open(PID_GAINS_FILE, FILE_READ);
+        if (!gainsFile) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to open PID gains file");
+            return false;
+        }
+
+        bool loaded = false;
+        char line[64];
+        while (gainsFile.available()) {
+            size_t length = gainsFile.readBytesUntil('\n', line, sizeof(line) - 1);
+            line[length] = '\0';
+            char* values = strchr(line, '/');
+            if (values == NULL) continue;
+            *values++ = '\0';
+            for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                if (strcmp(line, wheelNames[wheel]) == 0 && parseGains(values, gains[wheel])) {
+                    loaded = true;
+                }
+            }
+        }
+        gainsFile.close();
+        if (!loaded) DEBUG_PRINT(DEBUG_WARNING, "No valid gains in %s", PID_GAINS_FILE);
+        return loaded;
+    }
+
+    // Save the per-wheel PID gains, same order as loadWheelGains()
+    // Format: one "wheel/kP/kI/kD" line per wheel, e.g. "right/5/0.1/0.025"
+    bool saveWheelGains(const WheelGains gains[2]) {
+        if (!isInitialized) return false;
+        File gainsFile = SD.open(PID_GAINS_FILE, FILE_WRITE);
+        if (!gainsFile) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to open PID gains file");
+            return false;
+        }
+        gainsFile.seek(0);
+        gainsFile.truncate();
+        char line[64];
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            snprintf(line, sizeof(line), "%s/%.6g/%.6g/%.6g", wheelNames[wheel],
+                     gains[wheel].kP, gains[wheel].kI, gains[wheel].kD);
+            gainsFile.println(line);
+        }
+        gainsFile.close();
+        DEBUG_PRINT(DEBUG_INFO, "PID gains saved to %s", PID_GAINS_FILE);
+        return true;
+    }
+
+    // Load the motor responses saved by the calibration, indexed
+    // [wheel][direction] like FeedforwardTable
+    // Returns true only if all four curves were found and valid
+    bool loadMotorResponses(MotorResponse responses[2][2]) {
+        if (!isInitialized || !SD.exists(FEEDFORWARD_FILE)) return false;
+        File responseFile = SD.open(FEEDFORWARD_FILE, FILE_READ);
+        if (!responseFile) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to open feedforward file");
+            return false;
+        }
+
+        bool found[2][2] = {{false, false}, {false, false}};
+        char line[FEEDFORWARD_POINTS * 10 + 32];
+        while (responseFile.available()) {
+            size_t length = responseFile.readBytesUntil('\n', line, sizeof(line) - 1);
+            line[length] = '\0';
+            char* direction = strchr(line, '/');
+            if (direction == NULL) continue;
+            *direction++ = '\0';
+            char* values = strchr(direction, '/');
+            if (values == NULL) continue;
+            *values++ = '\0';
+            for (uint8_t wheel = 0; wheel < 2; wheel++) {
+                for (uint8_t dir = 0; dir < 2; dir++) {
+                    if (strcmp(line, wheelNames[wheel]) == 0 && strcmp(direction, directionNames[dir]) == 0 &&
+                        parseResponse(values, responses[wheel][dir])) {
+                        found[wheel][dir] = true;
+                    }
+                }
+            }
+        }
+        responseFile.close();
+
+        bool complete = found[0][0] && found[0][1] && found[1][0] && found[1][1];
+        if (!complete) DEBUG_PRINT(DEBUG_WARNING, "Incomplete motor calibration in %s", FEEDFORWARD_FILE);
+        return complete;
+    }
+
+    // Save the motor responses, same order as loadMotorResponses()
+    // Format: one "wheel/direction/deadband/speed1/.../speedN" line per curve,
+    // e.g. "right/forward/42/0/310/620/..."
+    bool saveMotorResponses(const MotorResponse responses[2][2]) {
+        if (!isInitialized) return false;
+        File responseFile = SD.open(FEEDFORWARD_FILE, FILE_WRITE);
+        if (!responseFile) {
+            DEBUG_PRINT(DEBUG_WARNING, "Failed to open feedforward file");
+            return false;
+        }
+        responseFile.seek(0);
+        responseFile.truncate();
+        char value[16];
+        for (uint8_t wheel = 0; wheel < 2; wheel++) {
+            for (uint8_t dir = 0; dir < 2; dir++) {
+                const MotorResponse& response = responses[wheel][dir];
+                responseFile.print(wheelNames[wheel]);
+                responseFile.print('/');
+                responseFile.print(directionNames[dir]);
+                snprintf(value, sizeof(value), "/%.1f", response.deadband);
+                responseFile.print(value);
+                for (uint8_t i = 0; i < FEEDFORWARD_POINTS; i++) {
+                    snprintf(value, sizeof(value), "/%.0f", response.velocity[i]);
+                    responseFile.print(value);
+                }
+                responseFile.println();
+            }
+        }
+        responseFile.close();
+        DEBUG_PRINT(DEBUG_INFO, "Motor calibration saved to %s", FEEDFORWARD_FILE);
+        return true;
+    }
+
+private:
+    inline static const char* const wheelNames[2] = {"right", "left"};
+    inline static const char* const directionNames[2] = {"forward", "backward"};
 
+    // Parse "deadband/speed1/.../speedN", response untouched unless every value is valid
+    static bool parseResponse(const char* text, MotorResponse& response) {
+        float values[FEEDFORWARD_POINTS + 1];
+        for (uint8_t i = 0; i <= FEEDFORWARD_POINTS; i++) {
+            char* end;
+            values[i] = strtof(text, &end);
+            if (end == text || !isfinite(values[i]) || values[i] < 0) return false;
+            if (i < FEEDFORWARD_POINTS && *end != '/') return false;
+            text = end + 1;
+        }
+        response.deadband = values[0];
+        for (uint8_t i = 0; i < FEEDFORWARD_POINTS; i++) {
+            response.velocity[i] = values[i + 1];
+        }
+        return true;
+    }
+
+    // Parse "kP/kI/kD", gains are left untouched unless all three are valid
+    static bool parseGains(const char* text, WheelGains& gains) {
+        float values[3];
+        for (uint8_t i = 0; i < 3; i++) {
+            char* end;
+            values[i] = strtof(text, &end);
+            if (end == text || !isfinite(values[i]) || values[i] < 0) return false;
+            if (i < 2 && *end != '/') return false;
+            text = end + 1;
+        }
+        gains.kP = values[0];
+        gains.kI = values[1];
+        gains.kD = values[2];
+        return true;
+    }
 };
 
 #endif // STORAGE_MANAGER_H
\ No newline at end of file
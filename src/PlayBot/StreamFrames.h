@@ -0,0 +1,118 @@
+// StreamFrames.h
+#ifndef STREAM_FRAMES_H
+#define STREAM_FRAMES_H
+
+#include "AnimationFormat.h"
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Parser of the frames streamed by the Playdate in the text protocol
+// Format: "k/head/right/left;head/right/left;..."
+// A read window may hold several "k/" messages back to back, every frame
+// ends with ';' so partial frames are never played. A read may end inside
+// a message: the next read goes on with its frames, and the start of a
+// frame cut by the end of a read is parsed with the next read; a
+// malformed frame, or one longer than MaxFrameBytes, is skipped and its
+// credit given back. Frames go to a sink with pushStreamFrame(frame) and
+// dropStreamFrame() (AnimationManager on the robot).
+// This header is shared by the firmware and tools/StreamLoopback, so it
+// must only depend on the C standard headers.
+template <size_t MaxFrameBytes>
+class StreamFrameParser {
+private:
+    char tail[MaxFrameBytes + 2]; // Start of a frame cut by the end of a read, "k/" included
+    uint8_t tailLength;
+    bool skipping;                // Rest of a cut frame too long to be one, skipped up to its ';'
+    bool inMessage;               // Read ended between two frames of a "k/" message
+
+    static int16_t clampValue(long value) {
+        return value < INT16_MIN ? INT16_MIN : value > INT16_MAX ? INT16_MAX : (int16_t)value;
+    }
+
+public:
+    StreamFrameParser()
+        : tailLength(0)
+        , skipping(false)
+        , inMessage(false) {
+    }
+
+    // Forget a cut frame, called when the stream or the protocol changes
+    void reset() {
+        tailLength = 0;
+        skipping = false;
+        inMessage = false;
+    }
+
+    // True when the next read continues the frames of the previous one
+    bool isPending() const { return tailLength > 0 || skipping || inMessage; }
+
+    // Copy the kept start of a cut frame to buffer, the next read goes after it
+    // Returns its length
+    size_t takeTail(char* buffer) {
+        size_t length = tailLength;
+        memcpy(buffer, tail, length);
+        tailLength = 0;
+        return length;
+    }
+
+    // Parse the frames in buffer (NUL terminated) and hand them to sink
+    // Returns the start of another command read along with the frames, NULL if none
+    template <class Sink>
+    char* parse(char* buffer, Sink& sink) {
+        char* ptr = buffer;
+        inMessage = false;
+        if (skipping) {
+            while (*ptr && *ptr != ';') ptr++;
+            if (!*ptr) return NULL;      // Still inside the frame
+            ptr++;
+            skipping = false;
+            sink.dropStreamFrame();
+        }
+        while (true) {
+            // Line endings between messages, a read may start with one
+            while (*ptr == '\r' || *ptr == '\n') ptr++;
+            if (!*ptr) {
+                // The next frames of the message come without "k/"
+                inMessage = ptr > buffer && ptr[-1] == ';';
+                break;
+            }
+            if (isalpha(*ptr) && *ptr != 'k') return ptr;
+            char* frameStart = ptr;
+            if (ptr[0] == 'k' && ptr[1] == '/') ptr += 2;
+
+            long head, wheelRight, wheelLeft;
+            int consumed = 0;
+            if (sscanf(ptr, "%ld/%ld/%ld;%n", &head, &wheelRight, &wheelLeft, &consumed) == 3 &&
+                consumed > 0) {
+                AnimationFrame frame;
+                frame.head = clampValue(head);
+                frame.wheelRight = clampValue(wheelRight);
+                frame.wheelLeft = clampValue(wheelLeft);
+                sink.pushStreamFrame(frame);
+                ptr += consumed;
+            } else {
+                // Skip a malformed frame, or keep the start of one cut by the end of this read
+                while (*ptr && *ptr != ';') ptr++;
+                if (*ptr) {
+                    ptr++;
+                    sink.dropStreamFrame();
+                } else if (ptr != frameStart) {
+                    // Completed by the next read, or skipped up to its ';' if already too long
+                    size_t length = ptr - frameStart;
+                    if (length < sizeof(tail)) {
+                        memcpy(tail, frameStart, length);
+                        tailLength = length;
+                    } else {
+                        skipping = true;
+                    }
+                }
+            }
+        }
+        return NULL;
+    }
+};
+
+#endif // STREAM_FRAMES_H
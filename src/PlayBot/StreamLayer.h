@@ -0,0 +1,225 @@
+// StreamLayer.h
+#ifndef STREAM_LAYER_H
+#define STREAM_LAYER_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "AnimationFormat.h"
+
+// Animation layer fed with frames streamed by the Playdate over USB
+// Lets the Playdate play generated or procedural motion without any file
+// on the SD card. Frames are buffered in a small jitter buffer and played
+// at the stream frame rate, interpolated linearly like dense animations.
+// Flow control is credit based: the Playdate sends one frame per credit
+// and the Teensy grants credits ("msg k/n") as the buffer drains. Credits
+// in flight are capped so every frame the Playdate may send fits in the
+// 80-byte window read by CommunicationManager in one pass.
+// Underruns hold the last pose, playback resumes once the buffer has been
+// primed again. Malformed frames are dropped and give their credit back,
+// frames cut by the end of a read are completed by the next one
+// (StreamFrames.h). A stream that stays dry for STREAM_TIMEOUT_MS ends.
+// Frame values: head (µs, outside 500-2500 holds the head), right and left
+// wheel targets in encoder ticks relative to the stream start.
+class StreamLayer {
+private:
+    // Credits that fit in one read window, after the "k/" prefix
+    static const uint8_t MAX_CREDITS = (USB_READ_WINDOW - 2) / STREAM_FRAME_MAX_BYTES;
+
+    // Jitter buffer
+    AnimationFrame buffer[STREAM_BUFFER_FRAMES]; // Received frames waiting to play
+    uint8_t readIndex;            // Oldest buffered frame
+    uint8_t frameCount;           // Frames in the buffer
+    uint8_t creditsInFlight;      // Credits granted and not yet used by the Playdate
+    bool active;                  // Stream started
+    bool priming;                 // Waiting for STREAM_PREBUFFER_FRAMES before playing
+
+    // Playback, interpolating from the last played frame to the next one
+    AnimationFrame from;          // Frame being left
+    AnimationFrame to;            // Frame being approached
+    uint32_t fromMicros;          // Time of the frame being left
+    uint32_t frameMicros;         // Frame period (µs)
+    uint32_t dryMicros;           // Start of the current underrun
+    bool hasFrame;                // At least one frame has played
+
+    // Evaluated outputs
+    float values[ANIMATION_CHANNEL_COUNT]; // Latest channel values, origin included
+    float origin[ANIMATION_CHANNEL_COUNT]; // Offset added to wheel channels
+
+    // Statistics of current or last stream
+    uint32_t framesPlayed;        // Frames taken from the buffer
+    uint32_t underruns;           // Times the buffer ran dry while playing
+    uint32_t overruns;            // Frames received without room (credits not respected)
+    uint32_t lostFrames;          // Frames malformed or too long to parse
+
+    // Take the oldest frame from the buffer
+    AnimationFrame popFrame() {
+        AnimationFrame frame = buffer[readIndex];
+        readIndex = (readIndex + 1) % STREAM_BUFFER_FRAMES;
+        frameCount--;
+        framesPlayed++;
+        return frame;
+    }
+
+    // Grant the credits the buffer has room for
+    // Sends "msg k/n" with the number of new credits
+    void grantCredits() {
+        uint8_t room = STREAM_BUFFER_FRAMES - frameCount - creditsInFlight;
+        uint8_t window = MAX_CREDITS - creditsInFlight;
+        uint8_t credits = min(room, window);
+        if (credits == 0) return;
+
+        creditsInFlight += credits;
+        char message[16];
+        snprintf(message, sizeof(message), "msg k/%u", credits);
+        playdateLink.println(message);
+    }
+
+    // Evaluate the segment between the last two frames
+    void evaluateFrames(uint32_t nowMicros) {
+        float t = 1.0f;
+        uint32_t elapsed = nowMicros - fromMicros;
+        if (elapsed < frameMicros) t = (float)elapsed / frameMicros;
+
+        if (animationIsValidHead(to.head)) {
+            values[ANIMATION_TRACK_HEAD] = animationIsValidHead(from.head)
+                ? from.head + (to.head - from.head) * t
+                : to.head;
+        }
+        values[ANIMATION_TRACK_WHEEL_RIGHT] = origin[ANIMATION_TRACK_WHEEL_RIGHT] +
+            from.wheelRight + (to.wheelRight - from.wheelRight) * t;
+        values[ANIMATION_TRACK_WHEEL_LEFT] = origin[ANIMATION_TRACK_WHEEL_LEFT] +
+            from.wheelLeft + (to.wheelLeft - from.wheelLeft) * t;
+    }
+
+public:
+    StreamLayer()
+        : readIndex(0)
+        , frameCount(0)
+        , creditsInFlight(0)
+        , active(false)
+        , priming(false)
+        , fromMicros(0)
+        , frameMicros(1000000 / ANIMATION_DEFAULT_FRAME_RATE)
+        , dryMicros(0)
+        , hasFrame(false)
+        , framesPlayed(0)
+        , underruns(0)
+        , overruns(0)
+        , lostFrames(0) {
+        memset(&from, 0, sizeof(from));
+        memset(&to, 0, sizeof(to));
+        for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+            values[channel] = origin[channel] = 0;
+        }
+    }
+
+    // Start a stream at frameRate fps and grant the first credits
+    // wheelOrigin gives the wheel positions the stream is relative to
+    void start(uint8_t frameRate, float wheelOriginRight, float wheelOriginLeft) {
+        readIndex = frameCount = 0;
+        creditsInFlight = 0;
+        frameMicros = 1000000 / frameRate;
+        hasFrame = false;
+        priming = true;
+        dryMicros = micros();
+        framesPlayed = underruns = overruns = lostFrames = 0;
+        origin[ANIMATION_TRACK_HEAD] = 0;
+        origin[ANIMATION_TRACK_WHEEL_RIGHT] = wheelOriginRight;
+        origin[ANIMATION_TRACK_WHEEL_LEFT] = wheelOriginLeft;
+        active = true;
+        grantCredits();
+    }
+
+    // Stop the stream, later frames are ignored
+    void stop() {
+        if (active) {
+            DEBUG_PRINT(DEBUG_INFO, "Stream stats - Frames: %lu, Underruns: %lu, Overruns: %lu, Lost: %lu",
+                        (unsigned long)framesPlayed, (unsigned long)underruns,
+                        (unsigned long)overruns, (unsigned long)lostFrames);
+        }
+        active = false;
+        hasFrame = false;
+        readIndex = frameCount = 0;
+        creditsInFlight = 0;
+    }
+
+    // Queue a frame received from the Playdate
+    void pushFrame(const AnimationFrame& frame) {
+        if (!active) return;
+        if (creditsInFlight > 0) creditsInFlight--;
+        if (frameCount >= STREAM_BUFFER_FRAMES) {
+            overruns++;
+            return;
+        }
+        buffer[(readIndex + frameCount) % STREAM_BUFFER_FRAMES] = frame;
+        frameCount++;
+    }
+
+    // Give back the credit of a frame that could not be parsed
+    void dropFrame() {
+        if (!active) return;
+        if (creditsInFlight > 0) creditsInFlight--;
+        lostFrames++;
+    }
+
+    // Advance playback to the given time (micros() timestamp) and grant credits
+    // Returns false once the stream has timed out
+    bool update(uint32_t nowMicros) {
+        if (!active) return false;
+
+        if (priming) {
+            if (frameCount >= STREAM_PREBUFFER_FRAMES) {
+                // Restart the clock so the first buffered frame is due now
+                priming = false;
+                if (!hasFrame) {
+                    to = popFrame();
+                    hasFrame = true;
+                }
+                fromMicros = nowMicros - frameMicros;
+            } else if (nowMicros - dryMicros >= (uint32_t)STREAM_TIMEOUT_MS * 1000) {
+                DEBUG_PRINT(DEBUG_WARNING, "Stream timed out");
+                stop();
+                return false;
+            }
+        }
+
+        if (!priming) {
+            // Take every frame whose time has come
+            while (nowMicros - fromMicros >= frameMicros) {
+                if (frameCount == 0) {
+                    // Underrun: hold the last pose until the buffer is primed again
+                    underruns++;
+                    priming = true;
+                    dryMicros = nowMicros;
+                    from = to;
+                    break;
+                }
+                from = to;
+                to = popFrame();
+                // Frames without a head command keep the previous head position
+                if (!animationIsValidHead(to.head)) to.head = from.head;
+                fromMicros += frameMicros;
+            }
+        }
+
+        if (hasFrame) evaluateFrames(nowMicros);
+        grantCredits();
+        return true;
+    }
+
+    // Layer state getters
+    bool isActive() const { return active; }
+    bool drivesChannel(uint8_t channel) const {
+        if (!active || !hasFrame) return false;
+        return channel != ANIMATION_TRACK_HEAD || animationIsValidHead(to.head);
+    }
+    float getValue(uint8_t channel) const { return values[channel]; }
+
+    // Statistics getters
+    uint32_t getFramesPlayed() const { return framesPlayed; }
+    uint32_t getUnderruns() const { return underruns; }
+    uint32_t getOverruns() const { return overruns; }
+    uint32_t getLostFrames() const { return lostFrames; }
+};
+
+#endif // STREAM_LAYER_H
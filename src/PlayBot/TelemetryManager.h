@@ -0,0 +1,254 @@
+// TelemetryManager.h
+#ifndef TELEMETRY_MANAGER_H
+#define TELEMETRY_MANAGER_H
+
+#include "Config.h"
+#include "Debug.h"
+#include "SensorManager.h"
+#include "MotorController.h"
+#include "BinaryProtocol.h"
+
+// Subscription telemetry pushed to Playdate
+// Playdate subscribes fields at a period with "e/fields/periodMs", for
+// example "e/ep/10" for encoders and pose at 100 Hz and "e/b/1000" for the
+// battery once a second; period 0 drops the fields, "e" drops them all.
+// Fields:
+// - 'e' : encRight/encLeft (ticks)
+// - 'p' : xMm/yMm/headingMrad/speedMmPerS/turnRateMradPerS
+// - 'i' : irRight/irLeft
+// - 'f' : tofFront/tofBack (mm)
+// - 'l' : light
+// - 'b' : batteryMv/percent/charging
+// - 'd' : distance travelled (mm)
+// Every field due on a loop pass goes in one frame:
+//   "msg t/seq/E1200,-1200/p3,0,12,1,0/i"
+// An uppercase letter carries the absolute values, sent when the field is
+// subscribed and then every TELEMETRY_KEYFRAME_MS. A lowercase letter
+// carries the change since the previous frame of that field, nothing
+// after the letter when no value changed. seq counts frames, a gap means
+// deltas were lost: resubscribing gets absolute values again. The frames
+// of a pass are written to USB together. With the binary protocol the
+// fields due go in one BINARY_TYPE_TELEMETRY frame instead, with the same
+// absolute values and changes.
+// Values come from the sensor snapshot and the published pose, nothing is
+// sampled for a frame.
+class TelemetryManager {
+private:
+    enum Field : uint8_t {
+        FIELD_ENCODERS,
+        FIELD_POSE,
+        FIELD_IR,
+        FIELD_TOF,
+        FIELD_LIGHT,
+        FIELD_BATTERY,
+        FIELD_DISTANCE,
+        FIELD_COUNT
+    };
+
+    static const uint8_t MAX_VALUES = 5;
+    static_assert(FIELD_COUNT == BINARY_TELEMETRY_FIELD_COUNT, "Telemetry fields must match BinaryProtocol.h");
+
+    static constexpr char fieldLetters[FIELD_COUNT] = {'e', 'p', 'i', 'f', 'l', 'b', 'd'};
+
+    struct Subscription {
+        uint16_t period;              // ms, 0 when not subscribed
+        uint32_t lastSent;            // millis() of the last frame with this field
+        uint32_t lastKey;             // millis() of the last absolute values
+        bool keyPending;              // Next frame carries absolute values
+        int32_t sent[MAX_VALUES];     // Values as Playdate last got them
+    };
+
+    PlaydateLink& link;
+    SensorManager& sensorManager;
+    MotorController& motorController;
+    Subscription subscriptions[FIELD_COUNT];
+    uint16_t frameSeq;
+    char output[TELEMETRY_BUFFER_BYTES]; // Frames of one pass
+    size_t outputLength;
+
+    // Current values of a field, returns how many
+    uint8_t readField(Field field, int32_t* values) const {
+        const SensorManager::SensorSnapshot& snapshot = sensorManager.getSnapshot();
+        switch (field) {
+            case FIELD_ENCODERS:
+                values[0] = snapshot.encRight;
+                values[1] = snapshot.encLeft;
+                return 2;
+            case FIELD_POSE: {
+                Pose pose = motorController.getPose();
+                values[0] = lroundf(pose.x);
+                values[1] = lroundf(pose.y);
+                values[2] = lroundf(pose.heading * 1000);
+                values[3] = lroundf(pose.linearVelocity);
+                values[4] = lroundf(pose.angularVelocity * 1000);
+                return 5;
+            }
+            case FIELD_IR:
+                values[0] = snapshot.irRight;
+                values[1] = snapshot.irLeft;
+                return 2;
+            case FIELD_TOF:
+                values[0] = lroundf(snapshot.tof[0]);
+                values[1] = lroundf(snapshot.tof[1]);
+                return 2;
+            case FIELD_LIGHT:
+                values[0] = snapshot.light;
+                return 1;
+            case FIELD_BATTERY:
+                values[0] = lroundf(snapshot.batteryVoltage * 1000);
+                values[1] = lroundf(snapshot.batteryPercent);
+                values[2] = snapshot.charging ? 1 : 0;
+                return 3;
+            case FIELD_DISTANCE:
+                values[0] = lroundf(snapshot.distanceMeters * 1000);
+                return 1;
+            default:
+                return 0;
+        }
+    }
+
+    // Values of a field to send, absolute when key is set, otherwise the changes
+    // since its previous frame; returns how many, changed is set if any differs
+    uint8_t takeValues(Field field, uint32_t now, int32_t* out, bool& key, bool& changed) {
+        Subscription& subscription = subscriptions[field];
+        int32_t values[MAX_VALUES];
+        uint8_t count = readField(field, values);
+        key = subscription.keyPending || now - subscription.lastKey >= TELEMETRY_KEYFRAME_MS;
+        changed = false;
+        for (uint8_t i = 0; i < count; i++) {
+            if (values[i] != subscription.sent[i]) changed = true;
+            out[i] = key ? values[i] : values[i] - subscription.sent[i];
+            subscription.sent[i] = values[i];
+        }
+        if (key) {
+            subscription.keyPending = false;
+            subscription.lastKey = now;
+        }
+        return count;
+    }
+
+    // Append one field to the frame, absolute or as changes
+    int appendField(char* frame, size_t size, int length, Field field, uint32_t now) {
+        int32_t values[MAX_VALUES];
+        bool key;
+        bool changed;
+        uint8_t count = takeValues(field, now, values, key, changed);
+        length += snprintf(frame + length, size - length, "/%c", key ? fieldLetters[field] - 'a' + 'A' : fieldLetters[field]);
+        if (key || changed) {
+            for (uint8_t i = 0; i < count && length < (int)size; i++) {
+                length += snprintf(frame + length, size - length, i == 0 ? "%ld" : ",%ld", (long)values[i]);
+            }
+        }
+        return length;
+    }
+
+    // Binary protocol: every field due in one BINARY_TYPE_TELEMETRY frame
+    void sendBinaryFrame(uint32_t now, const bool* due) {
+        uint8_t payload[BINARY_MAX_PAYLOAD];
+        BinaryWriter writer(payload, sizeof(payload));
+        for (uint8_t field = 0; field < FIELD_COUNT; field++) {
+            if (!due[field]) continue;
+            int32_t values[MAX_VALUES];
+            bool key;
+            bool changed;
+            uint8_t count = takeValues((Field)field, now, values, key, changed);
+            writer.putU8(key ? field | BINARY_TELEMETRY_ABSOLUTE : field);
+            for (uint8_t i = 0; i < count; i++) {
+                writer.putVarint(values[i]);
+            }
+        }
+        if (writer.length > 0) link.sendFrame(BINARY_TYPE_TELEMETRY, payload, writer.length);
+    }
+
+    // Queue a finished frame for this pass's write
+    void queueFrame(const char* frame, int length) {
+        if (outputLength + length + 2 > sizeof(output)) flush();
+        memcpy(output + outputLength, frame, length);
+        outputLength += length;
+        output[outputLength++] = '\r';
+        output[outputLength++] = '\n';
+        frameSeq++;
+    }
+
+    void flush() {
+        if (outputLength == 0) return;
+        link.write((const uint8_t*)output, outputLength);
+        outputLength = 0;
+    }
+
+public:
+    TelemetryManager(PlaydateLink& playdate, SensorManager& sensors, MotorController& motors)
+        : link(playdate)
+        , sensorManager(sensors)
+        , motorController(motors)
+        , frameSeq(0)
+        , outputLength(0) {
+        memset(subscriptions, 0, sizeof(subscriptions));
+    }
+
+    // Subscribe fields (letters) at periodMs, 0 drops them, no fields drops every subscription
+    // Called when Playdate sends "e/fields/periodMs"
+    // Returns false if a letter is not a field
+    bool subscribe(const char* fields, uint16_t periodMs) {
+        if (fields == NULL || fields[0] == '\0') {
+            for (uint8_t field = 0; field < FIELD_COUNT; field++) {
+                subscriptions[field].period = 0;
+            }
+            DEBUG_PRINT(DEBUG_INFO, "Telemetry stopped");
+            return true;
+        }
+        uint16_t period = periodMs > 0 && periodMs < TELEMETRY_MIN_PERIOD_MS ? TELEMETRY_MIN_PERIOD_MS : periodMs;
+        bool valid = true;
+        uint32_t now = millis();
+        for (const char* letter = fields; *letter; letter++) {
+            const char* found = (const char*)memchr(fieldLetters, *letter, FIELD_COUNT);
+            if (!found) {
+                valid = false;
+                continue;
+            }
+            Subscription& subscription = subscriptions[found - fieldLetters];
+            subscription.period = period;
+            subscription.lastSent = now - period;
+            subscription.keyPending = true;
+        }
+        DEBUG_PRINT(DEBUG_INFO, "Telemetry %s every %u ms%s", fields, period, valid ? "" : " (unknown fields ignored)");
+        return valid;
+    }
+
+    // Send the frame of the fields due - called in main loop once the snapshot is fresh
+    void update() {
+        uint32_t now = millis();
+        bool due[FIELD_COUNT];
+        bool anyDue = false;
+        for (uint8_t field = 0; field < FIELD_COUNT; field++) {
+            Subscription& subscription = subscriptions[field];
+            due[field] = subscription.period > 0 && now - subscription.lastSent >= subscription.period;
+            if (!due[field]) continue;
+            subscription.lastSent += subscription.period;
+            if (now - subscription.lastSent >= subscription.period) subscription.lastSent = now;
+            anyDue = true;
+        }
+        if (!anyDue) return;
+        if (link.isBinary()) {
+            sendBinaryFrame(now, due);
+            return;
+        }
+
+        char frame[TELEMETRY_FRAME_BYTES];
+        int length = 0;
+        for (uint8_t field = 0; field < FIELD_COUNT; field++) {
+            if (!due[field]) continue;
+            // Longest field: letter and five values of up to 11 characters with their separators
+            if (length > 0 && length + 2 + MAX_VALUES * 12 >= (int)sizeof(frame)) {
+                queueFrame(frame, length);
+                length = 0;
+            }
+            if (length == 0) length = snprintf(frame, sizeof(frame), "msg t/%u", frameSeq);
+            length = appendField(frame, sizeof(frame), length, (Field)field, now);
+        }
+        if (length > 0) queueFrame(frame, length);
+        flush();
+    }
+};
+
+#endif // TELEMETRY_MANAGER_H
@@ -0,0 +1,150 @@
+// TofSampler.h
+#ifndef TOF_SAMPLER_H
+#define TOF_SAMPLER_H
+
+#include "Config.h"
+#include "AsyncI2C.h"
+#include <atomic>
+
+// Latest distance of one ToF sensor
+struct TofSample {
+    uint16_t distance;            // mm, 0 when the sensor had no echo
+    uint32_t timestamp;           // micros() when the read completed, 0 before the first one
+};
+
+// Background ToF sampling on the asynchronous I2C engine
+// Every TOF_SAMPLE_INTERVAL update() starts a round reading each sensor
+// behind the PCA9540BD mux as a chain of three transactions run from the
+// I2C interrupt: select the mux channel, write the distance register, read
+// 2 bytes. Samples are published per sensor with their timestamp; readers
+// copy them under a sequence count, retrying if the interrupt wrote one
+// meanwhile. A failed transaction skips the rest of that sensor, the
+// previous sample stays.
+class TofSampler {
+private:
+    enum Step : uint8_t {
+        STEP_SELECT,              // Mux control register
+        STEP_ADDRESS,             // Distance register pointer
+        STEP_READ                 // Distance, MSB first
+    };
+
+    AsyncI2C& bus;
+    I2CTransaction transaction;
+    uint8_t sensor;               // Mux channel being read
+    Step step;
+    volatile bool running;        // A round is in progress
+    uint32_t lastRoundStart;      // millis() of the last round
+    TofSample samples[TOF_SENSOR_COUNT];
+    volatile uint32_t sampleSeq[TOF_SENSOR_COUNT]; // Odd while the interrupt writes a sample
+    volatile uint32_t failedReads;
+
+    static void transactionDone(AsyncI2C::Result result, void* context) {
+        static_cast<TofSampler*>(context)->advance(result);
+    }
+
+    // Next transaction of the chain - runs in the I2C interrupt
+    void advance(AsyncI2C::Result result) {
+        if (result != AsyncI2C::I2C_OK) {
+            failedReads = failedReads + 1;
+            nextSensor();
+            return;
+        }
+        switch (step) {
+            case STEP_SELECT:
+                step = STEP_ADDRESS;
+                transaction.address = TOF_SENSOR_ADDR;
+                transaction.txLength = 1;
+                transaction.tx[0] = TOF_DISTANCE_REGISTER;
+                transaction.rxLength = 0;
+                break;
+            case STEP_ADDRESS:
+                step = STEP_READ;
+                transaction.txLength = 0;
+                transaction.rxLength = 2;
+                break;
+            case STEP_READ:
+                sampleSeq[sensor] = sampleSeq[sensor] + 1;
+                std::atomic_signal_fence(std::memory_order_release);
+                samples[sensor].distance = (transaction.rx[0] << 8) | transaction.rx[1];
+                samples[sensor].timestamp = micros();
+                std::atomic_signal_fence(std::memory_order_release);
+                sampleSeq[sensor] = sampleSeq[sensor] + 1;
+                nextSensor();
+                return;
+        }
+        if (!bus.start(transaction, transactionDone, this)) running = false;
+    }
+
+    // Move on to the next sensor, or end the round
+    void nextSensor() {
+        if (++sensor >= TOF_SENSOR_COUNT) {
+            running = false;
+            return;
+        }
+        selectSensor();
+    }
+
+    // First transaction of a sensor: route the bus through its mux channel
+    void selectSensor() {
+        step = STEP_SELECT;
+        transaction.address = TOF_MULTIPLEXER_ADDR;
+        transaction.txLength = 1;
+        transaction.tx[0] = PCA9540_ENABLE | sensor;
+        transaction.rxLength = 0;
+        if (!bus.start(transaction, transactionDone, this)) running = false;
+    }
+
+public:
+    explicit TofSampler(AsyncI2C& i2c)
+        : bus(i2c)
+        , sensor(0)
+        , step(STEP_SELECT)
+        , running(false)
+        , lastRoundStart(0)
+        , failedReads(0) {
+        memset(&transaction, 0, sizeof(transaction));
+        for (uint8_t i = 0; i < TOF_SENSOR_COUNT; i++) {
+            samples[i].distance = 0;
+            samples[i].timestamp = 0;
+            sampleSeq[i] = 0;
+        }
+    }
+
+    // Start a round when due - called in main loop
+    void update() {
+        bus.poll();
+        if (running || millis() - lastRoundStart < TOF_SAMPLE_INTERVAL) return;
+        lastRoundStart = millis();
+        sensor = 0;
+        running = true;
+        selectSensor();
+    }
+
+    // Copy the latest sample of a sensor (mux channel)
+    TofSample getSample(uint8_t channel) const {
+        TofSample sample;
+        uint32_t seq;
+        do {
+            seq = sampleSeq[channel];
+            std::atomic_signal_fence(std::memory_order_acquire);
+            sample = samples[channel];
+            std::atomic_signal_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != sampleSeq[channel]);
+        return sample;
+    }
+
+    // Copy the latest sample without waiting, false if the I2C interrupt is writing it
+    // For interrupts that may have preempted that write, where getSample() would spin forever
+    bool peekSample(uint8_t channel, TofSample& sample) const {
+        uint32_t seq = sampleSeq[channel];
+        std::atomic_signal_fence(std::memory_order_acquire);
+        sample = samples[channel];
+        std::atomic_signal_fence(std::memory_order_acquire);
+        return !(seq & 1) && seq == sampleSeq[channel];
+    }
+
+    // Sensor reads abandoned after a bus error since boot
+    uint32_t getFailedReads() const { return failedReads; }
+};
+
+#endif // TOF_SAMPLER_H
@@ -0,0 +1,350 @@
+/**
+ * Animation Compiler - Host Tool
+ *
+ * Converts exported text animations (.txt) into the precompiled binary
+ * format (.pba) played back by the firmware's AnimationManager.
+ *
+ * Text input: one frame per line, index/head_position/right_wheel/left_wheel
+ * Binary output (see src/PlayBot/AnimationFormat.h):
+ * - Dense frames (default): AnimationHeader followed by packed int16 frames
+ * - Keyframes (-k): each channel reduced to the linear keys needed to stay
+ *   within a tolerance of the dense frames
+ *
+ * Channels that never carry a command (head outside 500-2500 µs on every
+ * frame, or a wheel that stays at 0) are left out of the channel mask to
+ * save SD bytes.
+ *
+ * Usage: AnimationCompiler [-r fps] [-k tolerance] [-o output.pba] input.txt [input2.txt ...]
+ */
+
+#include "../../src/PlayBot/AnimationFormat.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// ================= Text Parsing =================
+
+// Parse one numeric field, rounding to the nearest integer
+// Returns false if the field is not a number or does not fit in int16
+static bool parseField(const std::string& field, int16_t& value) {
+    const char* start = field.c_str();
+    char* end = nullptr;
+    errno = 0;
+    double parsed = strtod(start, &end);
+    if (end == start || errno != 0) return false;
+    while (*end == ' ' || *end == '\t') end++;
+    if (*end != '\0') return false;
+
+    long rounded = lround(parsed);
+    if (rounded < INT16_MIN || rounded > INT16_MAX) return false;
+    value = (int16_t)rounded;
+    return true;
+}
+
+// Parse a text frame line: index/head_position/right_wheel/left_wheel
+static bool parseLine(const std::string& line, AnimationFrame& frame) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t slash = line.find('/', start);
+        fields.push_back(line.substr(start, slash - start));
+        if (slash == std::string::npos) break;
+        start = slash + 1;
+    }
+    if (fields.size() != 4) return false;
+
+    return parseField(fields[1], frame.head) &&
+           parseField(fields[2], frame.wheelRight) &&
+           parseField(fields[3], frame.wheelLeft);
+}
+
+// Read every frame of a text animation
+static bool readTextAnimation(const char* path, std::vector<AnimationFrame>& frames) {
+    FILE* input = fopen(path, "r");
+    if (!input) {
+        fprintf(stderr, "%s: cannot open: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char lineBuf[256];
+    unsigned lineNumber = 0;
+    bool ok = true;
+    while (fgets(lineBuf, sizeof(lineBuf), input)) {
+        lineNumber++;
+        std::string line(lineBuf);
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+        if (line.empty()) continue;
+
+        AnimationFrame frame;
+        if (!parseLine(line, frame)) {
+            fprintf(stderr, "%s:%u: invalid frame \"%s\"\n", path, lineNumber, line.c_str());
+            ok = false;
+            continue;
+        }
+        frames.push_back(frame);
+    }
+    fclose(input);
+    return ok;
+}
+
+// ================= Binary Output =================
+
+// Channels that carry at least one command across the animation
+static uint16_t detectChannels(const std::vector<AnimationFrame>& frames) {
+    uint16_t mask = 0;
+    for (const AnimationFrame& frame : frames) {
+        if (frame.head >= ANIMATION_HEAD_MIN && frame.head <= ANIMATION_HEAD_MAX) {
+            mask |= ANIMATION_CHANNEL_HEAD;
+        }
+        if (frame.wheelRight != 0) mask |= ANIMATION_CHANNEL_WHEEL_RIGHT;
+        if (frame.wheelLeft != 0) mask |= ANIMATION_CHANNEL_WHEEL_LEFT;
+    }
+    return mask;
+}
+
+static void writeU16(FILE* output, uint16_t value) {
+    uint8_t bytes[2] = { (uint8_t)(value & 0xFF), (uint8_t)(value >> 8) };
+    fwrite(bytes, 1, sizeof(bytes), output);
+}
+
+static void writeU32(FILE* output, uint32_t value) {
+    writeU16(output, value & 0xFFFF);
+    writeU16(output, value >> 16);
+}
+
+// Write header and packed frames, little-endian regardless of host
+static bool writeBinaryAnimation(const char* path, const std::vector<AnimationFrame>& frames,
+                                 uint8_t frameRate, uint16_t channelMask) {
+    FILE* output = fopen(path, "wb");
+    if (!output) {
+        fprintf(stderr, "%s: cannot create: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fwrite(ANIMATION_MAGIC, 1, ANIMATION_MAGIC_LENGTH, output);
+    fputc(ANIMATION_VERSION_FRAMES, output);
+    fputc(frameRate, output);
+    writeU16(output, channelMask);
+    writeU32(output, (uint32_t)frames.size());
+
+    for (const AnimationFrame& frame : frames) {
+        if (channelMask & ANIMATION_CHANNEL_HEAD) writeU16(output, (uint16_t)frame.head);
+        if (channelMask & ANIMATION_CHANNEL_WHEEL_RIGHT) writeU16(output, (uint16_t)frame.wheelRight);
+        if (channelMask & ANIMATION_CHANNEL_WHEEL_LEFT) writeU16(output, (uint16_t)frame.wheelLeft);
+    }
+
+    bool ok = !ferror(output);
+    if (fclose(output) != 0) ok = false;
+    if (!ok) fprintf(stderr, "%s: write failed\n", path);
+    return ok;
+}
+
+// ================= Keyframe Reduction =================
+
+// Channel values of every frame, in AnimationFormat channel order
+static std::vector<int16_t> channelValues(const std::vector<AnimationFrame>& frames, uint8_t channel) {
+    std::vector<int16_t> values;
+    for (const AnimationFrame& frame : frames) {
+        values.push_back(channel == 0 ? frame.head : (channel == 1 ? frame.wheelRight : frame.wheelLeft));
+    }
+    return values;
+}
+
+static uint32_t frameTimeMs(size_t frameIndex, uint8_t frameRate) {
+    return (uint32_t)lround(frameIndex * 1000.0 / frameRate);
+}
+
+// Check that a straight line between two frames stays within tolerance
+static bool fitsLine(const std::vector<int16_t>& values, size_t first, size_t last, double tolerance) {
+    for (size_t i = first + 1; i < last; i++) {
+        double t = (double)(i - first) / (double)(last - first);
+        double interpolated = values[first] + (values[last] - values[first]) * t;
+        if (fabs(interpolated - values[i]) > tolerance) return false;
+    }
+    return true;
+}
+
+// Reduce one channel to linear keys, greedily extending each segment
+// Head frames without a servo command hold the previous command
+static void reduceChannel(const std::vector<AnimationFrame>& frames, uint8_t channel,
+                          uint8_t frameRate, double tolerance, std::vector<AnimationKey>& keys) {
+    std::vector<int16_t> values = channelValues(frames, channel);
+    size_t first = 0;
+    if (channel == 0) {
+        while (first < values.size() &&
+               (values[first] < ANIMATION_HEAD_MIN || values[first] > ANIMATION_HEAD_MAX)) first++;
+        if (first == values.size()) return;
+        for (size_t i = first + 1; i < values.size(); i++) {
+            if (values[i] < ANIMATION_HEAD_MIN || values[i] > ANIMATION_HEAD_MAX) values[i] = values[i - 1];
+        }
+    }
+
+    size_t start = first;
+    keys.push_back({frameTimeMs(start, frameRate), values[start], channel, ANIMATION_EASE_LINEAR});
+    for (size_t end = start + 2; end < values.size(); end++) {
+        if (!fitsLine(values, start, end, tolerance)) {
+            start = end - 1;
+            keys.push_back({frameTimeMs(start, frameRate), values[start], channel, ANIMATION_EASE_LINEAR});
+        }
+    }
+    size_t last = values.size() - 1;
+    if (last != start) {
+        keys.push_back({frameTimeMs(last, frameRate), values[last], channel, ANIMATION_EASE_LINEAR});
+    }
+}
+
+// Build the key stream of an animation in playback order
+// A key is needed once the previous key of its channel is reached, so keys
+// are sorted by that time. A final hold key keeps the dense duration.
+static std::vector<AnimationKey> buildKeys(const std::vector<AnimationFrame>& frames, uint16_t channelMask,
+                                           uint8_t frameRate, double tolerance) {
+    struct OrderedKey {
+        uint32_t neededMs;
+        AnimationKey key;
+    };
+    std::vector<OrderedKey> ordered;
+
+    for (uint8_t channel = 0; channel < ANIMATION_CHANNEL_COUNT; channel++) {
+        if (!(channelMask & (1 << channel))) continue;
+        std::vector<AnimationKey> keys;
+        reduceChannel(frames, channel, frameRate, tolerance, keys);
+        if (keys.empty()) continue;
+        if (ordered.empty()) {
+            AnimationKey hold = keys.back();
+            hold.timeMs = frameTimeMs(frames.size(), frameRate);
+            keys.push_back(hold);
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            ordered.push_back({i > 0 ? keys[i - 1].timeMs : 0, keys[i]});
+        }
+    }
+
+    std::stable_sort(ordered.begin(), ordered.end(), [](const OrderedKey& a, const OrderedKey& b) {
+        if (a.neededMs != b.neededMs) return a.neededMs < b.neededMs;
+        return a.key.timeMs < b.key.timeMs;
+    });
+
+    std::vector<AnimationKey> keys;
+    for (const OrderedKey& entry : ordered) keys.push_back(entry.key);
+    return keys;
+}
+
+// Write header and keyframe records, little-endian regardless of host
+static bool writeKeyframeAnimation(const char* path, const std::vector<AnimationKey>& keys,
+                                   uint8_t frameRate, uint16_t channelMask) {
+    FILE* output = fopen(path, "wb");
+    if (!output) {
+        fprintf(stderr, "%s: cannot create: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fwrite(ANIMATION_MAGIC, 1, ANIMATION_MAGIC_LENGTH, output);
+    fputc(ANIMATION_VERSION_KEYFRAMES, output);
+    fputc(frameRate, output);
+    writeU16(output, channelMask);
+    writeU32(output, (uint32_t)keys.size());
+
+    for (const AnimationKey& key : keys) {
+        writeU32(output, key.timeMs);
+        writeU16(output, (uint16_t)key.value);
+        fputc(key.channel, output);
+        fputc(key.easing, output);
+    }
+
+    bool ok = !ferror(output);
+    if (fclose(output) != 0) ok = false;
+    if (!ok) fprintf(stderr, "%s: write failed\n", path);
+    return ok;
+}
+
+// Default output path: input path with its extension replaced by .pba
+static std::string defaultOutputPath(const std::string& input) {
+    size_t slash = input.find_last_of('/');
+    size_t dot = input.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return input + ".pba";
+    }
+    return input.substr(0, dot) + ".pba";
+}
+
+// Convert one text animation, returns false on any error
+// tolerance < 0 writes dense frames, otherwise keyframes
+static bool compileAnimation(const char* inputPath, const std::string& outputPath,
+                             uint8_t frameRate, double tolerance) {
+    std::vector<AnimationFrame> frames;
+    if (!readTextAnimation(inputPath, frames)) return false;
+    if (frames.empty()) {
+        fprintf(stderr, "%s: no frames\n", inputPath);
+        return false;
+    }
+
+    uint16_t channelMask = detectChannels(frames);
+    if (tolerance >= 0) {
+        std::vector<AnimationKey> keys = buildKeys(frames, channelMask, frameRate, tolerance);
+        if (!writeKeyframeAnimation(outputPath.c_str(), keys, frameRate, channelMask)) return false;
+        printf("%s -> %s: %zu frames -> %zu keys, channels 0x%02X, %zu bytes\n",
+               inputPath, outputPath.c_str(), frames.size(), keys.size(), channelMask,
+               sizeof(AnimationHeader) + keys.size() * sizeof(AnimationKey));
+        return true;
+    }
+
+    if (!writeBinaryAnimation(outputPath.c_str(), frames, frameRate, channelMask)) return false;
+
+    printf("%s -> %s: %zu frames @ %u fps, channels 0x%02X, %zu bytes\n",
+           inputPath, outputPath.c_str(), frames.size(), frameRate, channelMask,
+           sizeof(AnimationHeader) + frames.size() * animationFrameSize(channelMask));
+    return true;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-r fps] [-k tolerance] [-o output.pba] input.txt [input2.txt ...]\n"
+            "  -r fps        Frame rate of the text animation (default %d)\n"
+            "  -k tolerance  Write keyframes, keeping every channel within tolerance\n"
+            "                (µs for the head, ticks for the wheels) of the frames\n"
+            "  -o path       Output file, only valid with a single input\n",
+            program, ANIMATION_DEFAULT_FRAME_RATE);
+}
+
+int main(int argc, char** argv) {
+    int frameRate = ANIMATION_DEFAULT_FRAME_RATE;
+    double tolerance = -1;
+    const char* outputPath = nullptr;
+    std::vector<const char*> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            frameRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+            if (tolerance < 0) {
+                printUsage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return 2;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (inputs.empty() || (outputPath && inputs.size() > 1) || frameRate < 1 || frameRate > 255) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    for (const char* input : inputs) {
+        std::string output = outputPath ? outputPath : defaultOutputPath(input);
+        ok &= compileAnimation(input, output, (uint8_t)frameRate, tolerance);
+    }
+    return ok ? 0 : 1;
+}
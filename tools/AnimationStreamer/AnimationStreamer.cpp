@@ -0,0 +1,219 @@
+/**
+ * Animation Streamer - Host Tool
+ *
+ * Streams a text animation (.txt) to the firmware over a serial link, the
+ * way the Playdate does with "s/fps" and "k/..." messages. Useful to try
+ * generated motion from a computer through a USB serial adapter plugged
+ * into the Teensy host port, or against a pseudo-terminal.
+ *
+ * Frames are sent as fast as the firmware grants credits ("msg k/n"), one
+ * frame per credit, several frames per message when credits allow.
+ *
+ * Usage: AnimationStreamer [-r fps] [-b baud] device input.txt
+ */
+
+#include "../../src/PlayBot/AnimationFormat.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Longest "k/" message, must stay below the firmware read window (USB_READ_WINDOW)
+static const size_t MAX_MESSAGE_BYTES = 78;
+
+// ================= Text Input =================
+
+// Read every frame of a text animation: index/head_position/right_wheel/left_wheel
+static bool readTextAnimation(const char* path, std::vector<AnimationFrame>& frames) {
+    FILE* input = fopen(path, "r");
+    if (!input) {
+        fprintf(stderr, "%s: cannot open: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char lineBuf[256];
+    unsigned lineNumber = 0;
+    bool ok = true;
+    while (fgets(lineBuf, sizeof(lineBuf), input)) {
+        lineNumber++;
+        if (lineBuf[0] == '\n' || lineBuf[0] == '\r' || lineBuf[0] == '\0') continue;
+
+        double index, head, wheelRight, wheelLeft;
+        if (sscanf(lineBuf, "%lf/%lf/%lf/%lf", &index, &head, &wheelRight, &wheelLeft) != 4) {
+            fprintf(stderr, "%s:%u: invalid frame\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+        frames.push_back({(int16_t)lround(head), (int16_t)lround(wheelRight), (int16_t)lround(wheelLeft)});
+    }
+    fclose(input);
+    return ok;
+}
+
+// ================= Serial Link =================
+
+// Open a serial device in raw mode
+static int openSerial(const char* path, speed_t baud) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot open: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, baud);
+        cfsetospeed(&tty, baud);
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return fd;
+}
+
+// Write a whole message followed by a newline
+static bool sendMessage(int fd, const std::string& message) {
+    std::string line = message + "\n";
+    const char* data = line.c_str();
+    size_t left = line.size();
+    while (left > 0) {
+        ssize_t written = write(fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    return true;
+}
+
+// Read available bytes and add the credits of every complete "msg k/n" line
+// Waits up to timeoutMs for data
+static bool readCredits(int fd, std::string& pending, unsigned& credits, int timeoutMs) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, timeoutMs);
+    if (ready < 0) return errno == EINTR;
+    if (ready == 0) return true;
+
+    char chunk[256];
+    ssize_t count = read(fd, chunk, sizeof(chunk));
+    if (count <= 0) return false;
+    pending.append(chunk, count);
+
+    size_t newline;
+    while ((newline = pending.find('\n')) != std::string::npos) {
+        std::string line = pending.substr(0, newline);
+        pending.erase(0, newline + 1);
+        unsigned granted;
+        if (sscanf(line.c_str(), "msg k/%u", &granted) == 1) credits += granted;
+    }
+    return true;
+}
+
+static double secondsSince(const struct timespec& start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-r fps] [-b baud] device input.txt\n"
+            "  -r fps   Frame rate of the text animation (default %d)\n"
+            "  -b baud  Serial speed (default 115200)\n",
+            program, ANIMATION_DEFAULT_FRAME_RATE);
+}
+
+int main(int argc, char** argv) {
+    int frameRate = ANIMATION_DEFAULT_FRAME_RATE;
+    speed_t baud = B115200;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            frameRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            int rate = atoi(argv[++i]);
+            baud = rate == 57600 ? B57600 : rate == 230400 ? B230400 : B115200;
+        } else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return 2;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2 || frameRate < 1 || frameRate > 100) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<AnimationFrame> frames;
+    if (!readTextAnimation(paths[1], frames)) return 1;
+    if (frames.empty()) {
+        fprintf(stderr, "%s: no frames\n", paths[1]);
+        return 1;
+    }
+
+    int fd = openSerial(paths[0], baud);
+    if (fd < 0) return 1;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sendMessage(fd, "s/" + std::to_string(frameRate));
+
+    std::string pending;
+    unsigned credits = 0;
+    unsigned grants = 0;
+    size_t sent = 0;
+    while (sent < frames.size()) {
+        unsigned before = credits;
+        if (!readCredits(fd, pending, credits, credits > 0 ? 0 : 1000)) {
+            fprintf(stderr, "%s: link closed\n", paths[0]);
+            close(fd);
+            return 1;
+        }
+        if (credits > before) grants++;
+        if (credits == 0) {
+            if (secondsSince(start) > 2.0 && grants == 0) {
+                fprintf(stderr, "%s: no credits granted, is the firmware streaming?\n", paths[0]);
+                close(fd);
+                return 1;
+            }
+            continue;
+        }
+
+        // Pack as many granted frames as fit in one message
+        std::string message = "k/";
+        while (credits > 0 && sent < frames.size()) {
+            const AnimationFrame& frame = frames[sent];
+            char text[24];
+            snprintf(text, sizeof(text), "%d/%d/%d;", frame.head, frame.wheelRight, frame.wheelLeft);
+            if (message.size() + strlen(text) > MAX_MESSAGE_BYTES) break;
+            message += text;
+            credits--;
+            sent++;
+        }
+        if (!sendMessage(fd, message)) {
+            fprintf(stderr, "%s: write failed: %s\n", paths[0], strerror(errno));
+            close(fd);
+            return 1;
+        }
+    }
+
+    // Let the jitter buffer play out before stopping the stream
+    usleep(1000000 / frameRate * 8);
+    sendMessage(fd, "s/0");
+    close(fd);
+
+    double elapsed = secondsSince(start);
+    printf("Streamed %zu frames in %.2f s (%.1f fps, %u grants)\n",
+           sent, elapsed, sent / elapsed, grants);
+    return 0;
+}
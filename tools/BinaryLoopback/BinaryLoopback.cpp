@@ -0,0 +1,419 @@
+/**
+ * Binary Loopback - Host Tool
+ *
+ * Checks the binary protocol shared with the firmware (BinaryProtocol.h)
+ * on Linux: CRC and COBS against reference values and edge cases, then
+ * frames sent through a local socket pair and read back in random chunk
+ * sizes, clean and with corrupted bytes, lost frames and a receiver
+ * joining mid-stream. Ends with the size and host parsing time of the
+ * sensor data response in text and binary form.
+ *
+ * Usage: BinaryLoopback [-s seed] [-n frames]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../../src/PlayBot/BinaryProtocol.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char* name, const std::string& detail = "") {
+    if (passed) {
+        printf("PASS  %s\n", name);
+    } else {
+        printf("FAIL  %s%s%s\n", name, detail.empty() ? "" : ": ", detail.c_str());
+        failures++;
+    }
+}
+
+// ================= CRC and COBS =================
+
+static void testCrc() {
+    const char* reference = "123456789";
+    uint16_t crc = binaryCrc16((const uint8_t*)reference, strlen(reference));
+    char detail[32];
+    snprintf(detail, sizeof(detail), "got 0x%04X", crc);
+    check(crc == 0x29B1, "CRC-16/CCITT-FALSE check value", detail);
+}
+
+// Payload of length bytes, zeroPercent of them 0x00
+static std::vector<uint8_t> randomBytes(std::mt19937& random, size_t length, int zeroPercent) {
+    std::vector<uint8_t> bytes(length);
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = (int)(random() % 100) < zeroPercent ? 0 : (uint8_t)(random() % 255 + 1);
+    }
+    return bytes;
+}
+
+static void testCobs(std::mt19937& random) {
+    // Known encodings
+    struct Vector {
+        std::vector<uint8_t> in;
+        std::vector<uint8_t> out;
+    };
+    std::vector<Vector> vectors = {
+        {{}, {0x01}},
+        {{0x00}, {0x01, 0x01}},
+        {{0x00, 0x00}, {0x01, 0x01, 0x01}},
+        {{0x11, 0x22, 0x00, 0x33}, {0x03, 0x11, 0x22, 0x02, 0x33}},
+        {{0x11, 0x00, 0x00, 0x00}, {0x02, 0x11, 0x01, 0x01, 0x01}},
+    };
+    std::vector<uint8_t> run254(254);
+    for (size_t i = 0; i < run254.size(); i++) run254[i] = (uint8_t)(i + 1);
+    std::vector<uint8_t> expected254 = {0xFF};
+    expected254.insert(expected254.end(), run254.begin(), run254.end());
+    vectors.push_back({run254, expected254});
+    std::vector<uint8_t> run255 = run254;
+    run255.push_back(0x42);
+    std::vector<uint8_t> expected255 = expected254;
+    expected255.push_back(0x02);
+    expected255.push_back(0x42);
+    vectors.push_back({run255, expected255});
+
+    bool vectorsOk = true;
+    std::string detail;
+    for (size_t v = 0; v < vectors.size(); v++) {
+        std::vector<uint8_t> out(vectors[v].in.size() + vectors[v].in.size() / 254 + 1);
+        size_t length = binaryCobsEncode(vectors[v].in.data(), vectors[v].in.size(), out.data());
+        out.resize(length);
+        if (out != vectors[v].out) {
+            vectorsOk = false;
+            detail = "vector " + std::to_string(v);
+        }
+    }
+    check(vectorsOk, "COBS reference encodings", detail);
+
+    // Round trip of every length up to two blocks, dense and sparse in zeros
+    bool roundTripOk = true;
+    detail.clear();
+    for (int zeroPercent : {0, 1, 10, 50, 100}) {
+        for (size_t length = 1; length <= 600; length++) {
+            std::vector<uint8_t> in = randomBytes(random, length, zeroPercent);
+            std::vector<uint8_t> encoded(length + length / 254 + 1);
+            size_t encodedLength = binaryCobsEncode(in.data(), length, encoded.data());
+            std::vector<uint8_t> decoded(encodedLength);
+            size_t decodedLength = binaryCobsDecode(encoded.data(), encodedLength, decoded.data());
+            bool zeroFree = memchr(encoded.data(), 0, encodedLength) == nullptr;
+            if (!zeroFree || decodedLength != length || memcmp(decoded.data(), in.data(), length) != 0) {
+                roundTripOk = false;
+                detail = "length " + std::to_string(length) + ", " + std::to_string(zeroPercent) + "% zeros";
+            }
+        }
+    }
+    check(roundTripOk, "COBS round trip, 1 to 600 bytes", detail);
+
+    const uint8_t truncated[] = {0x05, 0x11, 0x22};
+    const uint8_t innerZero[] = {0x03, 0x11, 0x00};
+    uint8_t scratch[8];
+    check(binaryCobsDecode(truncated, sizeof(truncated), scratch) == 0 &&
+          binaryCobsDecode(innerZero, sizeof(innerZero), scratch) == 0,
+          "COBS malformed input rejected");
+}
+
+static void testPayloads(std::mt19937& random) {
+    std::vector<int32_t> values = {0, 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, INT32_MAX, INT32_MIN};
+    for (int i = 0; i < 1000; i++) values.push_back((int32_t)random());
+    std::vector<uint8_t> buffer(values.size() * 5 + 16);
+    BinaryWriter writer(buffer.data(), buffer.size());
+    writer.putU8(0xA5);
+    writer.putI16(-12345);
+    writer.putU32(0xDEADBEEF);
+    for (int32_t value : values) writer.putVarint(value);
+
+    BinaryReader reader(buffer.data(), writer.length);
+    bool ok = !writer.overflow && reader.getU8() == 0xA5 && reader.getI16() == -12345 && reader.getU32() == 0xDEADBEEF;
+    for (int32_t value : values) ok = ok && reader.getVarint() == value;
+    ok = ok && reader.atEnd() && !reader.error;
+    reader.getU8();
+    check(ok && reader.error, "Little-endian and zigzag varint payload round trip");
+
+    uint8_t small[3];
+    BinaryWriter full(small, sizeof(small));
+    full.putU32(1);
+    check(full.overflow && full.length == 3, "Payload writer stops when full");
+}
+
+// ================= Socket Loopback =================
+
+struct SentFrame {
+    uint8_t type;
+    uint8_t seq;
+    std::vector<uint8_t> payload;
+};
+
+// What the receiving side saw
+struct Received {
+    std::vector<SentFrame> frames;
+    BinaryFrameDecoder::Stats stats;
+};
+
+// Write the stream from a thread, read it back in random chunks into a decoder
+static Received loopback(const std::vector<uint8_t>& stream, std::mt19937& random) {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    std::thread writer([&stream, &sockets]() {
+        size_t offset = 0;
+        while (offset < stream.size()) {
+            ssize_t written = write(sockets[0], stream.data() + offset, std::min<size_t>(4096, stream.size() - offset));
+            if (written <= 0) break;
+            offset += written;
+        }
+        close(sockets[0]);
+    });
+
+    Received received;
+    BinaryFrameDecoder decoder;
+    uint8_t chunk[256];
+    for (;;) {
+        size_t wanted = random() % sizeof(chunk) + 1;
+        ssize_t count = read(sockets[1], chunk, wanted);
+        if (count <= 0) break;
+        for (ssize_t i = 0; i < count; i++) {
+            BinaryFrame frame;
+            if (decoder.push(chunk[i], frame) == BinaryFrameDecoder::BINARY_FRAME_READY) {
+                received.frames.push_back({frame.type, frame.seq,
+                                           std::vector<uint8_t>(frame.payload, frame.payload + frame.length)});
+            }
+        }
+    }
+    writer.join();
+    close(sockets[1]);
+    received.stats = decoder.getStats();
+    return received;
+}
+
+static std::vector<SentFrame> makeFrames(std::mt19937& random, int count) {
+    std::vector<SentFrame> frames;
+    const uint8_t types[] = {BINARY_TYPE_TEXT, BINARY_TYPE_SENSOR_DATA, BINARY_TYPE_POSE, BINARY_TYPE_TELEMETRY};
+    for (int i = 0; i < count; i++) {
+        size_t length = random() % 4 == 0 ? random() % (BINARY_MAX_PAYLOAD + 1) : random() % 40;
+        frames.push_back({types[random() % 4], (uint8_t)i, randomBytes(random, length, 10)});
+    }
+    return frames;
+}
+
+static std::vector<std::vector<uint8_t>> encodeFrames(const std::vector<SentFrame>& frames) {
+    std::vector<std::vector<uint8_t>> encoded;
+    uint8_t buffer[BINARY_MAX_FRAME];
+    for (const SentFrame& frame : frames) {
+        size_t length = binaryEncodeFrame(frame.type, frame.seq, frame.payload.data(), frame.payload.size(), buffer);
+        encoded.emplace_back(buffer, buffer + length);
+    }
+    return encoded;
+}
+
+static bool sameFrame(const SentFrame& a, const SentFrame& b) {
+    return a.type == b.type && a.seq == b.seq && a.payload == b.payload;
+}
+
+static void testCleanLoopback(std::mt19937& random, int count) {
+    std::vector<SentFrame> frames = makeFrames(random, count);
+    std::vector<uint8_t> stream;
+    for (const std::vector<uint8_t>& frame : encodeFrames(frames)) stream.insert(stream.end(), frame.begin(), frame.end());
+
+    Received received = loopback(stream, random);
+    bool ok = received.frames.size() == frames.size();
+    for (size_t i = 0; ok && i < frames.size(); i++) ok = sameFrame(received.frames[i], frames[i]);
+    char detail[96];
+    snprintf(detail, sizeof(detail), "%zu of %zu frames, %u CRC, %u framing, %u lost", received.frames.size(),
+             frames.size(), received.stats.crcErrors, received.stats.framingErrors, received.stats.lostFrames);
+    check(ok && received.stats.crcErrors == 0 && received.stats.framingErrors == 0 && received.stats.lostFrames == 0,
+          "Clean loopback, every frame in order", ok ? "" : detail);
+    size_t payloadBytes = 0;
+    for (const SentFrame& frame : frames) payloadBytes += frame.payload.size();
+    printf("      %zu frames, %zu bytes, %.2f%% framing overhead on the payloads\n", frames.size(), stream.size(),
+           100.0 * (stream.size() - payloadBytes) / stream.size());
+}
+
+static void testCorruptedLoopback(std::mt19937& random, int count) {
+    std::vector<SentFrame> frames = makeFrames(random, count);
+    std::vector<std::vector<uint8_t>> encoded = encodeFrames(frames);
+    std::vector<bool> damaged(frames.size(), false);
+    std::vector<uint8_t> stream;
+    for (size_t i = 0; i < encoded.size(); i++) {
+        std::vector<uint8_t> frame = encoded[i];
+        int fault = random() % 20;
+        if (fault == 0) {
+            // Flip a bit of a frame byte, the delimiter stays
+            frame[random() % (frame.size() - 1)] ^= (uint8_t)(1 << (random() % 8));
+            damaged[i] = true;
+        } else if (fault == 1) {
+            // Frame lost on the way
+            damaged[i] = true;
+            continue;
+        } else if (fault == 2) {
+            // Frame cut short, its delimiter kept
+            frame.erase(frame.begin() + random() % (frame.size() - 1), frame.end() - 1);
+            damaged[i] = true;
+        }
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    Received received = loopback(stream, random);
+    // Every frame delivered is one of the sent frames, in order, and every intact frame is delivered
+    size_t next = 0;
+    bool exact = true;
+    size_t intactMissing = 0;
+    for (const SentFrame& frame : received.frames) {
+        while (next < frames.size() && !sameFrame(frames[next], frame)) {
+            if (!damaged[next]) intactMissing++;
+            next++;
+        }
+        if (next == frames.size()) {
+            exact = false;
+            break;
+        }
+        next++;
+    }
+    for (; next < frames.size(); next++) {
+        if (!damaged[next]) intactMissing++;
+    }
+    size_t damagedCount = 0;
+    for (bool frameDamaged : damaged) damagedCount += frameDamaged;
+
+    char detail[128];
+    snprintf(detail, sizeof(detail), "%zu delivered, %zu intact frames missing, %s", received.frames.size(),
+             intactMissing, exact ? "no bad frame delivered" : "a bad frame was delivered");
+    check(exact && intactMissing == 0, "Corrupted loopback, damaged frames dropped, intact ones kept", detail);
+    printf("      %zu frames damaged or lost: %u CRC errors, %u framing errors, %u counted lost from seq\n",
+           damagedCount, received.stats.crcErrors, received.stats.framingErrors, received.stats.lostFrames);
+    check(received.stats.lostFrames == damagedCount, "Lost frames counted from the seq gaps");
+}
+
+static void testResynchronisation(std::mt19937& random) {
+    std::vector<SentFrame> frames = makeFrames(random, 50);
+    std::vector<std::vector<uint8_t>> encoded = encodeFrames(frames);
+    std::vector<uint8_t> stream;
+    // Receiver joining in the middle of the first frame
+    stream.insert(stream.end(), encoded[0].begin() + encoded[0].size() / 2, encoded[0].end());
+    // Line noise longer than any frame
+    std::vector<uint8_t> noise = randomBytes(random, 3 * BINARY_MAX_FRAME, 0);
+    stream.insert(stream.end(), noise.begin(), noise.end());
+    stream.push_back(BINARY_FRAME_DELIMITER);
+    // Text line of a Playdate that does not speak the binary protocol
+    const char* text = "v\n";
+    stream.insert(stream.end(), text, text + strlen(text));
+    stream.push_back(BINARY_FRAME_DELIMITER);
+    for (size_t i = 1; i < encoded.size(); i++) stream.insert(stream.end(), encoded[i].begin(), encoded[i].end());
+
+    Received received = loopback(stream, random);
+    bool ok = received.frames.size() == frames.size() - 1;
+    for (size_t i = 0; ok && i < received.frames.size(); i++) ok = sameFrame(received.frames[i], frames[i + 1]);
+    check(ok, "Resynchronisation after a partial frame, noise and a text line");
+}
+
+// ================= Size and Parsing Cost =================
+
+static void compareSensorData() {
+    const char* text = "msg d/100/120/150.20/160.50/-1200/1200/500/3.70/1/1.50/4/2/6/8/120/640\r\n";
+    uint8_t payload[BINARY_SENSOR_DATA_LENGTH];
+    BinaryWriter writer(payload, sizeof(payload));
+    writer.putI16(100);
+    writer.putI16(120);
+    writer.putU16(150);
+    writer.putU16(161);
+    writer.putI32(-1200);
+    writer.putI32(1200);
+    writer.putU16(500);
+    writer.putU16(3700);
+    writer.putU8(1);
+    writer.putU32(1500);
+    const uint16_t ages[6] = {4, 2, 6, 8, 120, 640};
+    for (uint16_t age : ages) writer.putU16(age);
+    uint8_t frame[BINARY_MAX_FRAME];
+    size_t frameLength = binaryEncodeFrame(BINARY_TYPE_SENSOR_DATA, 7, payload, writer.length, frame);
+    check(writer.length == BINARY_SENSOR_DATA_LENGTH, "Sensor data payload length matches BINARY_SENSOR_DATA_LENGTH");
+
+    const int iterations = 200000;
+    volatile long sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        int irRight, irLeft, light, charging;
+        float tofFront, tofBack, battery, distance;
+        long encRight, encLeft, age[6];
+        sscanf(text, "msg d/%d/%d/%f/%f/%ld/%ld/%d/%f/%d/%f/%ld/%ld/%ld/%ld/%ld/%ld", &irRight, &irLeft, &tofFront,
+               &tofBack, &encRight, &encLeft, &light, &battery, &charging, &distance, &age[0], &age[1], &age[2],
+               &age[3], &age[4], &age[5]);
+        sink += irRight + encLeft + age[5];
+    }
+    double textNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    BinaryFrameDecoder decoder;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        BinaryFrame received;
+        for (size_t b = 0; b < frameLength; b++) {
+            if (decoder.push(frame[b], received) != BinaryFrameDecoder::BINARY_FRAME_READY) continue;
+            BinaryReader reader(received.payload, received.length);
+            int32_t irRight = reader.getI16();
+            reader.getI16();
+            reader.getU16();
+            reader.getU16();
+            reader.getI32();
+            int32_t encLeft = reader.getI32();
+            reader.getU16();
+            reader.getU16();
+            reader.getU8();
+            reader.getU32();
+            int32_t age = 0;
+            for (int a = 0; a < 6; a++) age = reader.getU16();
+            sink += irRight + encLeft + age;
+        }
+    }
+    double binaryNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    printf("\nSensor data response   bytes   host parse ns\n");
+    printf("  text line            %5zu   %13.0f  (sscanf)\n", strlen(text), textNs);
+    printf("  binary frame         %5zu   %13.0f  (COBS, CRC, reader)\n", frameLength, binaryNs);
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-s seed] [-n frames]\n"
+            "  -s seed    Seed of the random payloads and faults (default 1)\n"
+            "  -n frames  Frames per loopback run (default 20000)\n",
+            program);
+}
+
+int main(int argc, char** argv) {
+    unsigned seed = 1;
+    int count = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (count < 1) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::mt19937 random(seed);
+    testCrc();
+    testCobs(random);
+    testPayloads(random);
+    testCleanLoopback(random, count);
+    testCorruptedLoopback(random, count);
+    testResynchronisation(random);
+    compareSensorData();
+
+    printf("\n%s\n", failures == 0 ? "All checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,291 @@
+/**
+ * Collision Replay - Host Tool
+ *
+ * Replays front ToF traces through the firmware's collision detectors
+ * (CollisionDetector.h) and reports, for each detector and parameter set,
+ * how late it sees real obstacles and how often it fires on nothing.
+ *
+ * Traces are CSV files, one sample per line: time_ms,distance_mm,contact
+ * where contact is 1 while the obstacle is really closer than the
+ * threshold (the ground truth, labelled by hand or from a tape measure
+ * run). Lines starting with '#' are ignored. Without files, a synthetic
+ * set is generated: approaches toward a wall at various speeds, and free
+ * roaming with the spurious readings the sensors give when pointing into
+ * empty space.
+ *
+ * Latency is measured from the first contact sample of an episode to the
+ * sample the detector fires on. A detection up to EDGE_TOLERANCE_MS
+ * before the episode counts as latency 0 and one up to EDGE_TOLERANCE_MS
+ * after it as chatter while the obstacle clears; any other onset outside
+ * an episode is a false alarm.
+ *
+ * Usage: CollisionReplay [-t thresholdMm] [-s seed] [trace.csv ...]
+ */
+
+#include "../../src/PlayBot/CollisionDetector.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Firmware values (Config.h), the threshold can be overridden with -t
+static const float DEFAULT_THRESHOLD = 70;       // FRONT_COLLISION_THRESHOLD
+static const uint16_t MAX_VALID_DISTANCE = 1800; // TOF_MAX_VALID_DISTANCE
+static const uint32_t SAMPLE_PERIOD_MS = 4;      // TOF_SAMPLE_INTERVAL
+static const uint32_t EDGE_TOLERANCE_MS = 50;
+
+struct Sample {
+    uint32_t timeMs;
+    uint16_t distance;
+    bool contact;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Sample> samples;
+};
+
+// ================= Trace loading =================
+
+static bool loadTrace(const char* path, Trace& trace) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    trace.name = path;
+    char line[128];
+    unsigned lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+        unsigned long timeMs, distance, contact;
+        if (sscanf(line, "%lu,%lu,%lu", &timeMs, &distance, &contact) != 3) {
+            fprintf(stderr, "%s:%u: expected time_ms,distance_mm,contact\n", path, lineNumber);
+            fclose(file);
+            return false;
+        }
+        trace.samples.push_back({(uint32_t)timeMs, (uint16_t)std::min(distance, 65535UL), contact != 0});
+    }
+    fclose(file);
+    return !trace.samples.empty();
+}
+
+// ================= Synthetic traces =================
+
+// What the sensor reports for a true distance
+// Far away it mostly sees nothing (out of range) and now and then gives
+// a junk reading anywhere; closer it is noisy with rare junk and dropouts.
+static uint16_t senseDistance(float trueDistance, std::mt19937& rng) {
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::normal_distribution<float> noise(0, 3 + 0.01f * trueDistance);
+    float draw = uniform(rng);
+    if (trueDistance > 1200) {
+        if (draw < 0.12f) return (uint16_t)(20 + uniform(rng) * 1480);
+        if (draw < 0.6f) return 8190;
+    } else {
+        if (draw < 0.02f) return (uint16_t)(20 + uniform(rng) * 1480);
+        if (draw < 0.03f) return 0;
+    }
+    float reading = trueDistance + noise(rng);
+    return (uint16_t)std::max(1.0f, reading);
+}
+
+static void addSample(Trace& trace, uint32_t timeMs, float trueDistance, float threshold, std::mt19937& rng) {
+    trace.samples.push_back({timeMs, senseDistance(trueDistance, rng), trueDistance < threshold});
+}
+
+// Drive toward a wall, push against it, back off
+static Trace approachTrace(unsigned index, float threshold, std::mt19937& rng) {
+    std::uniform_real_distribution<float> uniform(0, 1);
+    Trace trace;
+    trace.name = "approach " + std::to_string(index);
+    float distance = 600 + uniform(rng) * 900;
+    float speed = 80 + uniform(rng) * 220;              // mm/s
+    float stopAt = 15 + uniform(rng) * 35;
+    uint32_t holdMs = 300 + (uint32_t)(uniform(rng) * 700);
+    uint32_t time = 0;
+
+    while (distance > stopAt) {
+        addSample(trace, time, distance, threshold, rng);
+        distance -= speed * SAMPLE_PERIOD_MS / 1000.0f;
+        time += SAMPLE_PERIOD_MS;
+    }
+    for (uint32_t held = 0; held < holdMs; held += SAMPLE_PERIOD_MS, time += SAMPLE_PERIOD_MS) {
+        addSample(trace, time, stopAt, threshold, rng);
+    }
+    while (distance < 400) {
+        addSample(trace, time, distance, threshold, rng);
+        distance += 150 * SAMPLE_PERIOD_MS / 1000.0f;
+        time += SAMPLE_PERIOD_MS;
+    }
+    return trace;
+}
+
+// Wander for a while without touching anything: open space, walls passing
+// by, objects coming close but staying outside the threshold
+static Trace roamingTrace(unsigned index, float threshold, std::mt19937& rng) {
+    std::uniform_real_distribution<float> uniform(0, 1);
+    Trace trace;
+    trace.name = "roaming " + std::to_string(index);
+    uint32_t time = 0;
+    while (time < 30000) {
+        float start = uniform(rng) < 0.4f ? 2500 : 200 + uniform(rng) * 1200;
+        float end = uniform(rng) < 0.4f ? 2500 : threshold + 30 + uniform(rng) * 800;
+        uint32_t durationMs = 500 + (uint32_t)(uniform(rng) * 3000);
+        for (uint32_t t = 0; t < durationMs; t += SAMPLE_PERIOD_MS, time += SAMPLE_PERIOD_MS) {
+            addSample(trace, time, start + (end - start) * t / durationMs, threshold, rng);
+        }
+    }
+    return trace;
+}
+
+// ================= Replay =================
+
+struct Candidate {
+    std::string name;
+    std::unique_ptr<CollisionDetector> detector;
+};
+
+struct Result {
+    unsigned episodes;
+    unsigned detected;
+    unsigned falseAlarms;
+    double nonContactMs;
+    std::vector<double> latencies;    // ms
+    double nanosPerSample;
+};
+
+static void replayTrace(CollisionDetector& detector, const Trace& trace, Result& result) {
+    struct Episode { uint32_t start; uint32_t end; bool detected; };
+    std::vector<Episode> episodes;
+    std::vector<uint32_t> onsets;
+
+    detector.reset();
+    bool wasDetected = false;
+    for (size_t i = 0; i < trace.samples.size(); i++) {
+        const Sample& sample = trace.samples[i];
+        bool previousContact = i > 0 && trace.samples[i - 1].contact;
+        if (sample.contact && !previousContact) episodes.push_back({sample.timeMs, sample.timeMs, false});
+        if (sample.contact) episodes.back().end = sample.timeMs;
+        else if (i > 0) result.nonContactMs += sample.timeMs - trace.samples[i - 1].timeMs;
+
+        bool detected = detector.update(sample.distance);
+        if (detected && !wasDetected) onsets.push_back(sample.timeMs);
+        wasDetected = detected;
+    }
+
+    // Each episode takes the first onset from EDGE_TOLERANCE_MS before its start, later
+    // onsets up to EDGE_TOLERANCE_MS after its end are chatter around the threshold
+    for (uint32_t onset : onsets) {
+        bool matched = false;
+        for (Episode& episode : episodes) {
+            if (onset + EDGE_TOLERANCE_MS >= episode.start && onset <= episode.end + EDGE_TOLERANCE_MS) {
+                if (!episode.detected) {
+                    episode.detected = true;
+                    result.latencies.push_back(onset > episode.start ? onset - episode.start : 0);
+                }
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) result.falseAlarms++;
+    }
+    for (const Episode& episode : episodes) {
+        result.episodes++;
+        if (episode.detected) result.detected++;
+    }
+}
+
+static Result replay(CollisionDetector& detector, const std::vector<Trace>& traces) {
+    Result result = {0, 0, 0, 0, {}, 0};
+    size_t samples = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Trace& trace : traces) {
+        replayTrace(detector, trace, result);
+        samples += trace.samples.size();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    result.nanosPerSample = elapsed.count() / std::max<size_t>(samples, 1);
+    return result;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return NAN;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)std::min<double>(values.size() - 1, floor(fraction * values.size()));
+    return values[index];
+}
+
+static void printResult(const std::string& name, const Result& result) {
+    double mean = 0;
+    for (double latency : result.latencies) mean += latency;
+    if (!result.latencies.empty()) mean /= result.latencies.size();
+    double falsePerHour = result.nonContactMs > 0 ? result.falseAlarms * 3600000.0 / result.nonContactMs : 0;
+    printf("%-30s %4u/%-4u %7.1f %7.1f %7.1f %7.1f %6u %9.1f %7.0f\n", name.c_str(),
+           result.detected, result.episodes, mean, percentile(result.latencies, 0.5),
+           percentile(result.latencies, 0.95),
+           result.latencies.empty() ? NAN : *std::max_element(result.latencies.begin(), result.latencies.end()),
+           result.falseAlarms, falsePerHour, result.nanosPerSample);
+}
+
+int main(int argc, char** argv) {
+    float threshold = DEFAULT_THRESHOLD;
+    unsigned seed = 1;
+    std::vector<Trace> traces;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            threshold = strtof(argv[++i], nullptr);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-t thresholdMm] [-s seed] [trace.csv ...]\n", argv[0]);
+            return 2;
+        } else {
+            Trace trace;
+            if (!loadTrace(argv[i], trace)) return 1;
+            traces.push_back(trace);
+        }
+    }
+
+    if (traces.empty()) {
+        std::mt19937 rng(seed);
+        for (unsigned i = 0; i < 200; i++) traces.push_back(approachTrace(i, threshold, rng));
+        for (unsigned i = 0; i < 120; i++) traces.push_back(roamingTrace(i, threshold, rng));
+        printf("Synthetic traces (seed %u): 200 approaches, 120 x 30 s roaming\n", seed);
+    } else {
+        printf("%zu recorded traces\n", traces.size());
+    }
+    printf("Threshold %.0f mm\n\n", threshold);
+
+    std::vector<Candidate> candidates;
+    auto add = [&](const char* name, CollisionDetector* detector) {
+        candidates.push_back({name, std::unique_ptr<CollisionDetector>(detector)});
+    };
+    add("smoothed run 30 (original)", new SmoothedRunDetector(threshold, MAX_VALID_DISTANCE, 30));
+    add("smoothed run 5", new SmoothedRunDetector(threshold, MAX_VALID_DISTANCE, 5));
+    add("hampel w3 3.0s c1", new HampelDetector(threshold, MAX_VALID_DISTANCE, 3, 3.0f, 1));
+    add("hampel w5 3.0s c1", new HampelDetector(threshold, MAX_VALID_DISTANCE, 5, 3.0f, 1));
+    add("hampel w5 3.0s c2", new HampelDetector(threshold, MAX_VALID_DISTANCE, 5, 3.0f, 2));
+    add("hampel w7 3.0s c2", new HampelDetector(threshold, MAX_VALID_DISTANCE, 7, 3.0f, 2));
+    add("hampel w9 2.5s c3", new HampelDetector(threshold, MAX_VALID_DISTANCE, 9, 2.5f, 3));
+    add("cusum d5 h40 c20", new CusumDetector(threshold, MAX_VALID_DISTANCE, 5, 40, 20));
+    add("cusum d5 h60 c20", new CusumDetector(threshold, MAX_VALID_DISTANCE, 5, 60, 20));
+    add("cusum d10 h60 c25", new CusumDetector(threshold, MAX_VALID_DISTANCE, 10, 60, 25));
+    add("cusum d10 h100 c25", new CusumDetector(threshold, MAX_VALID_DISTANCE, 10, 100, 25));
+
+    printf("%-30s %9s %7s %7s %7s %7s %6s %9s %7s\n", "detector", "found", "mean", "p50", "p95", "max",
+           "false", "false/h", "ns");
+    printf("%-30s %9s %7s %7s %7s %7s %6s %9s %7s\n", "", "", "ms", "ms", "ms", "ms", "", "", "/sample");
+    for (Candidate& candidate : candidates) {
+        printResult(candidate.name, replay(*candidate.detector, traces));
+    }
+    return 0;
+}
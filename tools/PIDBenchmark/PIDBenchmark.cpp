@@ -0,0 +1,130 @@
+/**
+ * PID Benchmark - Host Tool
+ *
+ * Compares the cost of one wheel control update with the firmware's
+ * PIDController (both wheels in one call, float, gains folded at compile
+ * time) and with two PID_v1 instances (double, millis() sample gate),
+ * the way MotorController used them before.
+ *
+ * Both controllers are fed the same recorded setpoint and encoder traces
+ * so only the controller code is timed. Results are in nanoseconds per
+ * update and, on x86, TSC cycles per update. Host numbers only give the
+ * ratio; absolute figures on the Teensy come from the "m" command.
+ *
+ * Usage: PIDBenchmark [updates]
+ */
+
+#include "../../src/PlayBot/PIDConfig.h"
+#include "../../src/PlayBot/PIDController.h"
+#include <PID_v1.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+// Trace length, a power of two so the index wraps with a mask
+static const unsigned TRACE_LENGTH = 4096;
+
+// Fake clock for PID_v1, one millisecond per update so it never skips
+static unsigned long fakeMillis = 0;
+unsigned long millis() { return fakeMillis; }
+
+// Setpoints and encoder readings of both wheels following an animation
+struct Trace {
+    float setpoint[TRACE_LENGTH][2];
+    float input[TRACE_LENGTH][2];
+};
+
+// Wheels following a sine with lag, plus one tick of encoder quantization
+static void recordTrace(Trace& trace) {
+    for (unsigned i = 0; i < TRACE_LENGTH; i++) {
+        float t = i / 1000.0f;
+        for (unsigned wheel = 0; wheel < 2; wheel++) {
+            float sign = wheel == 0 ? 1.0f : -1.0f;
+            trace.setpoint[i][wheel] = sign * 800.0f * sinf(2.0f * 3.14159265f * 0.5f * t);
+            trace.input[i][wheel] = roundf(sign * 780.0f * sinf(2.0f * 3.14159265f * 0.5f * (t - 0.03f)));
+        }
+    }
+}
+
+struct Timing {
+    double nanosPerUpdate;
+    double cyclesPerUpdate;
+    double checksum;              // Keeps the outputs alive
+};
+
+template <class Step>
+static Timing measure(unsigned long updates, Step step) {
+    Timing timing = {0, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_TSC
+    unsigned long long startCycles = __rdtsc();
+#endif
+    for (unsigned long i = 0; i < updates; i++) {
+        timing.checksum += step(i & (TRACE_LENGTH - 1));
+    }
+#ifdef HAVE_TSC
+    timing.cyclesPerUpdate = (double)(__rdtsc() - startCycles) / updates;
+#endif
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    timing.nanosPerUpdate = elapsed.count() / updates;
+    return timing;
+}
+
+static void printTiming(const char* name, const Timing& timing) {
+    printf("%-28s %8.2f ns/update", name, timing.nanosPerUpdate);
+#ifdef HAVE_TSC
+    printf(" %8.1f cycles/update", timing.cyclesPerUpdate);
+#endif
+    printf("   (checksum %.0f)\n", timing.checksum);
+}
+
+int main(int argc, char** argv) {
+    unsigned long updates = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000000UL;
+    if (updates == 0) {
+        fprintf(stderr, "Usage: %s [updates]\n", argv[0]);
+        return 2;
+    }
+
+    static Trace trace;
+    recordTrace(trace);
+
+    // Two PID_v1 instances wired through double globals, as in HardwareConfig.h
+    static double input[2], output[2], setpoint[2];
+    PID pidRight(&input[0], &output[0], &setpoint[0], PID_KP, PID_KI, PID_KD, DIRECT);
+    PID pidLeft(&input[1], &output[1], &setpoint[1], PID_KP, PID_KI, PID_KD, DIRECT);
+    PID* pids[2] = {&pidRight, &pidLeft};
+    for (PID* pid : pids) {
+        pid->SetOutputLimits(-PID_OUTPUT_LIMIT, PID_OUTPUT_LIMIT);
+        pid->SetMode(AUTOMATIC);
+        pid->SetSampleTime(PID_SAMPLE_PERIOD_US / 1000);
+    }
+
+    Timing legacy = measure(updates, [&](unsigned i) {
+        fakeMillis += PID_SAMPLE_PERIOD_US / 1000;
+        for (unsigned wheel = 0; wheel < 2; wheel++) {
+            setpoint[wheel] = trace.setpoint[i][wheel];
+            input[wheel] = trace.input[i][wheel];
+        }
+        pidRight.Compute();
+        pidLeft.Compute();
+        return output[0] - output[1];
+    });
+
+    PIDController<WheelPIDConfig, 2> controller;
+    float outputs[2];
+    Timing batched = measure(updates, [&](unsigned i) {
+        controller.update(trace.setpoint[i], trace.input[i], outputs);
+        return (double)outputs[0] - outputs[1];
+    });
+
+    printf("%lu updates of both wheels\n", updates);
+    printTiming("PID_v1 (2 x Compute)", legacy);
+    printTiming("PIDController<2>::update", batched);
+    printf("Speedup: %.2fx\n", legacy.nanosPerUpdate / batched.nanosPerUpdate);
+    return 0;
+}
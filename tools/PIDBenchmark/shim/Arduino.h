@@ -0,0 +1,4 @@
+// Minimal Arduino.h to build the PID_v1 library on a host
+// millis() is provided by PIDBenchmark.cpp and advanced by hand
+#pragma once
+unsigned long millis();
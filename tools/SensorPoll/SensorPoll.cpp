@@ -0,0 +1,194 @@
+/**
+ * Sensor Poll - Host Tool
+ *
+ * Benchmarks the "d" sensor data request the way the Playdate uses it:
+ * polls at a fixed rate over a serial link, measures the round trip of
+ * each request up to its "msg d/..." response, then asks the firmware for
+ * its own handling time with "d/t". Other messages the firmware sends
+ * meanwhile are ignored.
+ *
+ * Usage: SensorPoll [-r hz] [-n requests] [-b baud] device
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Time to wait for a response before counting the request as lost
+static const int RESPONSE_TIMEOUT_MS = 500;
+
+// ================= Serial Link =================
+
+// Open a serial device in raw mode
+static int openSerial(const char* path, speed_t baud) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot open: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, baud);
+        cfsetospeed(&tty, baud);
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return fd;
+}
+
+// Write a whole message followed by a newline
+static bool sendMessage(int fd, const std::string& message) {
+    std::string line = message + "\n";
+    const char* data = line.c_str();
+    size_t left = line.size();
+    while (left > 0) {
+        ssize_t written = write(fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    return true;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Wait until deadline for a line starting with prefix, other lines are dropped
+// Returns false on timeout or when the link closes
+static bool waitForLine(int fd, std::string& pending, const char* prefix, double deadline, std::string& line) {
+    for (;;) {
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos) {
+            line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.compare(0, strlen(prefix), prefix) == 0) return true;
+        }
+
+        int timeoutMs = (int)((deadline - now()) * 1000);
+        if (timeoutMs <= 0) return false;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready <= 0) continue;
+
+        char chunk[256];
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count <= 0) return false;
+        pending.append(chunk, count);
+    }
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    return values[index];
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-r hz] [-n requests] [-b baud] device\n"
+            "  -r hz        Poll rate (default 30)\n"
+            "  -n requests  Requests to send (default 300)\n"
+            "  -b baud      Serial speed (default 115200)\n",
+            program);
+}
+
+int main(int argc, char** argv) {
+    int rate = 30;
+    int requests = 300;
+    speed_t baud = B115200;
+    const char* device = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            requests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            int speed = atoi(argv[++i]);
+            baud = speed == 57600 ? B57600 : speed == 230400 ? B230400 : B115200;
+        } else if (argv[i][0] == '-' || device) {
+            printUsage(argv[0]);
+            return 2;
+        } else {
+            device = argv[i];
+        }
+    }
+    if (!device || rate < 1 || rate > 1000 || requests < 1) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    int fd = openSerial(device, baud);
+    if (fd < 0) return 1;
+
+    // Start the firmware's statistics window from this run
+    std::string pending;
+    std::string line;
+    sendMessage(fd, "d/t");
+    if (!waitForLine(fd, pending, "msg d/t/", now() + 1.0, line)) {
+        fprintf(stderr, "%s: no answer to \"d/t\", is the firmware running?\n", device);
+        close(fd);
+        return 1;
+    }
+
+    std::vector<double> roundTrips;    // ms
+    int lost = 0;
+    double period = 1.0 / rate;
+    double next = now();
+    for (int i = 0; i < requests; i++) {
+        double wait = next - now();
+        if (wait > 0) usleep((useconds_t)(wait * 1e6));
+        next += period;
+
+        double sent = now();
+        if (!sendMessage(fd, "d")) {
+            fprintf(stderr, "%s: write failed: %s\n", device, strerror(errno));
+            close(fd);
+            return 1;
+        }
+        if (waitForLine(fd, pending, "msg d/", sent + RESPONSE_TIMEOUT_MS / 1000.0, line)) {
+            roundTrips.push_back((now() - sent) * 1000);
+        } else {
+            lost++;
+        }
+    }
+
+    sendMessage(fd, "d/t");
+    bool stats = waitForLine(fd, pending, "msg d/t/", now() + 1.0, line);
+    close(fd);
+
+    double mean = 0;
+    for (double roundTrip : roundTrips) mean += roundTrip;
+    if (!roundTrips.empty()) mean /= roundTrips.size();
+    printf("%d requests at %d Hz, %d lost\n", requests, rate, lost);
+    printf("Round trip ms: mean %.2f  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f\n", mean,
+           percentile(roundTrips, 0.5), percentile(roundTrips, 0.95), percentile(roundTrips, 0.99),
+           percentile(roundTrips, 1.0));
+
+    unsigned long handled, maxUs;
+    char avgUs[16];
+    if (stats && sscanf(line.c_str(), "msg d/t/%lu/%lu/%15s", &handled, &maxUs, avgUs) == 3) {
+        printf("Firmware handling: %lu requests, max %lu us, avg %s us\n", handled, maxUs, avgUs);
+    } else {
+        printf("Firmware handling time not reported\n");
+    }
+    return 0;
+}
@@ -0,0 +1,527 @@
+/**
+ * Stream Loopback - Host Tool
+ *
+ * Streams an animation through a pseudo-terminal into the firmware's
+ * stream path on Linux and checks the flow control end to end. One side
+ * plays the Playdate: it sends "s/fps", then packs one frame per credit
+ * into "k/" messages the way tools/AnimationStreamer does. The other side
+ * runs the firmware code: the "k/" frame parser (StreamFrames.h) fed by
+ * reads of at most USB_READ_WINDOW bytes like CommunicationManager, and
+ * the jitter buffer granting credits (StreamLayer.h), updated every
+ * millisecond like the main loop.
+ *
+ * Checks, for a clean run, a run where writes and reads are split at
+ * random points, and a run with malformed frames:
+ * - every intact frame is received once, in order, with its values
+ * - malformed frames are counted as lost and give their credit back
+ * - credits in flight stay between 0 and what fits in one read window
+ * - no overrun, and no underrun before the last frame was received
+ * - reads ending inside a message or a frame actually happened, and the
+ *   frames they cut were completed by the next read
+ *
+ * Usage: StreamLoopback [-s seed] [-n frames] [-r fps] [input.txt]
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+// ================= Firmware Stand-ins =================
+// StreamLayer.h is built without the hardware and debug headers: it only
+// needs playdateLink, DEBUG_PRINT, micros() and min(). Config.h still
+// gives the stream settings of the firmware.
+#define HARDWARE_CONFIG_H
+#define DEBUG_H
+#define DEBUG_INFO 1
+#define DEBUG_WARNING 2
+#define DEBUG_PRINT(level, ...) \
+    do { \
+        if (verbose) { \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } while (0)
+
+static bool verbose = false;
+static const auto clockStart = std::chrono::steady_clock::now();
+
+static uint32_t micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - clockStart).count();
+}
+
+using std::min;
+
+// Messages to the Playdate, written to the firmware end of the pseudo-terminal
+// Counts the credits granted in "msg k/n" lines
+struct HostLink {
+    int fd = -1;
+    uint32_t granted = 0;
+
+    void println(const char* message) {
+        unsigned credits;
+        if (sscanf(message, "msg k/%u", &credits) == 1) granted += credits;
+        std::string line = std::string(message) + "\r\n";
+        const char* data = line.c_str();
+        size_t left = line.size();
+        while (left > 0) {
+            ssize_t written = write(fd, data, left);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            data += written;
+            left -= written;
+        }
+    }
+};
+
+static HostLink playdateLink;
+
+#include "../../src/PlayBot/Config.h"
+#include "../../src/PlayBot/AnimationFormat.h"
+#include "../../src/PlayBot/StreamFrames.h"
+#include "../../src/PlayBot/StreamLayer.h"
+
+// Credits the firmware may have in flight (StreamLayer::MAX_CREDITS)
+static const uint32_t MAX_CREDITS = (USB_READ_WINDOW - 2) / STREAM_FRAME_MAX_BYTES;
+// Longest "k/" message sent by the Playdate side, as in AnimationStreamer
+static const size_t MAX_MESSAGE_BYTES = 78;
+
+static int failures = 0;
+
+static void check(bool passed, const char* name, const std::string& detail = "") {
+    if (passed) {
+        printf("PASS  %s\n", name);
+    } else {
+        printf("FAIL  %s%s%s\n", name, detail.empty() ? "" : ": ", detail.c_str());
+        failures++;
+    }
+}
+
+// ================= Frames =================
+
+// Read every frame of a text animation: index/head_position/right_wheel/left_wheel
+static bool readTextAnimation(const char* path, std::vector<AnimationFrame>& frames) {
+    FILE* input = fopen(path, "r");
+    if (!input) {
+        fprintf(stderr, "%s: cannot open: %s\n", path, strerror(errno));
+        return false;
+    }
+    char lineBuf[256];
+    unsigned lineNumber = 0;
+    bool ok = true;
+    while (fgets(lineBuf, sizeof(lineBuf), input)) {
+        lineNumber++;
+        if (lineBuf[0] == '\n' || lineBuf[0] == '\r' || lineBuf[0] == '\0') continue;
+        double index, head, wheelRight, wheelLeft;
+        if (sscanf(lineBuf, "%lf/%lf/%lf/%lf", &index, &head, &wheelRight, &wheelLeft) != 4) {
+            fprintf(stderr, "%s:%u: invalid frame\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+        frames.push_back({(int16_t)lround(head), (int16_t)lround(wheelRight), (int16_t)lround(wheelLeft)});
+    }
+    fclose(input);
+    return ok;
+}
+
+// Head sweeps and wheels driving back and forth, like an exported animation,
+// with a few frames at the longest text ("2500/-32768/-32768;") and heads
+// outside the servo range (hold the head)
+static std::vector<AnimationFrame> syntheticFrames(int count) {
+    std::vector<AnimationFrame> frames;
+    for (int i = 0; i < count; i++) {
+        double t = i / 100.0;
+        AnimationFrame frame;
+        frame.head = (int16_t)lround(1500 + 900 * sin(t * 1.3));
+        frame.wheelRight = (int16_t)lround(12000 * sin(t * 0.4) + 300 * t);
+        frame.wheelLeft = (int16_t)lround(12000 * sin(t * 0.4 + 0.5) - 300 * t);
+        if (i % 97 == 50) {
+            frame = {2500, INT16_MIN, INT16_MIN};
+        } else if (i % 89 == 40) {
+            frame.head = 0;
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+static bool sameFrame(const AnimationFrame& a, const AnimationFrame& b) {
+    return a.head == b.head && a.wheelRight == b.wheelRight && a.wheelLeft == b.wheelLeft;
+}
+
+// ================= Playdate Side =================
+
+struct RunOptions {
+    const char* name;
+    bool splitWrites;             // Write each message in random pieces with short pauses
+    bool randomReads;             // Read 1 to USB_READ_WINDOW bytes per pass instead of the window
+    int malformedEvery;           // Replace every n-th frame by a malformed one, 0 for none
+};
+
+// Write all bytes, in random pieces when split is set
+static bool writeAll(int fd, const std::string& data, bool split, std::mt19937& random) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t length = data.size() - offset;
+        if (split) length = std::min(length, (size_t)(random() % 24 + 1));
+        ssize_t written = write(fd, data.data() + offset, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += written;
+        if (split && random() % 3 == 0) usleep(random() % 300);
+    }
+    return true;
+}
+
+// Text of a malformed frame: wrong field count, a letter inside a value,
+// or garbage longer than any frame; never starts with a letter, which
+// would be read as a command
+static std::string malformedFrame(std::mt19937& random) {
+    switch (random() % 3) {
+        case 0: return "1500/12;";
+        case 1: return "1500/1x2/3;";
+        default: return "77/garbage-longer-than-a-frame;";
+    }
+}
+
+struct PlaydateResult {
+    std::vector<AnimationFrame> intact;   // Frames sent intact, in order
+    uint32_t malformed = 0;
+    uint32_t messages = 0;
+    bool linkFailed = false;
+    bool stalled = false;
+};
+
+// Stream frames as credits come in, then stop the stream once it has played out
+static void runPlaydate(int fd, const std::vector<AnimationFrame>& frames, int frameRate,
+                        const RunOptions& options, unsigned seed, PlaydateResult& result) {
+    std::mt19937 random(seed);
+    std::string pending;
+    uint32_t credits = 0;
+    auto lastGrant = std::chrono::steady_clock::now();
+
+    if (!writeAll(fd, "s/" + std::to_string(frameRate) + "\n", false, random)) {
+        result.linkFailed = true;
+        return;
+    }
+    size_t sent = 0;
+    while (sent < frames.size()) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, credits > 0 ? 0 : 20) > 0) {
+            char chunk[256];
+            ssize_t count = read(fd, chunk, sizeof(chunk));
+            if (count <= 0) {
+                result.linkFailed = true;
+                return;
+            }
+            pending.append(chunk, count);
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos) {
+                unsigned granted;
+                if (sscanf(pending.c_str(), "msg k/%u", &granted) == 1) {
+                    credits += granted;
+                    lastGrant = std::chrono::steady_clock::now();
+                }
+                pending.erase(0, newline + 1);
+            }
+        }
+        if (credits == 0) {
+            if (std::chrono::steady_clock::now() - lastGrant > std::chrono::seconds(2)) {
+                result.stalled = true;
+                return;
+            }
+            continue;
+        }
+
+        // Pack as many granted frames as fit in one message
+        std::string message = "k/";
+        while (credits > 0 && sent < frames.size()) {
+            std::string text;
+            bool malformed = options.malformedEvery > 0 && random() % options.malformedEvery == 0;
+            if (malformed) {
+                text = malformedFrame(random);
+            } else {
+                const AnimationFrame& frame = frames[sent];
+                char value[24];
+                snprintf(value, sizeof(value), "%d/%d/%d;", frame.head, frame.wheelRight, frame.wheelLeft);
+                text = value;
+            }
+            if (message.size() + text.size() > MAX_MESSAGE_BYTES) break;
+            message += text;
+            credits--;
+            if (malformed) {
+                result.malformed++;
+            } else {
+                result.intact.push_back(frames[sent]);
+                sent++;
+            }
+        }
+        if (!writeAll(fd, message + "\n", options.splitWrites, random)) {
+            result.linkFailed = true;
+            return;
+        }
+        result.messages++;
+    }
+
+    // Let the jitter buffer play out before stopping the stream
+    usleep(1000000 / frameRate * (STREAM_BUFFER_FRAMES + 4));
+    writeAll(fd, "s/0\n", false, random);
+}
+
+// ================= Firmware Side =================
+
+// Reads like CommunicationManager in the text protocol, streamed frames to
+// the jitter buffer
+struct Firmware {
+    StreamLayer streamLayer;
+    StreamFrameParser<STREAM_FRAME_MAX_BYTES> streamFrames;
+    char buffer[512];
+    std::vector<AnimationFrame> received;
+    uint32_t dropped = 0;
+    uint32_t reads = 0;
+    uint32_t cutMessages = 0;     // Reads ending between two frames of a message
+    uint32_t cutFrames = 0;       // Reads ending inside a frame
+    int32_t minInFlight = 0;
+    int32_t maxInFlight = 0;
+    uint32_t underrunsAtLastFrame = 0;
+    size_t expectedFrames = 0;
+    bool stopped = false;
+
+    // Sink of the frame parser (AnimationManager on the robot)
+    void pushStreamFrame(const AnimationFrame& frame) {
+        received.push_back(frame);
+        streamLayer.pushFrame(frame);
+        if (received.size() == expectedFrames) underrunsAtLastFrame = streamLayer.getUnderruns();
+    }
+
+    void dropStreamFrame() {
+        dropped++;
+        streamLayer.dropFrame();
+    }
+
+    void handleStreamFrames() {
+        char* command = streamFrames.parse(buffer, *this);
+        if (command == NULL) return;
+        memmove(buffer, command, strlen(command) + 1);
+        handleMessage();
+    }
+
+    void handleMessage() {
+        if (buffer[0] == 'k') {
+            handleStreamFrames();
+        } else if (buffer[0] == 's' && buffer[1] == '/') {
+            int frameRate = atoi(buffer + 2);
+            if (frameRate <= 0) {
+                streamLayer.stop();
+                stopped = true;
+            } else if (frameRate <= STREAM_MAX_FRAME_RATE) {
+                streamLayer.start(frameRate, 0, 0);
+            }
+        }
+    }
+
+    // One read pass of at most window bytes
+    void readPass(int fd, size_t window) {
+        char chunk[USB_READ_WINDOW];
+        ssize_t rd = read(fd, chunk, std::min(window, sizeof(chunk)));
+        if (rd <= 0) return;
+        reads++;
+        if (!streamLayer.isActive()) streamFrames.reset();
+        if (streamFrames.isPending()) {
+            size_t kept = streamFrames.takeTail(buffer);
+            memcpy(buffer + kept, chunk, rd);
+            buffer[kept + rd] = '\0';
+            handleStreamFrames();
+        } else {
+            memcpy(buffer, chunk, rd);
+            buffer[rd] = '\0';
+            size_t ending = strspn(buffer, "\r\n");
+            if (ending > 0) memmove(buffer, buffer + ending, rd - ending + 1);
+            handleMessage();
+        }
+        if (streamFrames.isPending()) {
+            if (chunk[rd - 1] == ';') {
+                cutMessages++;
+            } else {
+                cutFrames++;
+            }
+        }
+    }
+
+    // Credits granted and not yet used by a received or dropped frame
+    void trackCredits() {
+        int32_t inFlight = (int32_t)playdateLink.granted - (int32_t)(received.size() + dropped);
+        minInFlight = std::min(minInFlight, inFlight);
+        maxInFlight = std::max(maxInFlight, inFlight);
+    }
+};
+
+// ================= Runs =================
+
+static void runLoopback(const std::vector<AnimationFrame>& frames, int frameRate,
+                        const RunOptions& options, unsigned seed) {
+    printf("\n%s\n", options.name);
+    int master, slave;
+    if (openpty(&master, &slave, NULL, NULL, NULL) != 0) {
+        check(false, "open pseudo-terminal", strerror(errno));
+        return;
+    }
+    struct termios tty;
+    if (tcgetattr(slave, &tty) == 0) {
+        cfmakeraw(&tty);
+        tcsetattr(slave, TCSANOW, &tty);
+    }
+
+    Firmware firmware;
+    firmware.expectedFrames = frames.size();
+    playdateLink.fd = slave;
+    playdateLink.granted = 0;
+
+    PlaydateResult playdate;
+    std::thread playdateThread(runPlaydate, master, std::cref(frames), frameRate,
+                               std::cref(options), seed, std::ref(playdate));
+
+    std::mt19937 random(seed + 1);
+    auto start = std::chrono::steady_clock::now();
+    auto limit = start + std::chrono::milliseconds(frames.size() * 3000 / frameRate + 5000);
+    while (!firmware.stopped && std::chrono::steady_clock::now() < limit) {
+        // Main loop pass: read what the USB link has, then advance the stream
+        struct pollfd pfd = {slave, POLLIN, 0};
+        if (poll(&pfd, 1, 1) > 0) {
+            // "s/" commands are read whole like the USB packet carrying them, only frames are split
+            bool split = options.randomReads && firmware.streamLayer.isActive() &&
+                         firmware.received.size() < firmware.expectedFrames;
+            size_t window = split ? random() % USB_READ_WINDOW + 1 : USB_READ_WINDOW;
+            firmware.readPass(slave, window);
+        }
+        firmware.streamLayer.update(micros());
+        firmware.trackCredits();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    playdateThread.join();
+    close(master);
+    close(slave);
+
+    const StreamLayer& layer = firmware.streamLayer;
+    printf("      %zu frames in %.2f s (%.1f fps), %u messages, %u reads, %u credits granted\n",
+           firmware.received.size(), seconds, firmware.received.size() / seconds,
+           playdate.messages, firmware.reads, playdateLink.granted);
+    printf("      reads ending inside a message %u, inside a frame %u\n",
+           firmware.cutMessages, firmware.cutFrames);
+    printf("      played %lu, underruns %lu, overruns %lu, lost %lu, credits in flight %d to %d\n",
+           (unsigned long)layer.getFramesPlayed(), (unsigned long)layer.getUnderruns(),
+           (unsigned long)layer.getOverruns(), (unsigned long)layer.getLostFrames(),
+           firmware.minInFlight, firmware.maxInFlight);
+
+    char detail[96];
+    check(!playdate.linkFailed && !playdate.stalled && firmware.stopped, "stream ran to its end",
+          playdate.stalled ? "no credits for 2 s" : playdate.linkFailed ? "link failed" : "no s/0 received");
+
+    size_t matching = 0;
+    while (matching < firmware.received.size() && matching < playdate.intact.size() &&
+           sameFrame(firmware.received[matching], playdate.intact[matching])) {
+        matching++;
+    }
+    snprintf(detail, sizeof(detail), "%zu sent, %zu received, first difference at %zu",
+             playdate.intact.size(), firmware.received.size(), matching);
+    check(playdate.intact.size() == frames.size() && firmware.received.size() == frames.size() &&
+          matching == frames.size(), "every intact frame received once, in order", detail);
+
+    snprintf(detail, sizeof(detail), "%u malformed sent, %u dropped, %lu lost",
+             playdate.malformed, firmware.dropped, (unsigned long)layer.getLostFrames());
+    check(firmware.dropped == playdate.malformed && layer.getLostFrames() == playdate.malformed,
+          "malformed frames lost and their credits given back", detail);
+
+    snprintf(detail, sizeof(detail), "%d to %d, at most %u", firmware.minInFlight, firmware.maxInFlight, MAX_CREDITS);
+    check(firmware.minInFlight >= 0 && firmware.maxInFlight <= (int32_t)MAX_CREDITS,
+          "credits in flight fit in one read window", detail);
+
+    snprintf(detail, sizeof(detail), "%lu overruns, %u underruns before the last frame",
+             (unsigned long)layer.getOverruns(), firmware.underrunsAtLastFrame);
+    check(layer.getOverruns() == 0 && firmware.underrunsAtLastFrame == 0, "no overrun or underrun", detail);
+
+    snprintf(detail, sizeof(detail), "%lu of %zu", (unsigned long)layer.getFramesPlayed(), frames.size());
+    check(layer.getFramesPlayed() == frames.size(), "every frame played", detail);
+
+    // Whole messages fit in the window, reads only end inside a frame when the link splits them
+    if (options.splitWrites || options.randomReads) {
+        snprintf(detail, sizeof(detail), "%u reads ended inside a message, %u inside a frame",
+                 firmware.cutMessages, firmware.cutFrames);
+        check(firmware.cutMessages > 0 && firmware.cutFrames > 0,
+              "messages and frames cut by the end of a read were completed", detail);
+    }
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-s seed] [-n frames] [-r fps] [-v] [input.txt]\n"
+            "  -s seed    Seed of the write and read splits and malformed frames (default 1)\n"
+            "  -n frames  Synthetic frames per run when no input is given (default 1000)\n"
+            "  -r fps     Stream frame rate (default %d)\n"
+            "  -v         Print the firmware debug messages\n",
+            program, STREAM_MAX_FRAME_RATE);
+}
+
+int main(int argc, char** argv) {
+    unsigned seed = 1;
+    int count = 1000;
+    int frameRate = STREAM_MAX_FRAME_RATE;
+    const char* input = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            frameRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (argv[i][0] != '-' && input == NULL) {
+            input = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (count < 1 || frameRate < 1 || frameRate > STREAM_MAX_FRAME_RATE) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<AnimationFrame> frames;
+    if (input) {
+        if (!readTextAnimation(input, frames)) return 1;
+        if (frames.empty()) {
+            fprintf(stderr, "%s: no frames\n", input);
+            return 1;
+        }
+    } else {
+        frames = syntheticFrames(count);
+    }
+    printf("Streaming %zu frames at %d fps, read window %d bytes, %u credits in flight at most\n",
+           frames.size(), frameRate, USB_READ_WINDOW, MAX_CREDITS);
+
+    runLoopback(frames, frameRate, {"Clean loopback", false, false, 0}, seed);
+    runLoopback(frames, frameRate, {"Split writes and reads", true, true, 0}, seed);
+    runLoopback(frames, frameRate, {"Malformed frames", true, true, 25}, seed);
+
+    printf("\n%s\n", failures == 0 ? "All checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}